@@ -4,28 +4,82 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 C_SRCS += \
+../amplitudeenvelope.c \
+../arena.c \
 ../convolution.c \
 ../convolve.c \
 ../dawsonaudio.c \
+../fastmath.c \
 ../fft.c \
+../gain.c \
 ../impulse.c \
-../vector.c 
+../impulselibrary.c \
+../mappedaudio.c \
+../parallel.c \
+../prefetch.c \
+../prng.c \
+../refiner.c \
+../render.c \
+../resample.c \
+../sampleformat.c \
+../spectra.c \
+../spectraledit.c \
+../spectralmodel.c \
+../spectrogram.c \
+../vector.c \
+../writer.c 
 
 OBJS += \
+./amplitudeenvelope.o \
+./arena.o \
 ./convolution.o \
 ./convolve.o \
 ./dawsonaudio.o \
+./fastmath.o \
 ./fft.o \
+./gain.o \
 ./impulse.o \
-./vector.o 
+./impulselibrary.o \
+./mappedaudio.o \
+./parallel.o \
+./prefetch.o \
+./prng.o \
+./refiner.o \
+./render.o \
+./resample.o \
+./sampleformat.o \
+./spectra.o \
+./spectraledit.o \
+./spectralmodel.o \
+./spectrogram.o \
+./vector.o \
+./writer.o 
 
 C_DEPS += \
+./amplitudeenvelope.d \
+./arena.d \
 ./convolution.d \
 ./convolve.d \
 ./dawsonaudio.d \
+./fastmath.d \
 ./fft.d \
+./gain.d \
 ./impulse.d \
-./vector.d 
+./impulselibrary.d \
+./mappedaudio.d \
+./parallel.d \
+./prefetch.d \
+./prng.d \
+./refiner.d \
+./render.d \
+./resample.d \
+./sampleformat.d \
+./spectra.d \
+./spectraledit.d \
+./spectralmodel.d \
+./spectrogram.d \
+./vector.d \
+./writer.d 
 
 
 # Each subdirectory must supply rules for building sources it contributes
@@ -0,0 +1,141 @@
+/*
+ * amplitudeenvelope.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Dawson
+ */
+
+#include <math.h>
+#include "amplitudeenvelope.h"
+#include "fastmath.h"
+
+// Running sums for the fit of the per-sample envelope
+typedef struct EnvelopeFit {
+	float *frames; // one block of the per-sample envelope
+	double sumLog;
+	double sumLogTimesX;
+} EnvelopeFit;
+
+static AmplitudeEnvelope *allocateAmplitudeEnvelope(int numBlocks,
+		int64_t numFrames, int spacing, Arena *arena) {
+	AmplitudeEnvelope *envelope = (AmplitudeEnvelope *) arenaAlloc(arena,
+			sizeof(AmplitudeEnvelope));
+	envelope->numFrames = numFrames;
+	envelope->spacing = spacing;
+	envelope->numBlocks = numBlocks;
+	envelope->average = (float *) arenaAlloc(arena,
+			sizeof(float) * numBlocks);
+	envelope->A = 1.0f;
+	envelope->b = 0.0f;
+	return envelope;
+}
+
+// Add the frames of the envelope from first (up to a block of them)
+static void addToFit(const AmplitudeEnvelope *envelope, EnvelopeFit *fit,
+		int64_t first, int n) {
+	double sumLog, sumLogTimesX;
+	getAmplitudeEnvelopeFrames(envelope, first, n, fit->frames);
+	sumLogs(fit->frames, n, &sumLog, &sumLogTimesX);
+	fit->sumLog += sumLog;
+	fit->sumLogTimesX += sumLogTimesX + (double) first * sumLog;
+}
+
+// Add the frames of blocks [first, end) to the fit. Each needs its own
+// average and the next block's.
+static void addBlocksToFit(const AmplitudeEnvelope *envelope, EnvelopeFit *fit,
+		int first, int end) {
+	int i;
+	for (i = first; i < end; i++) {
+		addToFit(envelope, fit, (int64_t) i * envelope->spacing,
+				envelope->spacing);
+	}
+}
+
+// Add the frames after the interpolated blocks (all at the floor)
+static void finishFit(AmplitudeEnvelope *envelope, EnvelopeFit *fit) {
+	int64_t first = envelope->numBlocks > 0 ?
+			(int64_t) (envelope->numBlocks - 1) * envelope->spacing : 0;
+	if (first < envelope->numFrames) {
+		double n = (double) (envelope->numFrames - first);
+		double logFloor = logf(AMPLITUDE_ENVELOPE_FLOOR);
+		fit->sumLog += n * logFloor;
+		fit->sumLogTimesX += logFloor * (n * first + n * (n - 1.0) / 2.0);
+	}
+
+	if (envelope->numFrames > 1) {
+		float a;
+		fitLine(envelope->numFrames, fit->sumLog, fit->sumLogTimesX, &a,
+				&envelope->b);
+		envelope->A = expf(a);
+	}
+}
+
+AmplitudeEnvelope *analyzeAmplitudeEnvelope(const float *samples,
+		int64_t numFrames, int spacing, Arena *arena) {
+
+	int i, j;
+	int numBlocks = (int) (numFrames / spacing);
+
+	AmplitudeEnvelope *envelope = allocateAmplitudeEnvelope(numBlocks,
+			numFrames, spacing, arena);
+	EnvelopeFit fit = { (float *) arenaAlloc(arena, sizeof(float) * spacing),
+			0.0, 0.0 };
+
+	for (i = 0; i < numBlocks; i++) {
+		const float *block = samples + (int64_t) i * spacing;
+		v4sf sum = v4sf_set1(0.0f);
+		for (j = 0; j + SIMD_WIDTH <= spacing; j += SIMD_WIDTH) {
+			sum += v4sf_abs(v4sf_load(block + j));
+		}
+		float total = v4sf_sum(sum);
+		for (; j < spacing; j++) {
+			total += fabsf(block[j]);
+		}
+		envelope->average[i] = total / spacing;
+
+		// The block before this one can be interpolated now
+		if (i > 0) {
+			addBlocksToFit(envelope, &fit, i - 1, i);
+		}
+	}
+	finishFit(envelope, &fit);
+
+	return envelope;
+}
+
+AmplitudeEnvelope *createAmplitudeEnvelope(const float *average, int numBlocks,
+		int64_t numFrames, int spacing, Arena *arena) {
+
+	AmplitudeEnvelope *envelope = allocateAmplitudeEnvelope(numBlocks,
+			numFrames, spacing, arena);
+	EnvelopeFit fit = { (float *) arenaAlloc(arena, sizeof(float) * spacing),
+			0.0, 0.0 };
+
+	int i;
+	for (i = 0; i < numBlocks; i++) {
+		envelope->average[i] = average[i];
+	}
+	addBlocksToFit(envelope, &fit, 0, numBlocks - 1);
+	finishFit(envelope, &fit);
+
+	return envelope;
+}
+
+void getAmplitudeEnvelopeFrames(const AmplitudeEnvelope *envelope,
+		int64_t first, int n, float *out) {
+
+	int k;
+	for (k = 0; k < n; k++) {
+		int64_t frame = first + k;
+		int64_t i = frame / envelope->spacing;
+		float value = 0.0f;
+		if (i < envelope->numBlocks - 1) {
+			float increment = (envelope->average[i + 1] - envelope->average[i])
+					/ (float) envelope->spacing;
+			value = envelope->average[i]
+					+ (frame - i * envelope->spacing) * increment;
+		}
+		out[k] = value < AMPLITUDE_ENVELOPE_FLOOR ?
+				AMPLITUDE_ENVELOPE_FLOOR : value;
+	}
+}
@@ -0,0 +1,47 @@
+/*
+ * amplitudeenvelope.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Dawson
+ */
+
+#ifndef AMPLITUDEENVELOPE_H_
+#define AMPLITUDEENVELOPE_H_
+
+#include <stdint.h>
+#include "arena.h"
+
+// Floor of the per-sample envelope (so its log is defined)
+#define AMPLITUDE_ENVELOPE_FLOOR	0.000001f
+
+/*
+ * The amplitude envelope of an impulse, kept as the average absolute
+ * amplitude of every block of spacing frames. The per-sample envelope
+ * (straight lines between block averages, with the last block and any
+ * frames after it at the floor) is only evaluated where it is needed.
+ *
+ * The least-squares fit of A * exp(b * frame) to the per-sample envelope is
+ * worked out as the envelope is built, without storing the samples.
+ */
+typedef struct AmplitudeEnvelope {
+	int64_t numFrames;
+	int spacing; // frames per block
+	int numBlocks;
+	float *average; // [block]
+	float A;
+	float b;
+} AmplitudeEnvelope;
+
+// Analyze samples in one pass
+AmplitudeEnvelope *analyzeAmplitudeEnvelope(const float *samples,
+		int64_t numFrames, int spacing, Arena *arena);
+
+// Rebuild an envelope from block averages (e.g. from a spectral model)
+AmplitudeEnvelope *createAmplitudeEnvelope(const float *average, int numBlocks,
+		int64_t numFrames, int spacing, Arena *arena);
+
+// The per-sample envelope for frames [first, first + n)
+void getAmplitudeEnvelopeFrames(const AmplitudeEnvelope *envelope,
+		int64_t first, int n, float *out);
+
+#endif /* AMPLITUDEENVELOPE_H_ */
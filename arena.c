@@ -0,0 +1,91 @@
+/*
+ * arena.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "arena.h"
+
+// Chunk headers are padded so that the memory after them is aligned
+#define CHUNK_HEADER_SIZE	((sizeof(ArenaChunk) + ARENA_ALIGNMENT - 1) \
+		/ ARENA_ALIGNMENT * ARENA_ALIGNMENT)
+
+static ArenaChunk *createChunk(size_t size) {
+	void *memory = NULL;
+	if (posix_memalign(&memory, ARENA_ALIGNMENT, CHUNK_HEADER_SIZE + size)
+			!= 0) {
+		printf("Error: unable to allocate memory. Exiting.\n");
+		exit(1);
+	}
+	ArenaChunk *chunk = (ArenaChunk *) memory;
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+	return chunk;
+}
+
+Arena *createArena(size_t chunkSize) {
+	Arena *arena = (Arena *) malloc(sizeof(Arena));
+	arena->chunkSize = chunkSize;
+	arena->chunks = createChunk(chunkSize);
+	arena->bytes = 0;
+	return arena;
+}
+
+void *arenaAlloc(Arena *arena, size_t size) {
+
+	size = (size + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+	if (size == 0) {
+		size = ARENA_ALIGNMENT;
+	}
+
+	ArenaChunk *chunk = arena->chunks;
+	if (size > arena->chunkSize) {
+		// A chunk of its own, behind the current one so that the space left
+		// in the current one is still used
+		chunk = createChunk(size);
+		chunk->next = arena->chunks->next;
+		arena->chunks->next = chunk;
+	} else if (chunk->size - chunk->used < size) {
+		chunk = createChunk(arena->chunkSize);
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+	}
+
+	void *memory = (unsigned char *) chunk + CHUNK_HEADER_SIZE + chunk->used;
+	chunk->used += size;
+	arena->bytes += size;
+	return memory;
+}
+
+void *arenaCalloc(Arena *arena, size_t count, size_t size) {
+	void *memory = arenaAlloc(arena, count * size);
+	memset(memory, 0, count * size);
+	return memory;
+}
+
+void resetArena(Arena *arena) {
+	// Keep the current chunk; it is never one of the oversized ones
+	while (arena->chunks->next) {
+		ArenaChunk *chunk = arena->chunks->next;
+		arena->chunks->next = chunk->next;
+		free(chunk);
+	}
+	arena->chunks->used = 0;
+	arena->bytes = 0;
+}
+
+void free_Arena(Arena *arena) {
+	if (arena) {
+		while (arena->chunks) {
+			ArenaChunk *chunk = arena->chunks;
+			arena->chunks = chunk->next;
+			free(chunk);
+		}
+		free(arena);
+	}
+}
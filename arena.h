@@ -0,0 +1,48 @@
+/*
+ * arena.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stddef.h>
+
+// Alignment (in bytes) of every allocation, enough for any vector load
+#define ARENA_ALIGNMENT		32
+
+typedef struct ArenaChunk {
+	struct ArenaChunk *next;
+	size_t size;
+	size_t used;
+} ArenaChunk;
+
+/*
+ * Memory for the temporaries of one job (e.g. one synthesis). Allocations
+ * are carved out of large chunks in order and never freed one by one; the
+ * whole arena is freed, or reset for reuse, at once.
+ */
+typedef struct Arena {
+	ArenaChunk *chunks; // most recent first
+	size_t chunkSize;
+	size_t bytes; // allocated from the arena since it was created or reset
+} Arena;
+
+// Create an arena that grows chunkSize bytes at a time (or by a larger chunk
+// when an allocation needs one)
+Arena *createArena(size_t chunkSize);
+
+// Allocate from the arena (exits if out of memory)
+void *arenaAlloc(Arena *arena, size_t size);
+
+// Allocate count zeroed elements from the arena
+void *arenaCalloc(Arena *arena, size_t count, size_t size);
+
+// Release every allocation, keeping one chunk for reuse
+void resetArena(Arena *arena);
+
+void free_Arena(Arena *arena);
+
+#endif /* ARENA_H_ */
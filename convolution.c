@@ -10,13 +10,20 @@
 #define FFT_SIZE 						MIN_FFT_BLOCK_SIZE
 #define SMOOTHING_AMT					2048
 #define HALF_FFT_SIZE 					FFT_SIZE/2
-#define SAMPLES_PER_MS					SAMPLE_RATE/1000
-#define LEFT							1
-#define RIGHT							2
+#define ENGINE_SAMPLE_RATE				SAMPLE_RATE // 44100, 48000, 88200, 96000 or 192000
+#define CROSSOVER_LENGTH_MS				200
+#define CROSSOVER_POINT_MS				50
 #define LIVE_AUDIO_INPUT				true
 #define AUDIO_FILE_INPUT				!LIVE_AUDIO_INPUT
-#define IMPULSE_FILE_NAME				"resources/impulses/Factory Hall.wav"
+#define IMPULSE_DIRECTORY				"resources/impulses"
+#define IMPULSE_FILE_NAME				IMPULSE_DIRECTORY "/Factory Hall.wav"
+#define IMPULSE_CACHE_BUDGET_MB			512 // prepared impulses kept in memory
 #define AUDIO_FILE_NAME					"resources/audio/sax.wav"
+#define SPECTRA_CACHE_DIR				"resources/cache" // prepared impulses
+#define FILE_INPUT_READ_AHEAD			16 // blocks decoded ahead of playback
+#define SYNTHESIS_ARENA_CHUNK_SIZE		(4 << 20) // bytes
+#define PREVIEW_LENGTH_MS				1000 // of noise synthesized before it is heard
+#define REFINEMENT_DELAY_MS				250 // after the last edit, before the full impulse
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -33,12 +40,26 @@
 #include <ncurses.h>
 #include <sys/resource.h>
 #include <sys/times.h>
+#include <sys/stat.h>
 #include <pthread.h>
 #include "dawsonaudio.h"
 #include "convolve.h"
 #include "vector.h"
 #include "impulse.h"
 #include "fft.h"
+#include "sampleformat.h"
+#include "prefetch.h"
+#include "spectra.h"
+#include "spectralmodel.h"
+#include "impulselibrary.h"
+#include "parallel.h"
+#include "arena.h"
+#include "prng.h"
+#include "fastmath.h"
+#include "spectrogram.h"
+#include "amplitudeenvelope.h"
+#include "spectraledit.h"
+#include "refiner.h"
 #include <GLUT/glut.h>
 
 GLsizei g_width = 1200;
@@ -68,11 +89,10 @@ GLfloat g_inc_y = 0.0f;
 GLfloat g_inc_x = 0.0f;
 GLfloat g_linewidth = 1.0f;
 
-float top_vals_left[HALF_FFT_SIZE];
-float bottom_vals_left[HALF_FFT_SIZE];
-float top_vals_right[HALF_FFT_SIZE];
-float bottom_vals_right[HALF_FFT_SIZE];
-float *g_amp_envelope;
+// Graph values, one row of HALF_FFT_SIZE bins per impulse channel
+float (*top_vals)[HALF_FFT_SIZE];
+float (*bottom_vals)[HALF_FFT_SIZE];
+int g_num_graph_channels = 0;
 float g_max = 0.0f;
 
 char *audio_file_name = NULL;
@@ -142,17 +162,20 @@ typedef struct ImpulseHorizontalSelect {
 
 ImpulseHorizontalSelect *impulseHorizontalSelect = NULL;
 
+// Rate the engine runs at (set by setEngineSampleRate)
+int g_sample_rate;
+
 // Length of crossover between synthesized and recorded impulse
-int crossover_length = 200 * SAMPLES_PER_MS;
+int crossover_length;
 
 // Location of point at which crossover between synthesized and recorded impulse begins
-int crossover_point = 50 * SAMPLES_PER_MS;
+int crossover_point;
 
 int g_impulse_num_frames;
 
 int g_changes_made = 0;
 
-int g_current_channel_view = LEFT;
+int g_current_channel_view = 0; // index of the impulse channel being edited
 
 int g_r_pressed = false;
 
@@ -228,10 +251,9 @@ Mouse TheMouse = {0,0,0,0,0};
 typedef struct {
 	float amplitude1;
 	float sampleRate;
-	SNDFILE *infile1;
-	SF_INFO sfinfo1;
-	int channels;
-	float buffer1[MIN_FFT_BLOCK_SIZE*2];
+	PrefetchReader *reader;
+	const float *input; // current mono block, owned by the reader
+	float *silence; // played when the reader falls behind
 } paData;
 
 void RecomputeImpulseButtonCallback();
@@ -268,6 +290,8 @@ typedef struct FFTArgs {
 	int impulse_block_number;
 	int num_callbacks_to_complete;
 	int counter;
+	FFTData *fftData; // the impulse's partitions when the work was queued (held)
+	int generation;
 } FFTArgs;
 
 FFTData *g_fftData_ptr; // Stores the Fourier-transforms of each block of the impulse
@@ -277,13 +301,11 @@ int g_impulse_length; // The length in frames of the impulse
 int g_num_blocks; // The number of equal-size blocks into which the impulse will be divided
 int g_max_factor; // The highest power of 2 used to divide the impulse into blocks
 int g_input_storage_buffer_length; // The length of the buffer used to store incoming audio from the mic
-int g_output_storage_buffer1_length; // channel 1
-int g_output_storage_buffer2_length; // channel 2
+int g_output_storage_buffer_length; // The length of each channel's output storage buffer
 int g_end_sample; // The index of the last sample in g_storage_buffer
 int g_counter = 0; // Keep track of how many callback cycles have passed
 
-long g_block_duration_in_nanoseconds = (NANOSECONDS_IN_A_SECOND / SAMPLE_RATE)
-				* MIN_FFT_BLOCK_SIZE;
+long g_block_duration_in_nanoseconds;
 
 Vector g_powerOf2Vector; // Stores the correct number of powers of 2 to make the block calculations work (lol)
 
@@ -293,6 +315,138 @@ pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t condition = PTHREAD_COND_INITIALIZER;
 
 audioData* g_impulse;
+bool g_impulse_edited = false; // g_impulse was resynthesized, so it isn't the library's
+FFTData *g_impulse_spectra; // the spectra of g_impulse, without live edits
+uint64_t g_noise_seed; // seeds the noise of g_impulse, so edits keep the same noise
+
+/*
+ * The impulses in IMPULSE_DIRECTORY. The engine's impulse is held, and so is
+ * each one it used before until no partition convolves with it any more (see
+ * RetiredImpulse), so none is evicted while partitions may still use it.
+ */
+ImpulseLibrary *g_library;
+int g_library_index = -1; // impulse shown and used by the engine
+int g_library_requested = -1; // being prepared, to switch to when ready
+
+/*
+ * An impulse the engine switched away from. Once its spectra have no users,
+ * the library's is released and a resynthesized one is freed. Spectra
+ * replaced outside the audio callback also wait for a callback to complete,
+ * since one running then may have read the pointer and not yet counted
+ * itself as a user (see acquireEngineSpectra()).
+ */
+typedef struct RetiredImpulse {
+	FFTData *fftData;
+	audioData *impulse; // resynthesized (freed with fftData), or NULL
+	int libraryIndex; // to release, or -1
+	unsigned long callbackCount; // g_callback_count when it was retired
+	struct RetiredImpulse *next;
+} RetiredImpulse;
+
+RetiredImpulse *g_retired_impulses;
+
+/*
+ * The engine's block counts and buffers for an impulse. Those for an impulse
+ * switched to are made on the GUI thread, so that the audio callback only
+ * swaps them with its own.
+ */
+typedef struct EngineBuffers {
+	int num_blocks;
+	int max_factor;
+	int input_storage_buffer_length;
+	int output_storage_buffer_length;
+	int end_sample;
+	float *input_storage_buffer;
+	int num_output_channels;
+	float **output_storage_buffers;
+	Vector powerOf2Vector;
+} EngineBuffers;
+
+/*
+ * A switch to a prepared impulse, or to a resynthesis of the impulse in use.
+ * The audio callback installs it by taking up its spectra and swapping its
+ * buffers with the engine's, so the block counts, buffers and spectra all
+ * change between two blocks; the engine's previous buffers are freed on the
+ * GUI thread once it has.
+ */
+typedef struct ImpulseSwitch {
+	PreparedImpulse *prepared; // NULL for a resynthesis
+	FFTData *fftData;
+	EngineBuffers buffers;
+} ImpulseSwitch;
+
+ImpulseSwitch *g_pending_impulse; // switched to, not yet installed in the engine
+ImpulseSwitch *g_impulse_switch; // the switch made last, until it is installed
+volatile int g_impulse_generation = 0; // incremented when the engine's impulse changes
+unsigned long g_callback_count = 0; // audio callbacks completed
+
+/*
+ * Live editing ('e'): the engine convolves with spectra that follow the graph
+ * as it is drawn (see spectraledit.h). The editor replaced last is kept until
+ * the next one is, since partitions may still be using its spectra.
+ */
+bool g_live_editing = false;
+SpectralEditor *g_spectral_editor;
+SpectralEditor *g_previous_spectral_editor;
+float *g_spectra_graph; // [channel][bin] top values the engine's spectra were synthesized from
+
+/*
+ * What resynthesizeImpulse() last made of each channel: the graph it was
+ * drawn from, the decay it was fitted to (A * exp(b * block) per bin) and
+ * the filtered noise. A channel none of whose bins changed since reuses its
+ * noise, cut or extended along the same decay when the length changes.
+ * Anything else that shapes the noise (seed, g_max, graph height)
+ * invalidates every channel.
+ *
+ * Every channel's graph is fitted over the same span (fitBlocks): the length
+ * of the impulse when the cache was last invalidated. A bin reaches its
+ * bottom value at the end of that span whatever the length is now, so a
+ * channel decays the same way whether it was edited since or not.
+ */
+typedef struct ChannelSynthesis {
+	float top[HALF_FFT_SIZE];
+	float bottom[HALF_FFT_SIZE];
+	float A[HALF_FFT_SIZE];
+	float b[HALF_FFT_SIZE];
+	float *noise;
+	int64_t numFrames; // of noise, which may outlast the impulse
+} ChannelSynthesis;
+
+typedef struct SynthesisCache {
+	int numChannels;
+	int fitBlocks; // span of every channel's decay
+	uint64_t seed;
+	float max;
+	float height;
+	ChannelSynthesis *channels;
+} SynthesisCache;
+
+SynthesisCache g_synthesis_cache;
+
+/*
+ * Resynthesis is progressive: reloadImpulse() puts a preview in the engine
+ * whose noise stops after PREVIEW_LENGTH_MS (then fades to silence), and the
+ * refiner synthesizes the rest once the edits stop, for
+ * installRefinedImpulse() to put in its place. Everything the refinement
+ * reads is its own copy.
+ */
+typedef struct ImpulseRefinement {
+	int numChannels;
+	int64_t numFrames; // before zero-padding
+	int sampleRate;
+	int blockLength;
+	uint64_t seed;
+	ChannelSynthesis *channels; // the synthesis cache, as the preview left it
+	audioData *attack; // start of the impulse the preview replaced
+	audioData *preview; // zero-padded
+	FFTData *previewSpectra; // held (as a user) until the refinement is freed
+	audioData *target; // the preview in use, only to tell it is still in use
+
+	audioData *impulse; // zero-padded
+	FFTData *fftData;
+} ImpulseRefinement;
+
+Refiner *g_refiner;
 
 /*
  * This buffer is used to store INCOMING audio from the mic.
@@ -302,8 +456,9 @@ float *g_input_storage_buffer;
 /*
  * This buffer is used to store OUTGOING audio that has been processed.
  */
-float *g_output_storage_buffer1; // channel 1
-float *g_output_storage_buffer2; // channel 2
+float **g_output_storage_buffers; // one per impulse channel
+int g_num_output_channels;
+int g_num_stream_channels; // fixed when the stream opens; impulses may differ
 
 void setWindowRange();
 void idleFunc();
@@ -315,7 +470,25 @@ void keyboardUpFunc(unsigned char, int, int);
 void initialize_graphics();
 void initialize_glut(int argc, char *argv[]);
 void reloadImpulse();
-float **getExponentialFitFromGraph(int num_impulse_blocks, int channel);
+void switchToLibraryImpulse(int index);
+void checkLibraryImpulse();
+void retireImpulse(FFTData *fftData, audioData *impulse, int libraryIndex);
+void freeImpulseSwitch();
+void finishImpulseSwitch();
+void publishImpulseSwitch(PreparedImpulse *prepared, FFTData *fftData,
+		int numFrames, int numChannels);
+void installPendingImpulse();
+void installRefinedImpulse();
+void updateLiveEditing();
+void saveSpectraGraph();
+void initializePowerOf2Vector(Vector *vector, int max_factor);
+void initializeImpulseLengthSlider();
+Spectrogram *getExponentialFitFromGraph(int num_impulse_blocks,
+		int fit_blocks, int channel, float *A, float *b, Arena *arena);
+void extendFilteredWhiteNoise(float *synthesized_impulse_buffer,
+		int64_t firstFrame, int64_t numFrames,
+		const Spectrogram *impulse_filter_env_blocks_exp_fit, uint64_t seed,
+		int channel, Arena *arena);
 bool mouseCloseToTopLine();
 bool mouseCloseToMidLine();
 bool mouseCloseToBottomLine();
@@ -326,25 +499,110 @@ bool mouseCloserToRightBound();
 bool mouseBeganInImpulseHorizontalSelect();
 GraphData *getValuesFromGraph(int current_channel);
 
-void initializeGlobalParameters() {
+/*
+ * This function sets everything that depends on the engine's sample rate.
+ * The block length grows with the rate (512 frames at 44.1/48 kHz, 1024 at
+ * 88.2/96 kHz, 2048 at 192 kHz) so that each callback, and each partition of
+ * the impulse, covers about the same time at every rate. That keeps the
+ * per-callback deadline, and the number of partitions per second of impulse,
+ * close to what they are at 44.1 kHz.
+ */
+void setEngineSampleRate(int sampleRate) {
+	g_sample_rate = sampleRate;
+	crossover_length = CROSSOVER_LENGTH_MS * sampleRate / 1000;
+	crossover_point = CROSSOVER_POINT_MS * sampleRate / 1000;
+
+	// Nearest power of 2 multiple of MIN_FFT_BLOCK_SIZE to the same duration
 	g_block_length = MIN_FFT_BLOCK_SIZE;
-	g_num_blocks = g_impulse_length / g_block_length;
-	g_max_factor = g_num_blocks / 4;
-	g_input_storage_buffer_length = g_impulse_length / 4;
-	g_output_storage_buffer1_length = g_input_storage_buffer_length * 2;
-	g_output_storage_buffer2_length = g_input_storage_buffer_length * 2;
-	g_end_sample = g_input_storage_buffer_length - 1;
-
-	// Allocate memory for storage buffer, fill with 0s.
-	g_input_storage_buffer = (float *) calloc(g_input_storage_buffer_length,
-			sizeof(float));
+	while ((int64_t) g_block_length * SAMPLE_RATE * 3
+			< (int64_t) MIN_FFT_BLOCK_SIZE * sampleRate * 2) {
+		g_block_length *= 2;
+	}
+	g_block_duration_in_nanoseconds = (long) ((int64_t) NANOSECONDS_IN_A_SECOND
+			* g_block_length / sampleRate);
+}
 
-	// Allocate memory for output storage buffer, fill with 0s.
-	g_output_storage_buffer1 = (float *) calloc(g_output_storage_buffer1_length,
-			sizeof(float));
-	g_output_storage_buffer2 = (float *) calloc(g_output_storage_buffer2_length,
-			sizeof(float));
+/*
+ * This function sets the block counts and buffer lengths for an impulse of
+ * impulse_length frames.
+ */
+void setBufferLengths(EngineBuffers *buffers, int impulse_length) {
+	buffers->num_blocks = impulse_length / g_block_length;
+	buffers->max_factor = buffers->num_blocks / 4;
+	buffers->input_storage_buffer_length = impulse_length / 4;
+	buffers->output_storage_buffer_length =
+			buffers->input_storage_buffer_length * 2;
+	buffers->end_sample = buffers->input_storage_buffer_length - 1;
+}
+
+/*
+ * This function makes the engine's buffers, filled with 0s, for an impulse
+ * of impulse_length frames and num_channels channels.
+ */
+void initializeEngineBuffers(EngineBuffers *buffers, int impulse_length,
+		int num_channels) {
+	setBufferLengths(buffers, impulse_length);
+
+	// Storage for incoming audio
+	buffers->input_storage_buffer = (float *) calloc(
+			buffers->input_storage_buffer_length, sizeof(float));
+
+	// Output storage buffers, one per impulse channel
+	buffers->num_output_channels = num_channels;
+	buffers->output_storage_buffers = (float **) malloc(
+			sizeof(float *) * num_channels);
+	for (int c = 0; c < num_channels; c++) {
+		buffers->output_storage_buffers[c] = allocateChannelBuffer(
+				buffers->output_storage_buffer_length);
+	}
+
+	initializePowerOf2Vector(&buffers->powerOf2Vector, buffers->max_factor);
+}
+
+void free_EngineBuffers(EngineBuffers *buffers) {
+	free(buffers->input_storage_buffer);
+	for (int c = 0; c < buffers->num_output_channels; c++) {
+		free(buffers->output_storage_buffers[c]);
+	}
+	free(buffers->output_storage_buffers);
+	vector_free(&buffers->powerOf2Vector);
+}
 
+/*
+ * This function exchanges the engine's block counts and buffers with those
+ * in buffers. It only swaps pointers, so the audio callback can call it.
+ */
+void swapEngineBuffers(EngineBuffers *buffers) {
+	EngineBuffers engine = { g_num_blocks, g_max_factor,
+			g_input_storage_buffer_length, g_output_storage_buffer_length,
+			g_end_sample, g_input_storage_buffer, g_num_output_channels,
+			g_output_storage_buffers, g_powerOf2Vector };
+
+	g_num_blocks = buffers->num_blocks;
+	g_max_factor = buffers->max_factor;
+	g_input_storage_buffer_length = buffers->input_storage_buffer_length;
+	g_output_storage_buffer_length = buffers->output_storage_buffer_length;
+	g_end_sample = buffers->end_sample;
+	g_input_storage_buffer = buffers->input_storage_buffer;
+	g_num_output_channels = buffers->num_output_channels;
+	g_output_storage_buffers = buffers->output_storage_buffers;
+	g_powerOf2Vector = buffers->powerOf2Vector;
+
+	*buffers = engine;
+}
+
+void initializeGlobalParameters() {
+	EngineBuffers buffers;
+	initializeEngineBuffers(&buffers, g_impulse_length, g_impulse->numChannels);
+	// The engine had none yet
+	swapEngineBuffers(&buffers);
+}
+
+void clearOutputStorageBuffers() {
+	for (int c = 0; c < g_num_output_channels; c++) {
+		memset(g_output_storage_buffers[c], 0,
+				sizeof(float) * g_output_storage_buffer_length);
+	}
 }
 
 int max(int a, int b) {
@@ -840,7 +1098,7 @@ void SliderDraw(Slider *s) {
 		Font(GLUT_BITMAP_HELVETICA_10, buf, s->x_pos-6, s->y+4);
 	} else if (strcmp(s->label, "Length") == 0) {
 		glColor3f(1,1,1);
-		snprintf(buf, 20, "%f", (float)currentValue/(float)SAMPLE_RATE);
+		snprintf(buf, 20, "%f", (float)currentValue/(float)g_sample_rate);
 		Font(GLUT_BITMAP_HELVETICA_10, strcat(buf, " sec"), s->x_min + 40, s->y-15);
 	} else if (strcmp(s->label, "Input Sensitivity") == 0 || strcmp(s->label, "Dry/Wet") == 0) {
 		snprintf(buf, 20, "%d", currentValue);
@@ -949,20 +1207,14 @@ void RecomputeImpulseButtonCallback() {
 	g_changes_made++;
 	g_changingImpulse = true;
 	int i;
-	for (i=0; i<g_output_storage_buffer1_length; i++) {
-		g_output_storage_buffer1[i] = 0.0f;
-		g_output_storage_buffer2[i] = 0.0f;
-	}
+	clearOutputStorageBuffers();
 	for (i=0; i<g_input_storage_buffer_length; i++) {
 		g_input_storage_buffer[i] = 0.0f;
 	}
 	reloadImpulse();
 	printf("impulse reloaded\n");
 	g_r_pressed = true;
-	for (i=0; i<g_output_storage_buffer1_length; i++) {
-		g_output_storage_buffer1[i] = 0.0f;
-		g_output_storage_buffer2[i] = 0.0f;
-	}
+	clearOutputStorageBuffers();
 	for (i=0; i<g_input_storage_buffer_length; i++) {
 		g_input_storage_buffer[i] = 0.0f;
 	}
@@ -976,14 +1228,8 @@ void ReverseButtonCallback() {
 		return;
 	}
 
-	if (g_current_channel_view == LEFT) {
-		for (int i=0; i<graphData->length; i++) {
-			top_vals_left[graphData->first_index + i] = graphData->y_values[graphData->length - 1 - i];
-		}
-	} else if (g_current_channel_view == RIGHT) {
-		for (int i=0; i<graphData->length; i++) {
-			top_vals_right[graphData->first_index + i] = graphData->y_values[graphData->length - 1 - i];
-		}
+	for (int i=0; i<graphData->length; i++) {
+		top_vals[g_current_channel_view][graphData->first_index + i] = graphData->y_values[graphData->length - 1 - i];
 	}
 
 
@@ -995,15 +1241,12 @@ void ReverseButtonCallback() {
 void RandomizeButtonCallback() {
 	printf("Randomizing...\n");
 	for (int i=0; i<HALF_FFT_SIZE; i++) {
-		//		printf("top_vals_left[%d]: %f\n", i, top_vals_left[i]);
+		//		printf("top_vals[0][%d]: %f\n", i, top_vals[0][i]);
 		float randomVal = ((rand() / (float) RAND_MAX) - 0.5)*0.05 + 1;
 		//		printf("random: %f\n", randomVal);
-		if (top_vals_left[i] * randomVal < 0.0f && top_vals_left[i] * randomVal > -6.0f) {
-			top_vals_left[i] *= randomVal;
-		}
-		if (g_impulse->numChannels == STEREO) {
-			if (top_vals_right[i] * randomVal < 0.0f && top_vals_left[i] * randomVal > -6.0f) {
-				top_vals_right[i] *= randomVal;
+		for (int c=0; c<g_num_graph_channels; c++) {
+			if (top_vals[c][i] * randomVal < 0.0f && top_vals[c][i] * randomVal > -6.0f) {
+				top_vals[c][i] *= randomVal;
 			}
 		}
 	}
@@ -1029,12 +1272,18 @@ void SmoothnessSliderCallback() {
 }
 
 void ChannelSliderCallback() {
-	if (abs(ChannelSlider.x_pos - ChannelSlider.x_min) < abs(ChannelSlider.x_pos - ChannelSlider.x_max)) {
-		ChannelSlider.current_val = LEFT;
-	} else {
-		ChannelSlider.current_val = RIGHT;
-	}
-	g_current_channel_view = ChannelSlider.current_val;
+	// One equal-width stop per impulse channel, numbered from 1
+	int range = ChannelSlider.x_max - ChannelSlider.x_min;
+	float distance = (float) (ChannelSlider.x_pos - ChannelSlider.x_min) / (float) range;
+	int currentValue = ceil(distance * g_num_graph_channels);
+	if (currentValue < 1) {
+		currentValue = 1;
+	}
+	if (currentValue > g_num_graph_channels) {
+		currentValue = g_num_graph_channels;
+	}
+	ChannelSlider.current_val = currentValue;
+	g_current_channel_view = currentValue - 1;
 }
 
 void DryWetSliderCallback() {
@@ -1096,7 +1345,7 @@ void ImpulseLengthSliderCallback() {
 	}
 
 	ImpulseLengthSlider.current_val = currentValue;
-	printf("The impulse length is now %f seconds\n", (float) ImpulseLengthSlider.current_val/(float)SAMPLE_RATE);
+	printf("The impulse length is now %f seconds\n", (float) ImpulseLengthSlider.current_val/(float)g_sample_rate);
 	g_impulse_num_frames = currentValue;
 	RecomputeImpulseButtonCallback();
 }
@@ -1142,6 +1391,13 @@ void initialize_glut(int argc, char *argv[]) {
 }
 
 void idleFunc() {
+	if (g_library) {
+		checkLibraryImpulse();
+	}
+	if (g_refiner) {
+		installRefinedImpulse();
+	}
+	updateLiveEditing();
 	glutPostRedisplay();
 }
 
@@ -1163,10 +1419,7 @@ void keyboardFunc(unsigned char key, int x, int y) {
 			g_changes_made++;
 			g_changingImpulse = true;
 			int i;
-			for (i=0; i<g_output_storage_buffer1_length; i++) {
-				g_output_storage_buffer1[i] = 0.0f;
-				g_output_storage_buffer2[i] = 0.0f;
-			}
+			clearOutputStorageBuffers();
 			for (i=0; i<g_input_storage_buffer_length; i++) {
 				g_input_storage_buffer[i] = 0.0f;
 			}
@@ -1174,10 +1427,7 @@ void keyboardFunc(unsigned char key, int x, int y) {
 			reloadImpulse();
 			printf("impulse reloaded\n");
 			g_r_pressed = true;
-			for (i=0; i<g_output_storage_buffer1_length; i++) {
-				g_output_storage_buffer1[i] = 0.0f;
-				g_output_storage_buffer2[i] = 0.0f;
-			}
+			clearOutputStorageBuffers();
 			for (i=0; i<g_input_storage_buffer_length; i++) {
 				g_input_storage_buffer[i] = 0.0f;
 			}
@@ -1187,6 +1437,24 @@ void keyboardFunc(unsigned char key, int x, int y) {
 	case 'q':
 		exit(0);
 		break;
+	case 'e':
+		g_live_editing = !g_live_editing;
+		printf("live editing %s\n", g_live_editing ? "on" : "off");
+		break;
+	case '[':
+		// Previous impulse in the library
+		if (g_library && g_library->numImpulses > 0) {
+			int current = g_library_requested >= 0 ? g_library_requested : g_library_index;
+			switchToLibraryImpulse(current > 0 ? current - 1 : g_library->numImpulses - 1);
+		}
+		break;
+	case ']':
+		// Next impulse in the library
+		if (g_library && g_library->numImpulses > 0) {
+			int current = g_library_requested >= 0 ? g_library_requested : g_library_index;
+			switchToLibraryImpulse((current + 1) % g_library->numImpulses);
+		}
+		break;
 	case 'p':
 		if (smooth_draw && smooth_draw_amt < HALF_FFT_SIZE / 8) {
 			smooth_draw_amt++;
@@ -1476,157 +1744,81 @@ void displayFunc() {
 			}
 		}
 
-		if (g_current_channel_view == LEFT) {
-			// If draw button is pressed
-			if (TheMouse.lmb == 1) {
+		float *current_top_vals = top_vals[g_current_channel_view];
+		// If draw button is pressed
+		if (TheMouse.lmb == 1) {
 
-				//			printf("index: %d\n", index);
+			//			printf("index: %d\n", index);
 
-				if (index < 0) {
-					index = 0;
-				}
-				if (index > HALF_FFT_SIZE - 1) {
-					index = HALF_FFT_SIZE - 1;
-				}
+			if (index < 0) {
+				index = 0;
+			}
+			if (index > HALF_FFT_SIZE - 1) {
+				index = HALF_FFT_SIZE - 1;
+			}
 
-				// Set the value of the top_vals array using the y-value of the mouse position
-				//			printf("Mouse: %d, %d\n", TheMouse.x, TheMouse.y);
-				float newVal = 6 * ((float) impulseWindow->margin_top - (float) TheMouse.y) / ((float) impulseWindow->margin_bottom - (float) impulseWindow->margin_top);
-				//				printf("NewVal: %f\n", newVal);
-				if (newVal > 0.0f) {
-					newVal = 0.0f;
-				}
-				if (newVal < -5.99f) {
-					newVal = -5.99f;
-				}
-				top_vals_left[index] = newVal;
-
-				// If smooth draw is activated
-				if (smooth_draw) {
-					// If the mouse is in the center of the drawing area
-					if (index - smooth_draw_amt >= 0 && index + smooth_draw_amt < HALF_FFT_SIZE) {
-						int index_to_the_left = index - smooth_draw_amt;
-						int index_to_the_right = index + smooth_draw_amt;
-						float val_to_the_left = top_vals_left[index_to_the_left];
-						float val_to_the_right = top_vals_left[index_to_the_right];
-						float inc_to_the_left = (newVal - val_to_the_left)/(float) smooth_draw_amt;
-						float inc_to_the_right = (newVal - val_to_the_right)/(float) smooth_draw_amt;
-
-						for (int i=1; i<smooth_draw_amt; i++) {
-							// Values to the left
-							top_vals_left[index - i] = newVal - i*inc_to_the_left;
-							// Values to the right
-							top_vals_left[index + i] = newVal - i*inc_to_the_right;
-						}
+			// Set the value of the top_vals array using the y-value of the mouse position
+			//			printf("Mouse: %d, %d\n", TheMouse.x, TheMouse.y);
+			float newVal = 6 * ((float) impulseWindow->margin_top - (float) TheMouse.y) / ((float) impulseWindow->margin_bottom - (float) impulseWindow->margin_top);
+			//				printf("NewVal: %f\n", newVal);
+			if (newVal > 0.0f) {
+				newVal = 0.0f;
+			}
+			if (newVal < -5.99f) {
+				newVal = -5.99f;
+			}
+			current_top_vals[index] = newVal;
+
+			// If smooth draw is activated
+			if (smooth_draw) {
+				// If the mouse is in the center of the drawing area
+				if (index - smooth_draw_amt >= 0 && index + smooth_draw_amt < HALF_FFT_SIZE) {
+					int index_to_the_left = index - smooth_draw_amt;
+					int index_to_the_right = index + smooth_draw_amt;
+					float val_to_the_left = current_top_vals[index_to_the_left];
+					float val_to_the_right = current_top_vals[index_to_the_right];
+					float inc_to_the_left = (newVal - val_to_the_left)/(float) smooth_draw_amt;
+					float inc_to_the_right = (newVal - val_to_the_right)/(float) smooth_draw_amt;
+
+					for (int i=1; i<smooth_draw_amt; i++) {
+						// Values to the left
+						current_top_vals[index - i] = newVal - i*inc_to_the_left;
+						// Values to the right
+						current_top_vals[index + i] = newVal - i*inc_to_the_right;
 					}
-					// If the mouse is near the left of the drawing area
-					if (index - smooth_draw_amt < 0) {
-						int index_to_the_left = 0;
-						int index_to_the_right = index + smooth_draw_amt;
-						float val_to_the_left = top_vals_left[index_to_the_left];
-						float val_to_the_right = top_vals_left[index_to_the_right];
-						float inc_to_the_left = (newVal - val_to_the_left)/(float) (index - index_to_the_left);
-						float inc_to_the_right = (newVal - val_to_the_right)/(float) smooth_draw_amt;
-						for (int i=1; i < (index - index_to_the_left); i++) {
-							top_vals_left[index - i] = newVal - i*inc_to_the_left;
-						}
-						for (int i=1; i < smooth_draw_amt; i++) {
-							top_vals_left[index + i] = newVal - i*inc_to_the_right;
-						}
+				}
+				// If the mouse is near the left of the drawing area
+				if (index - smooth_draw_amt < 0) {
+					int index_to_the_left = 0;
+					int index_to_the_right = index + smooth_draw_amt;
+					float val_to_the_left = current_top_vals[index_to_the_left];
+					float val_to_the_right = current_top_vals[index_to_the_right];
+					float inc_to_the_left = (newVal - val_to_the_left)/(float) (index - index_to_the_left);
+					float inc_to_the_right = (newVal - val_to_the_right)/(float) smooth_draw_amt;
+					for (int i=1; i < (index - index_to_the_left); i++) {
+						current_top_vals[index - i] = newVal - i*inc_to_the_left;
 					}
-					// If the mouse is near the right of the drawing area
-					if (index + smooth_draw_amt >= HALF_FFT_SIZE) {
-						int index_to_the_left = index - smooth_draw_amt;
-						int index_to_the_right = HALF_FFT_SIZE - 1;
-						float val_to_the_left = top_vals_left[index_to_the_left];
-						float val_to_the_right = top_vals_left[index_to_the_right];
-						float inc_to_the_left = (newVal - val_to_the_left)/(float) smooth_draw_amt;
-						float inc_to_the_right = (newVal - val_to_the_right)/(float) (index_to_the_right - index);
-						for (int i=1; i < smooth_draw_amt ; i++) {
-							top_vals_left[index - i] = newVal - i*inc_to_the_left;
-						}
-						for (int i=1; i < (index_to_the_right - index); i++) {
-							top_vals_left[index + i] = newVal - i*inc_to_the_right;
-						}
+					for (int i=1; i < smooth_draw_amt; i++) {
+						current_top_vals[index + i] = newVal - i*inc_to_the_right;
 					}
 				}
-
-			}
-		} else if (g_current_channel_view == RIGHT && g_impulse->numChannels == STEREO) {
-			// If draw button is pressed
-			if (TheMouse.lmb == 1) {
-
-				//			printf("index: %d\n", index);
-
-				if (index < 0) {
-					index = 0;
-				}
-				if (index > HALF_FFT_SIZE - 1) {
-					index = HALF_FFT_SIZE - 1;
-				}
-
-				// Set the value of the top_vals array using the y-value of the mouse position
-				//			printf("Mouse: %d, %d\n", TheMouse.x, TheMouse.y);
-				float newVal = 6 * ((float) impulseWindow->margin_top - (float) TheMouse.y) / ((float) impulseWindow->margin_bottom - (float) impulseWindow->margin_top);
-				//			printf("NewVal: %f\n", newVal);
-				if (newVal > 0.0f) {
-					newVal = 0.0f;
-				}
-				if (newVal < -5.99f) {
-					newVal = -5.99f;
-				}
-				top_vals_right[index] = newVal;
-
-				// If smooth draw is activated
-				if (smooth_draw) {
-					// If the mouse is in the center of the drawing area
-					if (index - smooth_draw_amt >= 0 && index + smooth_draw_amt < HALF_FFT_SIZE) {
-						int index_to_the_left = index - smooth_draw_amt;
-						int index_to_the_right = index + smooth_draw_amt;
-						float val_to_the_left = top_vals_right[index_to_the_left];
-						float val_to_the_right = top_vals_right[index_to_the_right];
-						float inc_to_the_left = (newVal - val_to_the_left)/(float) smooth_draw_amt;
-						float inc_to_the_right = (newVal - val_to_the_right)/(float) smooth_draw_amt;
-
-						for (int i=1; i<smooth_draw_amt; i++) {
-							// Values to the left
-							top_vals_right[index - i] = newVal - i*inc_to_the_left;
-							// Values to the right
-							top_vals_right[index + i] = newVal - i*inc_to_the_right;
-						}
+				// If the mouse is near the right of the drawing area
+				if (index + smooth_draw_amt >= HALF_FFT_SIZE) {
+					int index_to_the_left = index - smooth_draw_amt;
+					int index_to_the_right = HALF_FFT_SIZE - 1;
+					float val_to_the_left = current_top_vals[index_to_the_left];
+					float val_to_the_right = current_top_vals[index_to_the_right];
+					float inc_to_the_left = (newVal - val_to_the_left)/(float) smooth_draw_amt;
+					float inc_to_the_right = (newVal - val_to_the_right)/(float) (index_to_the_right - index);
+					for (int i=1; i < smooth_draw_amt ; i++) {
+						current_top_vals[index - i] = newVal - i*inc_to_the_left;
 					}
-					// If the mouse is near the left of the drawing area
-					if (index - smooth_draw_amt < 0) {
-						int index_to_the_left = 0;
-						int index_to_the_right = index + smooth_draw_amt;
-						float val_to_the_left = top_vals_right[index_to_the_left];
-						float val_to_the_right = top_vals_right[index_to_the_right];
-						float inc_to_the_left = (newVal - val_to_the_left)/(float) (index - index_to_the_left);
-						float inc_to_the_right = (newVal - val_to_the_right)/(float) smooth_draw_amt;
-						for (int i=1; i < (index - index_to_the_left) ; i++) {
-							top_vals_right[index - i] = newVal - i*inc_to_the_left;
-						}
-						for (int i=1; i < smooth_draw_amt; i++) {
-							top_vals_right[index + i] = newVal - i*inc_to_the_right;
-						}
-					}
-					// If the mouse is near the right of the drawing area
-					if (index + smooth_draw_amt >= HALF_FFT_SIZE) {
-						int index_to_the_left = index - smooth_draw_amt;
-						int index_to_the_right = HALF_FFT_SIZE - 1;
-						float val_to_the_left = top_vals_right[index_to_the_left];
-						float val_to_the_right = top_vals_right[index_to_the_right];
-						float inc_to_the_left = (newVal - val_to_the_left)/(float) smooth_draw_amt;
-						float inc_to_the_right = (newVal - val_to_the_right)/(float) (index_to_the_right - index);
-						for (int i=1; i < smooth_draw_amt ; i++) {
-							top_vals_right[index - i] = newVal - i*inc_to_the_left;
-						}
-						for (int i=1; i < (index_to_the_right - index); i++) {
-							top_vals_right[index + i] = newVal - i*inc_to_the_right;
-						}
+					for (int i=1; i < (index_to_the_right - index); i++) {
+						current_top_vals[index + i] = newVal - i*inc_to_the_right;
 					}
 				}
 			}
+
 		}
 	}
 
@@ -1857,135 +2049,70 @@ void displayFunc() {
 
 	glLineWidth(1);
 
-	if (g_current_channel_view == LEFT) {
-		// Draw impulse
-		glPushMatrix();
-		{
-			for (i = 0; i < HALF_FFT_SIZE; i++) {
-
-				float top_value = impulseWindow->margin_top - top_vals_left[i]*((float) impulseWindow->margin_bottom - impulseWindow->margin_top)/6;
-				float inc = ((float)impulseWindow->margin_bottom - top_value) / 100;
-
-				if (i > 0) {
-					float top_val_to_the_left = impulseWindow->margin_top - top_vals_left[i-1]*((float) impulseWindow->margin_bottom - impulseWindow->margin_top)/6;
-
-					float y_inc = (top_value - top_val_to_the_left) / g_interpolation_amt;
-					float x_inc = (x_values[i] - x_values[i-1])/g_interpolation_amt;
-
-					for (int k=0; k<g_interpolation_amt; k++) {
-						glBegin(GL_LINE_STRIP);
-						for (int l=0; l<100; l++) {
-							if (abs(g_current_index - i) < smooth_draw_amt) {
-								glColor3f((float) (100 - l) * 0.8 / 100, (float) (100 - l) * 0.3 / 100,
-										(float) (100 - l) * 0.3 / 100);
-							} else {
-								glColor3f((float) (100 - l) * 0.6 / 100, (float) (100 - l) * 0.5 / 100,
-										(float) (100 - l) * 0.5 / 100);
-							}
-							float height = top_val_to_the_left + k*y_inc;
-							float height_inc = ((float) impulseWindow->margin_bottom - height) / 100;
-							glVertex3f(impulseWindow->margin_left + x_values[i-1] + x_inc*k, height + height_inc*l, 0.0f);
-						}
-						glEnd();
-					}
+	float *current_top_vals = top_vals[g_current_channel_view];
+	// Draw impulse
+	glPushMatrix();
+	{
+		for (i = 0; i < HALF_FFT_SIZE; i++) {
 
-				}
+			float top_value = impulseWindow->margin_top - current_top_vals[i]*((float) impulseWindow->margin_bottom - impulseWindow->margin_top)/6;
+			float inc = ((float)impulseWindow->margin_bottom - top_value) / 100;
 
-				if (g_current_index == i && mouseIsInDrawingArea() && noElementsAreSelected() && !mouseCloseToALine()) {
-					glLineWidth(6);
-				} else if (abs(g_current_index - i) < smooth_draw_amt && !mouseCloseToALine() && mouseIsInDrawingArea()) {
-					glLineWidth(3);
-				} else {
-					glLineWidth(1);
-				}
+			if (i > 0) {
+				float top_val_to_the_left = impulseWindow->margin_top - current_top_vals[i-1]*((float) impulseWindow->margin_bottom - impulseWindow->margin_top)/6;
 
-				glBegin(GL_LINE_STRIP);
-				for (j = 0; j < 100; j++) {
-					if (g_current_index == i && mouseIsInDrawingArea() && noElementsAreSelected() && !mouseCloseToALine()) {
-						glColor3f((float) (100 - j) * 1.0 / 100, (float) (100 - j) * 0.1 / 100,
-								(float) (100 - j) * 0.1 / 100);
-					} else if (abs(g_current_index - i) < smooth_draw_amt && !mouseCloseToALine() && mouseIsInDrawingArea()) {
-						glColor3f((float) (100 - j) * 0.8 / 100, (float) (100 - j) * 0.3 / 100,
-								(float) (100 - j) * 0.3 / 100);
-					} else {
-						glColor3f((float) (100 - j) * 0.6 / 100, (float) (100 - j) * 0.5 / 100,
-								(float) (100 - j) * 0.5 / 100);
-					}
-					float x_value = index_x_inc*log(i+1)*(float)HALF_FFT_SIZE/log((float)HALF_FFT_SIZE);
-					x_values[i] = x_value;
-					glVertex3f(impulseWindow->margin_left + x_value, top_value + (float) j * inc, 0.0f);
+				float y_inc = (top_value - top_val_to_the_left) / g_interpolation_amt;
+				float x_inc = (x_values[i] - x_values[i-1])/g_interpolation_amt;
 
-				}
-				glEnd();
-				glLineWidth(1);
-			}
-		}
-		glPopMatrix();
-	} else if (g_current_channel_view == RIGHT && g_impulse->numChannels == STEREO) {
-		// Draw impulse
-		glPushMatrix();
-		{
-			for (i = 0; i < HALF_FFT_SIZE; i++) {
-
-				float top_value = impulseWindow->margin_top - top_vals_right[i]*((float) impulseWindow->margin_bottom - impulseWindow->margin_top)/6;
-				float inc = ((float)impulseWindow->margin_bottom - top_value) / 100;
-
-				if (i > 0) {
-					float top_val_to_the_left = impulseWindow->margin_top - top_vals_right[i-1]*((float) impulseWindow->margin_bottom - impulseWindow->margin_top)/6;
-
-					float y_inc = (top_value - top_val_to_the_left) / g_interpolation_amt;
-					float x_inc = (x_values[i] - x_values[i-1])/g_interpolation_amt;
-
-					for (int k=0; k<g_interpolation_amt; k++) {
-						glBegin(GL_LINE_STRIP);
-						for (int l=0; l<100; l++) {
-							if (abs(g_current_index - i) < smooth_draw_amt) {
-								glColor3f((float) (100 - l) * 0.8 / 100, (float) (100 - l) * 0.3 / 100,
-										(float) (100 - l) * 0.3 / 100);
-							} else {
-								glColor3f((float) (100 - l) * 0.6 / 100, (float) (100 - l) * 0.5 / 100,
-										(float) (100 - l) * 0.5 / 100);
-							}
-							float height = top_val_to_the_left + k*y_inc;
-							float height_inc = ((float) impulseWindow->margin_bottom - height) / 100;
-							glVertex3f(impulseWindow->margin_left + x_values[i-1] + x_inc*k, height + height_inc*l, 0.0f);
+				for (int k=0; k<g_interpolation_amt; k++) {
+					glBegin(GL_LINE_STRIP);
+					for (int l=0; l<100; l++) {
+						if (abs(g_current_index - i) < smooth_draw_amt) {
+							glColor3f((float) (100 - l) * 0.8 / 100, (float) (100 - l) * 0.3 / 100,
+									(float) (100 - l) * 0.3 / 100);
+						} else {
+							glColor3f((float) (100 - l) * 0.6 / 100, (float) (100 - l) * 0.5 / 100,
+									(float) (100 - l) * 0.5 / 100);
 						}
-						glEnd();
+						float height = top_val_to_the_left + k*y_inc;
+						float height_inc = ((float) impulseWindow->margin_bottom - height) / 100;
+						glVertex3f(impulseWindow->margin_left + x_values[i-1] + x_inc*k, height + height_inc*l, 0.0f);
 					}
-
+					glEnd();
 				}
 
+			}
+
+			if (g_current_index == i && mouseIsInDrawingArea() && noElementsAreSelected() && !mouseCloseToALine()) {
+				glLineWidth(6);
+			} else if (abs(g_current_index - i) < smooth_draw_amt && !mouseCloseToALine() && mouseIsInDrawingArea()) {
+				glLineWidth(3);
+			} else {
+				glLineWidth(1);
+			}
+
+			glBegin(GL_LINE_STRIP);
+			for (j = 0; j < 100; j++) {
 				if (g_current_index == i && mouseIsInDrawingArea() && noElementsAreSelected() && !mouseCloseToALine()) {
-					glLineWidth(6);
+					glColor3f((float) (100 - j) * 1.0 / 100, (float) (100 - j) * 0.1 / 100,
+							(float) (100 - j) * 0.1 / 100);
 				} else if (abs(g_current_index - i) < smooth_draw_amt && !mouseCloseToALine() && mouseIsInDrawingArea()) {
-					glLineWidth(3);
+					glColor3f((float) (100 - j) * 0.8 / 100, (float) (100 - j) * 0.3 / 100,
+							(float) (100 - j) * 0.3 / 100);
 				} else {
-					glLineWidth(1);
+					glColor3f((float) (100 - j) * 0.6 / 100, (float) (100 - j) * 0.5 / 100,
+							(float) (100 - j) * 0.5 / 100);
 				}
+				float x_value = index_x_inc*log(i+1)*(float)HALF_FFT_SIZE/log((float)HALF_FFT_SIZE);
+				x_values[i] = x_value;
+				glVertex3f(impulseWindow->margin_left + x_value, top_value + (float) j * inc, 0.0f);
 
-				glBegin(GL_LINE_STRIP);
-				for (j = 0; j < 100; j++) {
-					if (g_current_index == i && mouseIsInDrawingArea() && noElementsAreSelected() && !mouseCloseToALine()) {
-						glColor3f((float) (100 - j) * 1.0 / 100, (float) (100 - j) * 0.1 / 100,
-								(float) (100 - j) * 0.1 / 100);
-					} else if (abs(g_current_index - i) < smooth_draw_amt && !mouseCloseToALine() && mouseIsInDrawingArea()) {
-						glColor3f((float) (100 - j) * 0.8 / 100, (float) (100 - j) * 0.3 / 100,
-								(float) (100 - j) * 0.3 / 100);
-					} else {
-						glColor3f((float) (100 - j) * 0.6 / 100, (float) (100 - j) * 0.5 / 100,
-								(float) (100 - j) * 0.5 / 100);
-					}
-					float x_value = index_x_inc*log(i+1)*(float)HALF_FFT_SIZE/log((float)HALF_FFT_SIZE);
-					x_values[i] = x_value;
-					glVertex3f(impulseWindow->margin_left + x_value, top_value + (float) j * inc, 0.0f);
-
-				}
-				glEnd();
-				glLineWidth(1);
 			}
+			glEnd();
+			glLineWidth(1);
 		}
-		glPopMatrix();
 	}
+	glPopMatrix();
 
 	// Draw expected changes
 	// If mouse is in middle of window
@@ -2007,13 +2134,8 @@ void displayFunc() {
 		int x_value_right = impulseWindow->margin_left + index_x_inc*log(index_right+1)*(float)HALF_FFT_SIZE/log((float)HALF_FFT_SIZE);
 		float y_value_left = 0.0f;
 		float y_value_right = 0.0f;
-		if (g_current_channel_view == RIGHT) {
-			y_value_left = impulseWindow->margin_top - top_vals_right[index_left]*((float) impulseWindow->margin_bottom - impulseWindow->margin_top)/6;
-			y_value_right = impulseWindow->margin_top - top_vals_right[index_right]*((float) impulseWindow->margin_bottom - impulseWindow->margin_top)/6;
-		} else if (g_current_channel_view == LEFT) {
-			y_value_left = impulseWindow->margin_top - top_vals_left[index_left]*((float) impulseWindow->margin_bottom - impulseWindow->margin_top)/6;
-			y_value_right = impulseWindow->margin_top - top_vals_left[index_right]*((float) impulseWindow->margin_bottom - impulseWindow->margin_top)/6;
-		}
+		y_value_left = impulseWindow->margin_top - current_top_vals[index_left]*((float) impulseWindow->margin_bottom - impulseWindow->margin_top)/6;
+		y_value_right = impulseWindow->margin_top - current_top_vals[index_right]*((float) impulseWindow->margin_bottom - impulseWindow->margin_top)/6;
 
 		float y_value_current = TheMouse.y;
 		glBegin(GL_LINE_STRIP);
@@ -2081,7 +2203,7 @@ void displayFunc() {
 
 //		float mouse_x_offset = (TheMouse.x - impulseWindow->margin_left) / (float) (impulseWindow->margin_right - impulseWindow->margin_left);
 
-		float width = (float) SAMPLE_RATE / (float) FFT_SIZE;
+		float width = (float) g_sample_rate / (float) FFT_SIZE;
 
 		int index = 0;
 
@@ -2125,7 +2247,7 @@ void *calculateFFT(void *incomingFFTArgs) {
 
 	FFTArgs *fftArgs = (FFTArgs *) incomingFFTArgs;
 
-	int i;
+	int i, c;
 
 	int numCyclesToWait = fftArgs->num_callbacks_to_complete - 1;
 
@@ -2146,9 +2268,22 @@ void *calculateFFT(void *incomingFFTArgs) {
 	complex *inputAudio = calloc(convLength, sizeof(complex));
 	// 2. Take audio from g_input_storage_buffer (first_sample_index to last_sample_index)
 	//    and place it into the buffer created in part 1 (0 to (last_sample_index - first_sample_index)).
-	for (i = 0; i < blockLength; i++) {
-		inputAudio[i].Re = g_input_storage_buffer[fftArgs->first_sample_index
-												  + i];
+	//    If the impulse has changed since this work was queued, the buffer is no
+	//    longer the one the indices refer to.
+	pthread_mutex_lock(&mutex);
+	bool current = fftArgs->generation == g_impulse_generation;
+	if (current) {
+		for (i = 0; i < blockLength; i++) {
+			inputAudio[i].Re = g_input_storage_buffer[fftArgs->first_sample_index
+													  + i];
+		}
+	}
+	pthread_mutex_unlock(&mutex);
+	if (!current) {
+		releaseFFTData(fftArgs->fftData);
+		free(inputAudio);
+		free(fftArgs);
+		pthread_exit(NULL);
 	}
 
 	//	printf(
@@ -2165,118 +2300,56 @@ void *calculateFFT(void *incomingFFTArgs) {
 	//    that now holds the input audio data.
 	int fftBlockNumber = fftArgs->impulse_block_number;
 
-	// If the impulse is mono
-	if (g_impulse->numChannels == MONO) {
+	int numChannels = fftArgs->fftData->numChannels;
+
+	// 5. Create buffers of length 2 * (last_sample_index - first_sample_index) to hold the result of
+	//    FFT multiplication, one per impulse channel.
+	complex **convResults = (complex **) malloc(sizeof(complex *) * numChannels);
+
+	for (c = 0; c < numChannels; c++) {
+		convResults[c] = calloc(convLength, sizeof(complex));
 
-		// 5. Create buffer of length 2 * (last_sample_index - first_sample_index) to hold the result of
-		//    FFT multiplication.
-		complex *convResult = calloc(convLength, sizeof(complex));
 		// 6. Complex multiply the buffer created in part 1 with the impulse FFT block determined in part 4,
 		//    and store the result in the buffer created in part 5.
-		complex c;
-
+		complex *impulseBlock = fftArgs->fftData->fftBlocks[c][fftBlockNumber];
 		for (i = 0; i < convLength; i++) {
-
-			//			if (g_changingImpulse || g_changes_made != state) {
-			//				free(convResult);
-			//				free(temp);
-			//				free(inputAudio);
-			//				free(fftArgs);
-			//				pthread_exit(NULL);
-			//				return NULL;
-			//			}
-
-			c = complex_mult(inputAudio[i],
-					g_fftData_ptr->fftBlocks1[fftBlockNumber][i]);
-
-			convResult[i].Re = c.Re;
-			convResult[i].Im = c.Im;
-
+			convResults[c][i] = complex_mult(inputAudio[i], impulseBlock[i]);
 		}
 
 		// 7. Take the IFFT of the buffer created in part 5.
-		ifft(convResult, convLength, temp);
-
-		// 8. When the appropriate number of callback cycles have passed (num_callbacks_to_complete), put
-		//    the real values of the buffer created in part 5 into the g_output_storage_buffer
-		//    (sample 0 through sample 2 * (last_sample_index - first_sample_index)
-		while (g_counter != counter_target) {
-			if (g_changingImpulse) {
-				pthread_exit(NULL);
-			}
-			nanosleep((const struct timespec[] ) { {0,g_block_duration_in_nanoseconds/NUM_CHECKS_PER_CYCLE}}, NULL);
-		}
+		ifft(convResults[c], convLength, temp);
+	}
+	releaseFFTData(fftArgs->fftData);
 
-		pthread_mutex_lock(&mutex);
-		// Put data in output buffer
-		if (g_output_storage_buffer1_length < convLength) {
-			convLength = g_output_storage_buffer1_length;
-		}
-		for (i = 0; i < convLength; i++) {
-			g_output_storage_buffer1[i] += convResult[i].Re / volumeFactor;
+	// 8. When the appropriate number of callback cycles have passed (num_callbacks_to_complete), put
+	//    the real values of the buffer created in part 5 into the g_output_storage_buffers
+	//    (sample 0 through sample 2 * (last_sample_index - first_sample_index)
+	while (g_counter != counter_target
+			&& fftArgs->generation == g_impulse_generation) {
+		if (g_changingImpulse) {
+			pthread_exit(NULL);
 		}
-		pthread_mutex_unlock(&mutex);
-
-		free(convResult);
+		nanosleep((const struct timespec[] ) { {0,g_block_duration_in_nanoseconds/NUM_CHECKS_PER_CYCLE}}, NULL);
 	}
 
-	// If the impulse is stereo
-	if (g_impulse->numChannels == STEREO) {
-
-		// 5. Create buffer of length 2 * (last_sample_index - first_sample_index) to hold the result of
-		//    FFT multiplication.
-		complex *convResultLeft = calloc(convLength, sizeof(complex));
-		complex *convResultRight = calloc(convLength, sizeof(complex));
-
-		// 6. Complex multiply the buffer created in part 1 with the impulse FFT block determined in part 4,
-		//    and store the result in the buffer created in part 5.
-		complex c1, c2;
-
-		for (i = 0; i < convLength; i++) {
-			// Left channel
-			c1 = complex_mult(inputAudio[i],
-					g_fftData_ptr->fftBlocks1[fftBlockNumber][i]);
-			// Right channel
-			c2 = complex_mult(inputAudio[i],
-					g_fftData_ptr->fftBlocks2[fftBlockNumber][i]);
-
-			convResultLeft[i].Re = c1.Re;
-			convResultLeft[i].Im = c1.Im;
-
-			convResultRight[i].Re = c2.Re;
-			convResultRight[i].Im = c2.Im;
-
+	pthread_mutex_lock(&mutex);
+	// Put data in output buffers (unless they now belong to another impulse)
+	if (fftArgs->generation == g_impulse_generation) {
+		if (g_output_storage_buffer_length < convLength) {
+			convLength = g_output_storage_buffer_length;
 		}
-
-		// 7. Take the IFFT of the buffer created in part 5.
-		ifft(convResultLeft, convLength, temp);
-		ifft(convResultRight, convLength, temp);
-
-		// 8. When the appropriate number of callback cycles have passed (num_callbacks_to_complete), put
-		//    the real values of the buffer created in part 5 into the g_output_storage_buffer
-		//    (sample 0 through sample 2 * (last_sample_index - first_sample_index)
-		while (g_counter != counter_target) {
-			if (g_changingImpulse) {
-				pthread_exit(NULL);
+		for (c = 0; c < numChannels; c++) {
+			for (i = 0; i < convLength; i++) {
+				g_output_storage_buffers[c][i] += convResults[c][i].Re / volumeFactor;
 			}
-			nanosleep((const struct timespec[] ) { {0,g_block_duration_in_nanoseconds/NUM_CHECKS_PER_CYCLE}}, NULL);
-		}
-
-		pthread_mutex_lock(&mutex);
-		// Put data in output buffer
-		if (g_output_storage_buffer1_length < convLength) {
-			convLength = g_output_storage_buffer1_length;
 		}
-		for (i = 0; i < convLength; i++) {
-			g_output_storage_buffer1[i] += convResultLeft[i].Re / volumeFactor; // left channel
-			g_output_storage_buffer2[i] += convResultRight[i].Re / volumeFactor; // right channel
-		}
-		pthread_mutex_unlock(&mutex);
-
-		free(convResultLeft);
-		free(convResultRight);
+	}
+	pthread_mutex_unlock(&mutex);
 
+	for (c = 0; c < numChannels; c++) {
+		free(convResults[c]);
 	}
+	free(convResults);
 
 	//	printf(
 	//			"Thread %d: The result of the convolution of sample %d to %d with h%d has been added to the output buffer. Expected arrival: when n = %d.\n",
@@ -2292,6 +2365,23 @@ void *calculateFFT(void *incomingFFTArgs) {
 	return NULL;
 }
 
+/*
+ * This function takes the spectra the engine convolves with, counted as used
+ * by a partition being queued. They are checked again once counted, so
+ * spectra that were replaced gain no users: whoever replaced them only has
+ * to wait for the users they had.
+ */
+FFTData *acquireEngineSpectra() {
+	while (true) {
+		FFTData *fftData = __atomic_load_n(&g_fftData_ptr, __ATOMIC_SEQ_CST);
+		acquireFFTData(fftData);
+		if (fftData == __atomic_load_n(&g_fftData_ptr, __ATOMIC_SEQ_CST)) {
+			return fftData;
+		}
+		releaseFFTData(fftData);
+	}
+}
+
 /*
  *  Description:  Callback for Port Audio
  */
@@ -2300,12 +2390,10 @@ static int paCallback(const void *inputBuffer, void *outputBuffer,
 		PaStreamCallbackFlags statusFlags, void *userData) {
 	paData *data = (paData *) userData;
 	if (AUDIO_FILE_INPUT) {
-		int readcount;
-		readcount = sf_readf_float(data->infile1, data->buffer1, framesPerBuffer);
-
-		if (readcount < framesPerBuffer) {
-			sf_seek(data->infile1, 0, SEEK_SET);
-			readcount = sf_readf_float(data->infile1, data->buffer1+(readcount*data->channels), framesPerBuffer-readcount);
+		// Decoding happens on the reader's thread; only take the next block
+		data->input = prefetchReaderPop(data->reader);
+		if (data->input == NULL) {
+			data->input = data->silence;
 		}
 	}
 
@@ -2314,17 +2402,23 @@ static int paCallback(const void *inputBuffer, void *outputBuffer,
 	float *inBuf = (float*) inputBuffer;
 	float *outBuf = (float*) outputBuffer;
 
-	int i, j;
+	int i, j, c;
 
 	if (!g_changingImpulse) {
 
-		// If the impulse is mono
-		if (g_impulse->numChannels == MONO) {
+		// Take up an impulse switched to since the last block
+		installPendingImpulse();
+
+		int numChannels = g_num_output_channels;
+
+		// Average level of each channel of the wet signal
+		float loudest_total = 0.0f;
+		for (c = 0; c < numChannels; c++) {
 
 			float total = 0.0f;
 
 			for (i = 0; i < framesPerBuffer; i++) {
-				total += fabsf(g_output_storage_buffer1[i]*mult_factor);
+				total += fabsf(g_output_storage_buffers[c][i]*mult_factor);
 			}
 
 			total /= (float) framesPerBuffer;
@@ -2333,86 +2427,38 @@ static int paCallback(const void *inputBuffer, void *outputBuffer,
 				g_loudest = total;
 				//				printf("New loudest value: %f\n", g_loudest);
 			}
-
-			//			printf("Avg value: %f\n", total);
-
-			if (total > 0.5f) {
-				for (i = 0; i < framesPerBuffer; i++) {
-					outBuf[i] = 0.0f;
-				}
-				g_consecutive_skipped_cycles++;
-				printf("Output was too loud (%f) and was automatically muted.\n", total);
-				if (g_consecutive_skipped_cycles > SAMPLE_RATE/(2*framesPerBuffer)) {
-					RecomputeImpulseButtonCallback();
-					g_consecutive_skipped_cycles = 0;
-				}
-			} else {
-				g_consecutive_skipped_cycles = 0;
-				pthread_mutex_lock(&mutex);
-				for (i = 0; i < framesPerBuffer; i++) {
-					outBuf[i] = ((float) g_dry_wet/100)*g_output_storage_buffer1[i]*mult_factor + ((float) (100-g_dry_wet)/100)*g_input_storage_buffer[g_input_storage_buffer_length
-																																					   - g_block_length + i];
-				}
-				pthread_mutex_unlock(&mutex);
+			if (total > loudest_total) {
+				loudest_total = total;
 			}
 		}
 
-		// If the impulse is stereo
-		if (g_impulse->numChannels == STEREO) {
-
-			float total_left = 0.0f;
-			float total_right = 0.0f;
-
-			for (i = 0; i < framesPerBuffer; i++) {
-				total_left += fabsf(g_output_storage_buffer1[i]*mult_factor);
-				total_right += fabsf(g_output_storage_buffer2[i]*mult_factor);
-			}
-
-			total_left /= (float) (framesPerBuffer);
-			total_right /= (float) (framesPerBuffer);
-
-			if (total_left > g_loudest) {
-				g_loudest = total_left;
-				//				printf("New loudest value: %f\n", g_loudest);
-			}
-			if (total_right > g_loudest) {
-				g_loudest = total_right;
-				//				printf("New loudest value: %f\n", g_loudest);
-			}
-
-			//			printf("Avg value: %f\n", (total_left + total_right / 2));
+		//			printf("Avg value: %f\n", loudest_total);
 
-			if (total_left > 0.5f) {
-				for (i = 0; i < framesPerBuffer * 2; i++) {
-					outBuf[i] = 0.0f;
-				}
-				g_consecutive_skipped_cycles++;
-				printf("Output was too loud (%f) and was automatically muted.\n", total_left);
-				if (g_consecutive_skipped_cycles > SAMPLE_RATE/(2*framesPerBuffer)) {
-					RecomputeImpulseButtonCallback();
-					g_consecutive_skipped_cycles = 0;
-				}
-			} else if (total_right > 0.5f) {
-				for (i = 0; i < framesPerBuffer * 2; i++) {
-					outBuf[i] = 0.0f;
-				}
-				g_consecutive_skipped_cycles++;
-				printf("Output was too loud (%f) and was automatically muted.\n", total_right);
-				if (g_consecutive_skipped_cycles > SAMPLE_RATE/(2*framesPerBuffer)) {
-					RecomputeImpulseButtonCallback();
-					g_consecutive_skipped_cycles = 0;
-				}
-			} else {
+		if (loudest_total > 0.5f) {
+			memset(outBuf, 0,
+					sizeof(float) * framesPerBuffer * g_num_stream_channels);
+			g_consecutive_skipped_cycles++;
+			printf("Output was too loud (%f) and was automatically muted.\n", loudest_total);
+			if (g_consecutive_skipped_cycles > g_sample_rate/(2*framesPerBuffer)) {
+				RecomputeImpulseButtonCallback();
 				g_consecutive_skipped_cycles = 0;
-				pthread_mutex_lock(&mutex);
+			}
+		} else {
+			g_consecutive_skipped_cycles = 0;
+			float *dry = g_input_storage_buffer + g_input_storage_buffer_length
+					- g_block_length;
+			float wet_gain = ((float) g_dry_wet/100)*mult_factor;
+			float dry_gain = (float) (100-g_dry_wet)/100;
+			pthread_mutex_lock(&mutex);
+			// Interleave each channel's wet signal with the (mono) dry input.
+			// An impulse with fewer channels than the stream repeats them.
+			for (c = 0; c < g_num_stream_channels; c++) {
+				float *wet = g_output_storage_buffers[c % numChannels];
 				for (i = 0; i < framesPerBuffer; i++) {
-					outBuf[2 * i] = ((float) g_dry_wet/100)*g_output_storage_buffer1[i]*mult_factor + ((float) (100-g_dry_wet)/100)*g_input_storage_buffer[g_input_storage_buffer_length
-																																						   - g_block_length + i];
-					outBuf[2 * i + 1] = ((float) g_dry_wet/100)*g_output_storage_buffer2[i]*mult_factor + ((float) (100-g_dry_wet)/100)*g_input_storage_buffer[g_input_storage_buffer_length
-																																							   - g_block_length + i];
+					outBuf[g_num_stream_channels * i + c] = wet_gain*wet[i] + dry_gain*dry[i];
 				}
-				pthread_mutex_unlock(&mutex);
 			}
+			pthread_mutex_unlock(&mutex);
 		}
 
 		++g_counter;
@@ -2428,18 +2474,9 @@ static int paCallback(const void *inputBuffer, void *outputBuffer,
 		}
 
 		if (AUDIO_FILE_INPUT) {
-			if (data->channels == MONO) {
-				for (i = 0; i < g_block_length; i++) {
-					g_input_storage_buffer[g_input_storage_buffer_length
-										   - g_block_length + i] = data->buffer1[i];
-				}
-			}
-			if (data->channels == STEREO) {
-				for (i = 0; i < g_block_length; i++) {
-					g_input_storage_buffer[g_input_storage_buffer_length
-										   - g_block_length + i] = (data->buffer1[2*i] + data->buffer1[2*i + 1])/2;
-				}
-			}
+			// The reader has already folded the file's frames down to mono
+			memcpy(g_input_storage_buffer + g_input_storage_buffer_length
+					- g_block_length, data->input, sizeof(float) * g_block_length);
 		} else if (LIVE_AUDIO_INPUT) {
 			// Fill right-most portion of g_input_storage_buffer with most recent audio
 			for (i = 0; i < g_block_length; i++) {
@@ -2478,6 +2515,8 @@ static int paCallback(const void *inputBuffer, void *outputBuffer,
 				fftArgs->impulse_block_number = (j * 2 + 1);
 				fftArgs->num_callbacks_to_complete = factor;
 				fftArgs->counter = g_counter;
+				fftArgs->fftData = acquireEngineSpectra();
+				fftArgs->generation = g_impulse_generation;
 				pthread_create(&thread, NULL, calculateFFT, (void *) fftArgs);
 
 				FFTArgs *fftArgs2 = (FFTArgs *) malloc(sizeof(FFTArgs));
@@ -2487,19 +2526,20 @@ static int paCallback(const void *inputBuffer, void *outputBuffer,
 				fftArgs2->impulse_block_number = (j * 2 + 2);
 				fftArgs2->num_callbacks_to_complete = factor * 2;
 				fftArgs2->counter = g_counter;
+				fftArgs2->fftData = acquireEngineSpectra();
+				fftArgs2->generation = g_impulse_generation;
 
 				pthread_create(&thread, NULL, calculateFFT, (void *) fftArgs2);
 
 			}
 		}
 
-		// Shift g_output_storage_buffer
+		// Shift g_output_storage_buffers
 		pthread_mutex_lock(&mutex);
-		for (i = 0; i < g_output_storage_buffer1_length - g_block_length; i++) {
-			g_output_storage_buffer1[i] = g_output_storage_buffer1[i
-																   + g_block_length];
-			g_output_storage_buffer2[i] = g_output_storage_buffer2[i
-																   + g_block_length];
+		for (c = 0; c < g_num_output_channels; c++) {
+			memmove(g_output_storage_buffers[c],
+					g_output_storage_buffers[c] + g_block_length,
+					sizeof(float) * (g_output_storage_buffer_length - g_block_length));
 		}
 		pthread_mutex_unlock(&mutex);
 
@@ -2508,20 +2548,9 @@ static int paCallback(const void *inputBuffer, void *outputBuffer,
 		 * If the impulse is being changed, send zeros to the output rather than
 		 * hearing a glitch in the audio
 		 */
-		if (g_impulse->numChannels == MONO) {
-			for (i = 0; i < framesPerBuffer; i++) {
-				outBuf[i] = 0.0f;
-			}
-		} else if (g_impulse->numChannels == STEREO) {
-			for (i = 0; i < framesPerBuffer*2; i++) {
-				outBuf[i] = 0.0f;
-			}
-		}
+		memset(outBuf, 0, sizeof(float) * framesPerBuffer * g_num_stream_channels);
 
-		for (i=0; i<g_output_storage_buffer1_length; i++) {
-			g_output_storage_buffer1[i] = 0.0f;
-			g_output_storage_buffer2[i] = 0.0f;
-		}
+		clearOutputStorageBuffers();
 		for (i=0; i<g_input_storage_buffer_length; i++) {
 			g_input_storage_buffer[i] = 0.0f;
 		}
@@ -2539,7 +2568,7 @@ static int paCallback(const void *inputBuffer, void *outputBuffer,
 	if (AUDIO_FILE_INPUT) {
 		for (i=0; i<MIN_FFT_BLOCK_SIZE; i++) {
 			input_spectrum[i].Im = 0.0f;
-			input_spectrum[i].Re = data->buffer1[i];
+			input_spectrum[i].Re = data->input[i];
 		}
 	}
 
@@ -2552,6 +2581,9 @@ static int paCallback(const void *inputBuffer, void *outputBuffer,
 
 	free(input_temp);
 
+	// Spectra replaced before this callback can't have been taken since
+	__atomic_add_fetch(&g_callback_count, 1, __ATOMIC_SEQ_CST);
+
 	return paContinue;
 }
 
@@ -2565,16 +2597,17 @@ void runPortAudio() {
 		PaStream* stream;
 		PaStreamParameters outputParams;
 		PaError err;
-		memset(&data.sfinfo1, 0, sizeof(data.sfinfo1));
-		data.infile1 = sf_open(audio_file_name, SFM_READ, &data.sfinfo1);
-		if (data.infile1 == NULL) {
+		data.reader = openPrefetchReader(audio_file_name, g_block_length,
+				FILE_INPUT_READ_AHEAD, g_sample_rate, true, true);
+		if (data.reader == NULL) {
 			printf("Error: could not open file: %s\n", audio_file_name);
 			puts(sf_strerror(NULL));
 			exit(1);
 		}
-		data.sampleRate = data.sfinfo1.samplerate;
+		data.sampleRate = data.reader->sampleRate;
 		data.amplitude1 = 1.0f;
-		data.channels = data.sfinfo1.channels;
+		data.silence = (float *) calloc(g_block_length, sizeof(float));
+		data.input = data.silence;
 
 		err = Pa_Initialize();
 		if (err != paNoError ) {
@@ -2585,7 +2618,7 @@ void runPortAudio() {
 
 		/* Ouput stream parameters */
 		outputParams.device = Pa_GetDefaultOutputDevice();
-		outputParams.channelCount = g_impulse->numChannels;
+		outputParams.channelCount = g_num_stream_channels;
 		outputParams.sampleFormat = paFloat32;
 		outputParams.suggestedLatency =
 				Pa_GetDeviceInfo(outputParams.device)->defaultLowOutputLatency;
@@ -2596,7 +2629,7 @@ void runPortAudio() {
 				NULL, /* no input */
 				&outputParams,
 				data.sampleRate,
-				MIN_FFT_BLOCK_SIZE,
+				g_block_length,
 				paNoFlag, /* flags */
 				paCallback,
 				&data);
@@ -2636,7 +2669,11 @@ void runPortAudio() {
 			printf("PortAudio error: terminate: %s\n", Pa_GetErrorText(err));
 		}
 
-		sf_close(data.infile1);
+		if (data.reader->underruns > 0) {
+			printf("File input fell behind %u times\n", data.reader->underruns);
+		}
+		closePrefetchReader(data.reader);
+		free(data.silence);
 
 	} else {
 		PaStream* stream;
@@ -2647,7 +2684,7 @@ void runPortAudio() {
 		Pa_Initialize();
 		/* Set output stream parameters */
 		outputParameters.device = Pa_GetDefaultOutputDevice();
-		outputParameters.channelCount = g_impulse->numChannels;
+		outputParameters.channelCount = g_num_stream_channels;
 		outputParameters.sampleFormat = paFloat32;
 		outputParameters.suggestedLatency = Pa_GetDeviceInfo(
 				outputParameters.device)->defaultLowOutputLatency;
@@ -2661,7 +2698,7 @@ void runPortAudio() {
 		inputParameters.hostApiSpecificStreamInfo = NULL;
 		/* Open audio stream */
 		err = Pa_OpenStream(&stream, &inputParameters, &outputParameters,
-				SAMPLE_RATE, MIN_FFT_BLOCK_SIZE, paNoFlag, paCallback, NULL);
+				g_sample_rate, g_block_length, paNoFlag, paCallback, NULL);
 
 		if (err != paNoError) {
 			printf("PortAudio error: open stream: %s\n", Pa_GetErrorText(err));
@@ -2700,68 +2737,47 @@ void runPortAudio() {
 }
 
 /*
- * This function takes an impulse and returns its frequency data over time
- * in a 2-dimensional buffer.
- *
- * float **impulse_filter_env_blocks[i][j], where i = time (in blocks)
- * and j = frequency bin number
- *
+ * This function takes an impulse and returns its frequency data over time:
+ * the magnitude of bins 1 to FFT_SIZE / 2 (the bins that are fitted; the DC
+ * bin is left out) of every FFT_SIZE block.
  */
-float **getImpulseFFTBlocks(audioData *impulse_from_file, int channel) {
+Spectrogram *getImpulseFFTBlocks(audioData *impulse_from_file, int channel,
+		Arena *arena) {
 
 	int i, j;
 	/*
 	 * Get FFT profile for impulse
 	 */
-	int num_impulse_blocks = (impulse_from_file->numFrames / FFT_SIZE);
+	int num_impulse_blocks = (int) (impulse_from_file->numFrames / FFT_SIZE);
+	float *samples = impulse_from_file->channels[channel];
 
-	// Allocate memory for array of filter envelope blocks
-	float **impulse_filter_env_blocks = (float **) malloc(
-			sizeof(float *) * num_impulse_blocks);
+	Spectrogram *impulse_filter_env_blocks = createSpectrogram(
+			num_impulse_blocks, HALF_FFT_SIZE, arena);
 
-	// Allocate memory each individual filter envelope
-	for (i = 0; i < num_impulse_blocks; i++) {
-		impulse_filter_env_blocks[i] = (float *) malloc(
-				sizeof(float) * FFT_SIZE);
-	}
+	// Memory for the FFT, reused for every block
+	complex *fftBlock = (complex *) arenaAlloc(arena, sizeof(complex) * FFT_SIZE);
+	complex *temp = (complex *) arenaAlloc(arena, sizeof(complex) * FFT_SIZE);
 
 	for (i = 0; i < num_impulse_blocks; i++) {
 
-		// Allocate memory for FFT
-		complex *fftBlock = (complex *) calloc(FFT_SIZE, sizeof(complex));
-		complex *temp = (complex *) calloc(FFT_SIZE, sizeof(complex));
-
-		if (channel == LEFT) {
-			// Copy impulse into fft buffer
-			for (j = 0; j < FFT_SIZE; j++) {
-				fftBlock[j].Re = impulse_from_file->buffer1[i * FFT_SIZE + j];
-			}
-		} else if (channel == RIGHT) {
-			// Copy impulse into fft buffer
-			for (j = 0; j < FFT_SIZE; j++) {
-				fftBlock[j].Re = impulse_from_file->buffer2[i * FFT_SIZE + j];
-			}
+		// Copy impulse into fft buffer
+		for (j = 0; j < FFT_SIZE; j++) {
+			fftBlock[j].Re = samples[i * FFT_SIZE + j];
+			fftBlock[j].Im = 0.0f;
 		}
 
 		// Take FFT of block
 		fft(fftBlock, FFT_SIZE, temp);
 
 		/*
-		 * Actually apply frequency-domain filter
+		 * Obtain magnitude for each frequency bin
 		 */
-		for (j = 0; j < FFT_SIZE; j++) {
-
-			/*
-			 * Obtain magnitude for each frequency bin
-			 */
-			impulse_filter_env_blocks[i][j] = sqrt(
-					pow(fftBlock[j].Re, 2) + pow(fftBlock[j].Im, 2));
-
+		float *magnitudes = getSpectrogramBlock(impulse_filter_env_blocks, i);
+		for (j = 0; j < HALF_FFT_SIZE; j++) {
+			magnitudes[j] = sqrtf(fftBlock[j + 1].Re * fftBlock[j + 1].Re
+					+ fftBlock[j + 1].Im * fftBlock[j + 1].Im);
 		}
 
-		free(temp);
-		free(fftBlock);
-
 	}
 	return impulse_filter_env_blocks;
 }
@@ -2783,389 +2799,258 @@ void create_hanning(float * window, unsigned long length) {
 	}
 }
 
-float **getExponentialFitFromGraph(int num_impulse_blocks, int channel) {
-
-	int i, j;
-
-	float **impulse_filter_env_blocks_exp_fit = (float **) malloc(
-			sizeof(float *) * HALF_FFT_SIZE);
+/*
+ * This function fits each bin of a channel's graph with an exponential decay
+ * from its top value to its bottom value over fit_blocks blocks, returned in
+ * A and b, and evaluates it at every block of the impulse.
+ */
+Spectrogram *getExponentialFitFromGraph(int num_impulse_blocks,
+		int fit_blocks, int channel, float *A, float *b, Arena *arena) {
 
-	for (i = 0; i < HALF_FFT_SIZE; i++) {
-		impulse_filter_env_blocks_exp_fit[i] = (float *) calloc(
-				num_impulse_blocks, sizeof(float));
-	}
+	int i;
 
-	float *x = (float *) malloc(sizeof(float) * num_impulse_blocks);
+	//	printf("x2: %d\n", (num_impulse_blocks-1));
 
-	for (i = 0; i < num_impulse_blocks; i++) {
-		x[i] = i;
-	}
+	float height = g_height_top - g_height_bottom;
+	//		float x1 = 0.0f;
+	float x2 = fit_blocks - 1;
 
-	//	printf("x2: %d\n", (num_impulse_blocks-1));
+	// Four bins at a time
+	for (i = 0; i < HALF_FFT_SIZE; i += SIMD_WIDTH) {
+		v4sf y1 = (v4sf_load(&top_vals[channel][i]) + height) * g_max / height;
+		v4sf y2 = v4sf_load(&bottom_vals[channel][i]);
 
-	if (channel == LEFT) {
-		for (i = 0; i < HALF_FFT_SIZE; i++) {
-			float y1 = (top_vals_left[i] + (g_height_top - g_height_bottom)) * g_max
-					/ (g_height_top - g_height_bottom);
-			float y2 = bottom_vals_left[i];
-			//		float x1 = 0.0f;
-			float x2 = num_impulse_blocks - 1;
-
-			//		float sum_x = x2 + x1;
-			//		float sum_temp = y1 + y2;
-			//		float sum_x_times_x = pow(x1, 2) + pow(x2, 2);
-			//		float sum_temp_times_x = x1 * y1 + x2 * y2;
-			//
-			//		float b = (2 * sum_temp_times_x - sum_x * sum_temp)
-			//				/ (2 * sum_x_times_x - sum_x * sum_x);
-			//		float a = (sum_temp - b * sum_x) / 2;
-			//
-			//		float A = exp(a);
-			//
-			float a = y1;
-
-			float b = pow((y2 / a), (1 / x2));
-
-			//		printf("y1: %f, y2: %f, b: %f\n", y1, y2, b);
-
-			//		printf(
-			//				"top_vals_left[i]: %f, y1: %f, y2: %f, x1: %f, x2: %f, b: %f, a: %f, A: %f\n",
-			//				top_vals_left[i], y1, y2, x1, x2, b, a, A);
-
-			for (j = 0; j < num_impulse_blocks; j++) {
-				impulse_filter_env_blocks_exp_fit[i][j] = a * pow(b, x[j]);
-				//			if (i == 0) {
-				//				printf("impulse_filter_env_blocks_exp_fit[%d][%d]: %f\n", i, j,
-				//						impulse_filter_env_blocks_exp_fit[i][j]);
-				//			}
-			}
+		//		float sum_x = x2 + x1;
+		//		float sum_temp = y1 + y2;
+		//		float sum_x_times_x = pow(x1, 2) + pow(x2, 2);
+		//		float sum_temp_times_x = x1 * y1 + x2 * y2;
+		//
+		//		float b = (2 * sum_temp_times_x - sum_x * sum_temp)
+		//				/ (2 * sum_x_times_x - sum_x * sum_x);
+		//		float a = (sum_temp - b * sum_x) / 2;
+		//
+		//		float A = exp(a);
+		//
 
+		// y1 * (y2 / y1)^(j / x2) = y1 * exp(j * log(y2 / y1) / x2)
+		v4sf rate = v4sf_set1(0.0f);
+		if (x2 > 0) {
+			rate = v4sf_log(y2 / y1) / x2;
 		}
-	} else if (channel == RIGHT) {
-		for (i = 0; i < HALF_FFT_SIZE; i++) {
-			float y1 = (top_vals_right[i] + (g_height_top - g_height_bottom)) * g_max
-					/ (g_height_top - g_height_bottom);
-			float y2 = bottom_vals_right[i];
-			//		float x1 = 0.0f;
-			float x2 = num_impulse_blocks - 1;
-
-			//		float sum_x = x2 + x1;
-			//		float sum_temp = y1 + y2;
-			//		float sum_x_times_x = pow(x1, 2) + pow(x2, 2);
-			//		float sum_temp_times_x = x1 * y1 + x2 * y2;
-			//
-			//		float b = (2 * sum_temp_times_x - sum_x * sum_temp)
-			//				/ (2 * sum_x_times_x - sum_x * sum_x);
-			//		float a = (sum_temp - b * sum_x) / 2;
-			//
-			//		float A = exp(a);
-			//
-			float a = y1;
-
-			float b = pow((y2 / a), (1 / x2));
-
-			//		printf("y1: %f, y2: %f, b: %f\n", y1, y2, b);
-
-			//		printf(
-			//				"top_vals_left[i]: %f, y1: %f, y2: %f, x1: %f, x2: %f, b: %f, a: %f, A: %f\n",
-			//				top_vals_left[i], y1, y2, x1, x2, b, a, A);
-
-			for (j = 0; j < num_impulse_blocks; j++) {
-				impulse_filter_env_blocks_exp_fit[i][j] = a * pow(b, x[j]);
-				//			if (i == 0) {
-				//				printf("impulse_filter_env_blocks_exp_fit[%d][%d]: %f\n", i, j,
-				//						impulse_filter_env_blocks_exp_fit[i][j]);
-				//			}
-			}
 
-		}
+		//		printf("y1: %f, y2: %f, b: %f\n", y1, y2, b);
+
+		v4sf_store(A + i, y1);
+		v4sf_store(b + i, rate);
 	}
 
+	Spectrogram *impulse_filter_env_blocks_exp_fit = createSpectrogram(
+			num_impulse_blocks, HALF_FFT_SIZE, arena);
+	fillExponentialSpectrogram(impulse_filter_env_blocks_exp_fit, A, b, arena);
 
 	return impulse_filter_env_blocks_exp_fit;
 }
 
 /*
- * This function takes the frequency data of an impulse, computes best-fit exponential
- * functions for each frequency bin over time, and returns the values calculated from
- * these exponential functions in a 2-dimensional buffer.
+ * This function takes the frequency data of an impulse and computes best-fit
+ * exponential functions A * exp(b * block) for each frequency bin over time.
  *
- * float **impulse_filter_env_blocks_exp_fit[i][j], where i = frequency bin number
- * and j = time (in blocks).
+ * The bins are fitted four at a time, reading each block once.
  */
-float **getExponentialFitForImpulseFFTBlocks(int num_impulse_blocks,
-		int length_before_zero_padding, float **impulse_filter_env_blocks) {
+void fitExponentialDecay(int length_before_zero_padding,
+		const Spectrogram *impulse_filter_env_blocks, float *A, float *b,
+		Arena *arena) {
 
 	int i, j;
 
-	int num_nonzero_impulse_blocks = ceil(
-			(float) length_before_zero_padding / FFT_SIZE);
+	int n = ceil((float) length_before_zero_padding / FFT_SIZE);
 
-	/*
-	 * For each impulse_filter_env block, create exponential fit (to smooth out filter decay)
-	 */
-	float **impulse_filter_env_blocks_exp_fit = (float **) malloc(
-			sizeof(float *) * FFT_SIZE / 2);
-	for (i = 0; i < FFT_SIZE / 2; i++) {
-		impulse_filter_env_blocks_exp_fit[i] = (float *) calloc(
-				num_impulse_blocks, sizeof(float));
-	}
+	float *sum_temp = (float *) arenaCalloc(arena, FFT_SIZE / 2,
+			sizeof(float));
+	float *sum_temp_times_x = (float *) arenaCalloc(arena, FFT_SIZE / 2,
+			sizeof(float));
 
-	int n = num_nonzero_impulse_blocks;
-	float *x = (float *) malloc(sizeof(float) * num_impulse_blocks);
-	for (i = 0; i < num_impulse_blocks; i++) {
-		x[i] = i;
+	for (j = 0; j < n; j++) {
+		const float *block = getSpectrogramBlock(impulse_filter_env_blocks, j);
+		for (i = 0; i < FFT_SIZE / 2; i += SIMD_WIDTH) {
+			v4sf temp = v4sf_log(v4sf_load(block + i));
+			v4sf_store(sum_temp + i, v4sf_load(sum_temp + i) + temp);
+			v4sf_store(sum_temp_times_x + i,
+					v4sf_load(sum_temp_times_x + i) + temp * (float) j);
+		}
 	}
 
-	for (i = 0; i < FFT_SIZE / 2; i++) {
-		float *temp = (float *) malloc(
-				sizeof(float) * num_nonzero_impulse_blocks);
-		for (j = 0; j < n; j++) {
-			temp[j] = log(impulse_filter_env_blocks[j][i + 1]); // i + 1 because index of 0 = DC
+	for (i = 0; i < FFT_SIZE / 2; i += SIMD_WIDTH) {
+		float a[SIMD_WIDTH];
+		int k;
+		for (k = 0; k < SIMD_WIDTH; k++) {
+			fitLine(n, sum_temp[i + k], sum_temp_times_x[i + k], &a[k],
+					&b[i + k]);
 		}
+		v4sf_store(A + i, v4sf_exp(v4sf_load(a)));
+	}
+}
 
-		float sum_x_times_x = 0.0f;
-		float sum_temp_times_x = 0.0f;
-		float sum_x = 0.0f;
-		float sum_temp = 0.0f;
-
-		for (j = 0; j < n; j++) {
-			sum_x += x[j];
-			sum_temp += temp[j];
-			sum_x_times_x += pow(x[j], 2);
-			sum_temp_times_x += temp[j] * x[j];
-		}
+/*
+ * This function evaluates the exponential fit of each frequency bin at every
+ * block. max is raised to the largest value of the first block.
+ */
+Spectrogram *getExponentialFitFromModel(const float *A, const float *b,
+		int num_impulse_blocks, float *max, Arena *arena) {
 
-		float b = (n * sum_temp_times_x - sum_x * sum_temp)
-						/ (n * sum_x_times_x - sum_x * sum_x);
-		float a = (sum_temp - b * sum_x) / n;
+	int i;
 
-		float A = exp(a);
-		for (j = 0; j < num_impulse_blocks; j++) {
+	Spectrogram *impulse_filter_env_blocks_exp_fit = createSpectrogram(
+			num_impulse_blocks, HALF_FFT_SIZE, arena);
+	fillExponentialSpectrogram(impulse_filter_env_blocks_exp_fit, A, b, arena);
 
-			impulse_filter_env_blocks_exp_fit[i][j] = A * exp(b * x[j]);
-			//			if (i == 0) {
-			//				printf("impulse_filter_env_blocks_exp_fit[%d][%d]: %f\n", i, j,
-			//						impulse_filter_env_blocks_exp_fit[i][j]);
-			//			}
-		}
-
-		if (g_max < impulse_filter_env_blocks_exp_fit[i][0]) {
-			g_max = impulse_filter_env_blocks_exp_fit[i][0];
+	const float *first = getSpectrogramBlock(impulse_filter_env_blocks_exp_fit,
+			0);
+	for (i = 0; i < HALF_FFT_SIZE; i++) {
+		if (*max < first[i]) {
+			*max = first[i];
 		}
-
 	}
 
 	return impulse_filter_env_blocks_exp_fit;
 }
 
+typedef struct NoiseArgs {
+	uint64_t seed; // of the impulse's noise
+	int channel;
+	const Spectrogram *impulse_filter_env_blocks_exp_fit;
+	float *window; // hanning window, FFT_SIZE * 2 samples
+	float *synthesized_impulse_buffer;
+	int64_t firstFrame; // frames before this one are left alone
+	int64_t numFrames;
+	int firstBlock;
+	int phase; // 0 = even blocks, 1 = odd blocks
+	complex **scratch; // two FFT_SIZE * 2 buffers per worker thread
+} NoiseArgs;
+
 /*
- * This function computes the amplitude envelope of an impulse.
- *
- * float *envelope[i], where i = sample number
+ * This function filters one block of white noise and overlap-adds it into
+ * the synthesized impulse. Blocks are numbered within the current phase, so
+ * no two concurrent blocks ever write the same samples.
  */
-float *getAmplitudeEnvelope(audioData *impulse_from_file, int channel) {
-	int amp_envelope_length = impulse_from_file->numFrames / SMOOTHING_AMT;
-
-	float *avg_amplitudes = (float *) malloc(
-			sizeof(float) * amp_envelope_length);
-
-	int i, j;
-	for (i = 0; i < amp_envelope_length; i++) {
-
-		float sum = 0;
-
-		if (channel == LEFT) {
-			for (j = 0; j < SMOOTHING_AMT; j++) {
-				sum += fabsf(impulse_from_file->buffer1[i * SMOOTHING_AMT + j]);
-			}
-		} else if (channel == RIGHT) {
-			for (j = 0; j < SMOOTHING_AMT; j++) {
-				sum += fabsf(impulse_from_file->buffer2[i * SMOOTHING_AMT + j]);
-			}
-		}
-
+static void filterNoiseBlock(int taskIndex, int threadIndex, void *arg) {
 
+	NoiseArgs *args = (NoiseArgs *) arg;
+	int i = args->firstBlock + taskIndex * 2 + args->phase;
+	int j;
 
-		sum /= SMOOTHING_AMT;
+	complex *fftBlock = args->scratch[2 * threadIndex];
+	complex *temp = args->scratch[2 * threadIndex + 1];
 
-		avg_amplitudes[i] = sum;
-
-	}
+	// Put the spectrum of white noise (seeded for this block alone) into fft
+	// buffer. Generating it in the frequency domain saves transforming noise
+	// generated in the time domain. temp is free to use as scratch until the
+	// IFFT.
+	NoiseGenerator generator;
+	seedNoiseGenerator(&generator, getNoiseSeed(args->seed, args->channel, i));
+	generateNoiseSpectrum(&generator, fftBlock, FFT_SIZE * 2, (float *) temp);
 
 	/*
-	 * This envelope buffer holds an amplitude envelope that mirrors the
-	 * shape of the original impulse
+	 * Actually apply frequency-domain filter. Fitted bin j sets the gain of
+	 * bins 2j and 2j + 1 (four floats), mirrored in the upper half.
 	 */
-	float *envelope = (float *) malloc(
-			sizeof(float) * impulse_from_file->numFrames);
-
-	for (i = 0; i < (amp_envelope_length - 1); i++) {
-
-		float difference = avg_amplitudes[i + 1] - avg_amplitudes[i];
-
-		float increment = difference / (float) SMOOTHING_AMT;
-
-		for (j = 0; j < SMOOTHING_AMT; j++) {
-			envelope[i * SMOOTHING_AMT + j] = avg_amplitudes[i]
-															 + (j * increment);
-		}
-
-	}
-
-	for (i = 0; i < impulse_from_file->numFrames; i++) {
-		if (envelope[i] < 0.000001) {
-			envelope[i] = 0.000001;
+	const float *gains = getSpectrogramBlock(
+			args->impulse_filter_env_blocks_exp_fit, i);
+	float *bins = (float *) fftBlock;
+	for (j = 0; j < FFT_SIZE; j++) {
+		float gain = j < FFT_SIZE / 2 ? gains[j] : gains[FFT_SIZE - j - 1];
+		v4sf_store(bins + 4 * j, v4sf_load(bins + 4 * j) * gain);
+	}
+
+	ifft(fftBlock, FFT_SIZE * 2, temp);
+
+	// Window the block and overlap-add it
+	for (j = 0; j < FFT_SIZE * 2; j++) {
+		int64_t frame = (int64_t) i * FFT_SIZE + j;
+		if (frame >= args->firstFrame && frame < args->numFrames) {
+			args->synthesized_impulse_buffer[frame] +=
+					fftBlock[j].Re * args->window[j];
 		}
 	}
-	return envelope;
 }
 
 /*
- * This function computes an exponential fit for an amplitude envelope.
- */
-float *getExponentialFitForAmplitudeEnvelope(float *envelope,
-		audioData *impulse_from_file) {
-
-	int length = impulse_from_file->numFrames;
-
-	float *exp_fit = (float *) malloc(sizeof(float) * length);
-
-	float *temp = (float *) malloc(sizeof(float) * length);
-
-	int i;
-
-	float *x = (float *) malloc(sizeof(float) * length);
-	for (i = 0; i < length; i++) {
-		x[i] = i;
-	}
-
-	for (i = 0; i < length; i++) {
-		temp[i] = log(envelope[i]);
-	}
-
-	float sum_x_times_x = 0.0f;
-	float sum_temp_times_x = 0.0f;
-	float sum_x = 0.0f;
-	float sum_temp = 0.0f;
-
-	for (i = 0; i < length; i++) {
-		sum_x += x[i];
-		sum_temp += temp[i];
-		sum_x_times_x += pow(x[i], 2);
-		sum_temp_times_x += temp[i] * x[i];
-	}
-
-	float b = (length * sum_temp_times_x - sum_x * sum_temp)
-					/ (length * sum_x_times_x - sum_x * sum_x);
-	float a = (sum_temp - b * sum_x) / length;
-
-	float A = exp(a);
-
-	for (i = 0; i < length; i++) {
-		exp_fit[i] = A * exp(b * x[i]);
-	}
-
-	return exp_fit;
-}
-/*
- * This function filters white noise using the exponential fit filter data.
+ * This function filters white noise using the exponential fit filter data,
+ * one FFT_SIZE * 2 block every FFT_SIZE samples. The blocks are independent,
+ * so they are spread across the worker threads. The noise of each block is
+ * seeded from (seed, channel, block), so the result only depends on the
+ * arguments.
  *
  * float *synthesized_impulse_buffer[i], where i = sample number.
  */
 float *getFilteredWhiteNoise(audioData *impulse_from_file,
-		float **impulse_filter_env_blocks_exp_fit) {
-	int i, j;
+		const Spectrogram *impulse_filter_env_blocks_exp_fit, uint64_t seed,
+		int channel, Arena *arena) {
 
 	// Buffer to hold processed audio
-	float *synthesized_impulse_buffer = (float *) calloc(
-			impulse_from_file->numFrames, sizeof(float));
+	float *synthesized_impulse_buffer = allocateChannelBuffer(
+			impulse_from_file->numFrames);
 
-	int numBlocks = (impulse_from_file->numFrames / FFT_SIZE);
-
-	for (i = 0; i < numBlocks; i++) {
-
-		// Allocate memory for FFT
-		complex *fftBlock = (complex *) calloc(FFT_SIZE * 2, sizeof(complex));
-		complex *temp = (complex *) calloc(FFT_SIZE * 2, sizeof(complex));
-
-		// Put white noise into fft buffer
-		for (j = 0; j < FFT_SIZE * 2; j++) {
-
-			fftBlock[j].Re = ((float) rand() / RAND_MAX) * 2.0f - 1.0f;
-		}
-
-		// Take FFT of block
-		fft(fftBlock, FFT_SIZE * 2, temp);
-
-		/*
-		 * Actually apply frequency-domain filter
-		 */
-
-//		// set DC to 0
-//		fftBlock[0].Re = 0.1f;
-//		fftBlock[0].Im = 0.0f;
-//
-//		// If FFT_SIZE = 512, then this goes from 1 to 256 inclusive
-//		for (j = 1; j < FFT_SIZE / 2 + 1; j++) {
-//			fftBlock[2*j - 1].Re *= impulse_filter_env_blocks_exp_fit[j-1][i];
-//			fftBlock[2*j].Re *= impulse_filter_env_blocks_exp_fit[j-1][i];
-//			fftBlock[2 * FFT_SIZE - 2*j + 1].Re *= impulse_filter_env_blocks_exp_fit[j-1][i];
-//			fftBlock[2 * FFT_SIZE - 2*j].Re *= impulse_filter_env_blocks_exp_fit[j-1][i];
-//		}
+	extendFilteredWhiteNoise(synthesized_impulse_buffer, 0,
+			impulse_from_file->numFrames, impulse_filter_env_blocks_exp_fit,
+			seed, channel, arena);
 
+	return synthesized_impulse_buffer;
+}
 
-		for (j = 0; j < FFT_SIZE; j++) {
-			if (j < FFT_SIZE / 2) {
-				fftBlock[2 * j].Re *= impulse_filter_env_blocks_exp_fit[j][i];
-				fftBlock[2 * j + 1].Re *=
-						impulse_filter_env_blocks_exp_fit[j][i];
-				fftBlock[2 * j].Im *= impulse_filter_env_blocks_exp_fit[j][i];
-				fftBlock[2 * j + 1].Im *=
-						impulse_filter_env_blocks_exp_fit[j][i];
-			} else {
-				fftBlock[2 * j].Re *= impulse_filter_env_blocks_exp_fit[FFT_SIZE
-																		- j - 1][i];
-				fftBlock[2 * j + 1].Re *=
-						impulse_filter_env_blocks_exp_fit[FFT_SIZE - j - 1][i];
-				fftBlock[2 * j].Im *= impulse_filter_env_blocks_exp_fit[FFT_SIZE
-																		- j - 1][i];
-				fftBlock[2 * j + 1].Im *=
-						impulse_filter_env_blocks_exp_fit[FFT_SIZE - j - 1][i];
-			}
-		}
-
-
-
-		ifft(fftBlock, FFT_SIZE * 2, temp);
-
-		float *fftBlock_float = (float *) malloc(sizeof(float) * FFT_SIZE * 2);
-
-		for (j = 0; j < FFT_SIZE * 2; j++) {
-
-			fftBlock_float[j] = fftBlock[j].Re;
-
-		}
-
-		float *window = (float *) malloc(sizeof(float) * FFT_SIZE * 2);
-		hanning(window, FFT_SIZE * 2);
+/*
+ * This function synthesizes frames firstFrame to numFrames - 1 of filtered
+ * white noise (zero in the buffer until then), exactly as
+ * getFilteredWhiteNoise() would: only the blocks that reach those frames are
+ * filtered, so noise made for a shorter impulse is extended without
+ * synthesizing what it already holds again.
+ */
+void extendFilteredWhiteNoise(float *synthesized_impulse_buffer,
+		int64_t firstFrame, int64_t numFrames,
+		const Spectrogram *impulse_filter_env_blocks_exp_fit, uint64_t seed,
+		int channel, Arena *arena) {
+	int i;
 
-		for (j = 0; j < FFT_SIZE * 2; j++) {
+	int numBlocks = (int) (numFrames / FFT_SIZE);
+	// The block before the first frame's overlaps it
+	int firstBlock = (int) (firstFrame / FFT_SIZE) - 1;
+	if (firstBlock < 0) {
+		firstBlock = 0;
+	}
+	if (firstBlock >= numBlocks) {
+		return;
+	}
 
-			if (i * FFT_SIZE + j < impulse_from_file->numFrames) {
-				synthesized_impulse_buffer[i * FFT_SIZE + j] +=
-						fftBlock_float[j] * window[j];
-			}
+	float *window = (float *) arenaAlloc(arena, sizeof(float) * FFT_SIZE * 2);
+	hanning(window, FFT_SIZE * 2);
 
-		}
+	int numThreads = getNumWorkerThreads();
+	complex **scratch = (complex **) arenaAlloc(arena,
+			sizeof(complex *) * numThreads * 2);
+	for (i = 0; i < numThreads * 2; i++) {
+		scratch[i] = (complex *) arenaAlloc(arena,
+				sizeof(complex) * FFT_SIZE * 2);
+	}
 
-		free(temp);
-		free(fftBlock_float);
-		free(fftBlock);
-		free(window);
+	NoiseArgs args;
+	args.seed = seed;
+	args.channel = channel;
+	args.impulse_filter_env_blocks_exp_fit = impulse_filter_env_blocks_exp_fit;
+	args.window = window;
+	args.synthesized_impulse_buffer = synthesized_impulse_buffer;
+	args.firstFrame = firstFrame;
+	args.numFrames = numFrames;
+	args.firstBlock = firstBlock;
+	args.scratch = scratch;
 
+	/*
+	 * Block i overlaps only block i + 1, so all even blocks can run at once,
+	 * followed by all odd blocks.
+	 */
+	for (args.phase = 0; args.phase < 2; args.phase++) {
+		parallelFor((numBlocks - firstBlock - args.phase + 1) / 2,
+				filterNoiseBlock, &args);
 	}
-	return synthesized_impulse_buffer;
 }
 
 /*
@@ -3173,26 +3058,19 @@ float *getFilteredWhiteNoise(audioData *impulse_from_file,
  * noise buffer.
  */
 void applyAmplitudeEnvelope(audioData *impulse_from_file,
-		float *synthesized_impulse_buffer, float *envelope) {
+		float *synthesized_impulse_buffer, const AmplitudeEnvelope *envelope) {
 	float output_max = 0.0f;
-	int i;
-	float *exp_fit = getExponentialFitForAmplitudeEnvelope(envelope,
-			impulse_from_file);
-
-	float *differences = (float *) malloc(
-			sizeof(float) * impulse_from_file->numFrames);
-
-	for (i = 0; i < impulse_from_file->numFrames; i++) {
-		differences[i] = envelope[i] / exp_fit[i];
-		//		printf("differences[%d]: %f/%f: %f\n", i, envelope[i], exp_fit[i], differences[i]);
-	}
+	int64_t i;
 
 	/*
 	 * Apply amplitude envelope
 	 */
 	for (i = 0; i < impulse_from_file->numFrames; i++) {
 
-		//		synthesized_impulse_buffer[i] *= differences[i];
+		//		float frame_envelope;
+		//		getAmplitudeEnvelopeFrames(envelope, i, 1, &frame_envelope);
+		//		synthesized_impulse_buffer[i] *= frame_envelope
+		//				/ (envelope->A * exp(envelope->b * i));
 
 		if (fabsf(synthesized_impulse_buffer[i]) > output_max) {
 			output_max = fabsf(synthesized_impulse_buffer[i]);
@@ -3211,40 +3089,46 @@ void applyAmplitudeEnvelope(audioData *impulse_from_file,
  * This function stores initial exponential fit values (for the first block of data)
  * so that it can be visually displayed using OpenGL.
  */
-void setTopValsBasedOnImpulseFFTBlocks(
-		float **impulse_filter_env_blocks_exp_fit, int channel) {
+void setGraphValues(const Spectrogram *impulse_filter_env_blocks_exp_fit,
+		float max, float *top, float *bottom) {
 	int i;
+	const float *first = getSpectrogramBlock(impulse_filter_env_blocks_exp_fit,
+			0);
 
-	if (channel == LEFT) {
-		for (i = 0; i < FFT_SIZE / 2; i++) {
-
-			// Divide by g_max in order to normalize values
-			// g_max = maximum complex amplitude of impulse
-			top_vals_left[i] = ((g_height_top - g_height_bottom) - (impulse_filter_env_blocks_exp_fit[i][0] * (g_height_top - g_height_bottom) / g_max)) * -1;
-
-			//		printf("exp_fit_val[%d][0]: %f, top_vals_left[%d]: %f\n", i, impulse_filter_env_blocks_exp_fit[i][0], i, top_vals_left[i]);
-
-			bottom_vals_left[i] = 0.0001f;
-
-		}
-	} else if (channel == RIGHT) {
-		for (i = 0; i < FFT_SIZE / 2; i++) {
-
-			// Divide by g_max in order to normalize values
-			top_vals_right[i] = ((g_height_top - g_height_bottom) - (impulse_filter_env_blocks_exp_fit[i][0] * (g_height_top - g_height_bottom) / g_max)) * -1;
+	for (i = 0; i < FFT_SIZE / 2; i++) {
 
-			//		printf("exp_fit_val[%d][0]: %f, top_vals_left[%d]: %f\n", i, impulse_filter_env_blocks_exp_fit[i][0], i, top_vals_left[i]);
+		// Divide by max in order to normalize values
+		// max = maximum complex amplitude of impulse
+		top[i] = ((g_height_top - g_height_bottom) - (first[i] * (g_height_top - g_height_bottom) / max)) * -1;
 
-			bottom_vals_right[i] = 0.0001f;
+		bottom[i] = 0.0001f;
 
-		}
 	}
+}
 
+void setTopValsBasedOnImpulseFFTBlocks(
+		const Spectrogram *impulse_filter_env_blocks_exp_fit, int channel) {
+	setGraphValues(impulse_filter_env_blocks_exp_fit, g_max, top_vals[channel],
+			bottom_vals[channel]);
+}
 
+/*
+ * This function sizes the graph values for an impulse with numChannels
+ * channels. Existing values are kept when the channel count is unchanged.
+ */
+void allocateGraphValues(int numChannels) {
+	if (numChannels == g_num_graph_channels) {
+		return;
+	}
+	free(top_vals);
+	free(bottom_vals);
+	top_vals = calloc(numChannels, sizeof(*top_vals));
+	bottom_vals = calloc(numChannels, sizeof(*bottom_vals));
+	g_num_graph_channels = numChannels;
 }
 
 void crossfadeRecordedAndSynthesizedImpulses(float* synthesized_impulse_buffer,
-		audioData* impulse_from_file, int channel) {
+		audioData* impulse_from_file, int channel, Arena *arena) {
 
 	int i;
 
@@ -3253,35 +3137,23 @@ void crossfadeRecordedAndSynthesizedImpulses(float* synthesized_impulse_buffer,
 	}
 
 	// Create window for use in crossfading
-	float *window = (float *) malloc(sizeof(float) * crossover_length * 2);
+	float *window = (float *) arenaAlloc(arena,
+			sizeof(float) * crossover_length * 2);
 	create_hanning(window, crossover_length * 2);
 
-	if (channel == LEFT) {
-		// Use original impulse up until crossover point
-		for (i = 0; i < crossover_point; i++) {
-			synthesized_impulse_buffer[i] = impulse_from_file->buffer1[i];
-		}
-	} else if (channel == RIGHT) {
-		// Use original impulse up until crossover point
-		for (i = 0; i < crossover_point; i++) {
-			synthesized_impulse_buffer[i] = impulse_from_file->buffer2[i];
-		}
-	}
+	float *original = impulse_from_file->channels[channel];
 
+	// Use original impulse up until crossover point
+	for (i = 0; i < crossover_point; i++) {
+		synthesized_impulse_buffer[i] = original[i];
+	}
 
 	// Fade between original and synthesized impulse over crossover length
 	for (i = 0; i < crossover_length; i++) {
 
-		float original_component = 0.0f;
-		if (channel == LEFT) {
-			// Use second half of hanning window to fade out original component
-			original_component = impulse_from_file->buffer1[crossover_point
-															+ i] * window[crossover_length + i];
-		} else if (channel == RIGHT) {
-			// Use second half of hanning window to fade out original component
-			original_component = impulse_from_file->buffer2[crossover_point
-															+ i] * window[crossover_length + i];
-		}
+		// Use second half of hanning window to fade out original component
+		float original_component = original[crossover_point + i]
+				* window[crossover_length + i];
 
 		// Use first half of hanning window to fade in synthesized component
 		float synthesized_component = synthesized_impulse_buffer[crossover_point
@@ -3294,313 +3166,995 @@ void crossfadeRecordedAndSynthesizedImpulses(float* synthesized_impulse_buffer,
 }
 
 /*
- * This function resynthesizes the impulse whenever a change is made.
+ * This function scales every channel of an impulse by the reciprocal of its
+ * largest absolute sample.
  */
-audioData *resynthesizeImpulse(audioData *currentImpulse, int newLengthInFrames) {
-
-	int i;
-	// Preliminary calculations/processes
-	audioData *synth_impulse = (audioData *) malloc(sizeof(audioData));
-	//	int length = currentImpulse->numFrames;
-	//	int num_impulse_blocks = (currentImpulse->numFrames / FFT_SIZE);
+void normalizeImpulse(audioData *impulse) {
+	int c;
+	int64_t i;
+	float max = 0.0f;
+	for (c = 0; c < impulse->numChannels; c++) {
+		max = fmaxf(max, findPeak(impulse->channels[c], impulse->numFrames));
+	}
+	if (max == 0.0f) {
+		return;
+	}
+	for (c = 0; c < impulse->numChannels; c++) {
+		for (i = 0; i < impulse->numFrames; i++) {
+			impulse->channels[c][i] /= max;
+		}
+	}
+}
 
-	// Put synthesized impulse in audioData struct
-	synth_impulse->numChannels = currentImpulse->numChannels;
-	synth_impulse->numFrames = newLengthInFrames;
-	synth_impulse->sampleRate = SAMPLE_RATE;
-	synth_impulse->buffer1 = (float *) malloc(sizeof(float) * newLengthInFrames * currentImpulse->numChannels);
-	synth_impulse->buffer2 = (float *) malloc(sizeof(float) * newLengthInFrames * currentImpulse->numChannels);
+/*
+ * This function returns the number of bins of a channel's graph that differ
+ * from the graph its cached synthesis was drawn from (all of them if there
+ * is no usable cached synthesis).
+ */
+int countDirtyBins(int channel) {
+	int i, dirty = 0;
+	SynthesisCache *cache = &g_synthesis_cache;
 
-	/*
-	 * If the impulse is MONO
-	 */
-	if (synth_impulse->numChannels == MONO) {
+	if (channel >= cache->numChannels || cache->seed != g_noise_seed
+			|| cache->max != g_max
+			|| cache->height != g_height_top - g_height_bottom) {
+		return HALF_FFT_SIZE;
+	}
+	for (i = 0; i < HALF_FFT_SIZE; i++) {
+		if (cache->channels[channel].top[i] != top_vals[channel][i]
+				|| cache->channels[channel].bottom[i] != bottom_vals[channel][i]) {
+			dirty++;
+		}
+	}
+	return dirty;
+}
 
-		//TODO: Create new exponential fit data based on top_vals and bottom_vals, not on impulse data.
-		float **exp_fit = getExponentialFitFromGraph(
-				synth_impulse->numFrames / FFT_SIZE, LEFT);
+/*
+ * This function empties the synthesis cache, for a graph that no longer
+ * describes what it holds (another impulse's).
+ */
+void invalidateSynthesisCache() {
+	SynthesisCache *cache = &g_synthesis_cache;
+	for (int c = 0; c < cache->numChannels; c++) {
+		free(cache->channels[c].noise);
+	}
+	free(cache->channels);
+	cache->channels = NULL;
+	cache->numChannels = 0;
+	cache->fitBlocks = 0;
+}
 
-//		setTopValsBasedOnImpulseFFTBlocks(exp_fit, LEFT);
+/*
+ * This function returns the span, in blocks, over which the graph's decays
+ * are fitted: the synthesis cache's, or the impulse's length until there is
+ * one.
+ */
+int getGraphDecayBlocks() {
+	if (g_synthesis_cache.numChannels > 0) {
+		return g_synthesis_cache.fitBlocks;
+	}
+	return (int) (g_impulse_num_frames / FFT_SIZE);
+}
 
-		//Then, filter white noise with this exponential fit data.
-		float *synthesized_impulse_buffer = getFilteredWhiteNoise(
-				synth_impulse, exp_fit);
+/*
+ * This function makes the synthesis cache describe an impulse of numChannels
+ * channels synthesized with the current settings, keeping what it holds if
+ * that is still the case. A new cache fits decays over fitBlocks blocks.
+ */
+void resetSynthesisCache(int numChannels, int fitBlocks) {
+	int c;
+	SynthesisCache *cache = &g_synthesis_cache;
 
-		g_amp_envelope = getAmplitudeEnvelope(synth_impulse, LEFT);
+	if (cache->numChannels == numChannels && cache->seed == g_noise_seed
+			&& cache->max == g_max
+			&& cache->height == g_height_top - g_height_bottom) {
+		return;
+	}
+	invalidateSynthesisCache();
+
+	cache->numChannels = numChannels;
+	cache->fitBlocks = fitBlocks;
+	cache->seed = g_noise_seed;
+	cache->max = g_max;
+	cache->height = g_height_top - g_height_bottom;
+	cache->channels = (ChannelSynthesis *) calloc(numChannels,
+			sizeof(ChannelSynthesis));
+	for (c = 0; c < numChannels; c++) {
+		// Never matches a graph value, so every bin starts dirty
+		for (int i = 0; i < HALF_FFT_SIZE; i++) {
+			cache->channels[c].top[i] = NAN;
+		}
+	}
+}
 
-		//Then, apply amp envelope.
-		applyAmplitudeEnvelope(synth_impulse, synthesized_impulse_buffer,
-				g_amp_envelope);
+/*
+ * This function makes a channel's filtered noise (numFrames frames long) at
+ * least newNumFrames long, along the decay (A, b) it was fitted to: only the
+ * new blocks at its end are synthesized. Returns the resized noise.
+ */
+float *extendNoise(float *noise, int64_t numFrames, int64_t newNumFrames,
+		const float *A, const float *b, uint64_t seed, int channel,
+		Arena *arena) {
+	if (numFrames >= newNumFrames) {
+		return noise;
+	}
+
+	// Frames up to the last whole block are final; the ones after it are
+	// still missing the start of the next block
+	int64_t firstFrame = numFrames / FFT_SIZE * FFT_SIZE;
+	noise = resizeChannelBuffer(noise, numFrames, newNumFrames);
+	memset(noise + firstFrame, 0, sizeof(float) * (newNumFrames - firstFrame));
+
+	Spectrogram *exp_fit = createSpectrogram((int) (newNumFrames / FFT_SIZE),
+			HALF_FFT_SIZE, arena);
+	fillExponentialSpectrogram(exp_fit, A, b, arena);
+	extendFilteredWhiteNoise(noise, firstFrame, newNumFrames, exp_fit, seed,
+			channel, arena);
+	return noise;
+}
 
-		// crossfade between recorded impulse attack and synthesized tail
-		crossfadeRecordedAndSynthesizedImpulses(synthesized_impulse_buffer,
-				currentImpulse, LEFT);
+/*
+ * This function fades out the last FFT_SIZE frames of a buffer, so that a
+ * preview doesn't end in a click where its noise stops. (The full impulse
+ * isn't faded.)
+ */
+void fadeOutEnd(float *buffer, int64_t numFrames, Arena *arena) {
+	int i;
+	int length = numFrames < FFT_SIZE ? (int) numFrames : FFT_SIZE;
+	float *window = (float *) arenaAlloc(arena, sizeof(float) * length * 2);
+	hanning(window, length * 2);
+	for (i = 0; i < length; i++) {
+		buffer[numFrames - length + i] *= window[length + i];
+	}
+}
 
-		// Write to a wav file
-		//		writeWavFile(synthesized_impulse_buffer, SAMPLE_RATE,
-		//				synth_impulse->numChannels, synth_impulse->numFrames, 1,
-		//				"11_10_2015_test.wav");
+/*
+ * This function makes channel c of a synthesized impulse from its filtered
+ * noise (synthesized with seed), normalized, and crossfaded from the attack
+ * of the impulse it replaces. Noise that stops short of the end (a preview)
+ * is faded out; noise that runs past it is cut exactly as if it had been
+ * synthesized for this length. It only reads its arguments, so it runs on
+ * the refiner's thread as well.
+ */
+void shapeSynthesizedChannel(audioData *synth_impulse, int c,
+		const ChannelSynthesis *channel, uint64_t seed, audioData *attack,
+		const AmplitudeEnvelope *amp_envelope, Arena *arena) {
+
+	float *synthesized_impulse_buffer = synth_impulse->channels[c];
+	int64_t numFrames = synth_impulse->numFrames;
+
+	if (channel->numFrames < numFrames) {
+		memcpy(synthesized_impulse_buffer, channel->noise,
+				sizeof(float) * channel->numFrames);
+		fadeOutEnd(synthesized_impulse_buffer, channel->numFrames, arena);
+	} else if (channel->numFrames == numFrames) {
+		memcpy(synthesized_impulse_buffer, channel->noise,
+				sizeof(float) * numFrames);
+	} else {
+		// Frames after the last whole block also hold the start of a block
+		// past the end; they are made again from the last block alone
+		int64_t firstFrame = numFrames / FFT_SIZE * FFT_SIZE;
+		memcpy(synthesized_impulse_buffer, channel->noise,
+				sizeof(float) * firstFrame);
+		Spectrogram *exp_fit = createSpectrogram((int) (numFrames / FFT_SIZE),
+				HALF_FFT_SIZE, arena);
+		fillExponentialSpectrogram(exp_fit, channel->A, channel->b, arena);
+		extendFilteredWhiteNoise(synthesized_impulse_buffer, firstFrame,
+				numFrames, exp_fit, seed, c, arena);
+	}
+
+	//Then, apply amp envelope.
+	applyAmplitudeEnvelope(synth_impulse, synthesized_impulse_buffer,
+			amp_envelope);
+
+	// crossfade between recorded impulse attack and synthesized tail
+	crossfadeRecordedAndSynthesizedImpulses(synthesized_impulse_buffer,
+			attack, c, arena);
+
+	// Write to a wav file
+	//		writeWavFile(synthesized_impulse_buffer, SAMPLE_RATE,
+	//				synth_impulse->numChannels, synth_impulse->numFrames, 1,
+	//				"11_10_2015_test.wav");
+}
 
-		// Put synthesized impulse in audioData struct
-		synth_impulse->buffer1 = synthesized_impulse_buffer;
+/*
+ * This function resynthesizes the impulse whenever a change is made. Only
+ * channels with changed bins are synthesized again; the noise of the others
+ * comes from the synthesis cache, cut or extended to the new length. No
+ * channel's noise is synthesized past previewFrames: the rest of the
+ * impulse is silent until refineImpulse() makes it. currentImpulse is left
+ * to the caller.
+ */
+audioData *resynthesizeImpulse(audioData *currentImpulse,
+		int64_t newLengthInFrames, int64_t previewFrames) {
 
-		float max = 0.0f;
-		for (i = 0; i < synth_impulse->numFrames; i++) {
-			if (fabsf(synth_impulse->buffer1[i]) > max) {
-				max = fabsf(synth_impulse->buffer1[i]);
+	int c;
+	// Preliminary calculations/processes
+	audioData *synth_impulse = createAudioData(currentImpulse->numChannels,
+			newLengthInFrames, g_sample_rate);
+	int64_t synthesisFrames = previewFrames < newLengthInFrames ?
+			previewFrames : newLengthInFrames;
+
+	// Every temporary of the synthesis comes from here
+	Arena *arena = createArena(SYNTHESIS_ARENA_CHUNK_SIZE);
+
+	AmplitudeEnvelope *amp_envelope = analyzeAmplitudeEnvelope(
+			synth_impulse->channels[0], synth_impulse->numFrames,
+			SMOOTHING_AMT, arena);
+
+	// Dirty bins are counted before resetSynthesisCache() can forget them
+	int *dirty_bins = (int *) arenaAlloc(arena,
+			sizeof(int) * synth_impulse->numChannels);
+	for (c = 0; c < synth_impulse->numChannels; c++) {
+		dirty_bins[c] = countDirtyBins(c);
+	}
+	resetSynthesisCache(synth_impulse->numChannels,
+			(int) (synth_impulse->numFrames / FFT_SIZE));
+
+	for (c = 0; c < synth_impulse->numChannels; c++) {
+
+		ChannelSynthesis *cached = &g_synthesis_cache.channels[c];
+
+		if (dirty_bins[c] == 0) {
+			if (cached->numFrames < synthesisFrames) {
+				printf("Extending channel %d from %lld to %lld frames\n", c + 1,
+						(long long) cached->numFrames,
+						(long long) synthesisFrames);
+				cached->noise = extendNoise(cached->noise, cached->numFrames,
+						synthesisFrames, cached->A, cached->b, g_noise_seed, c,
+						arena);
+				cached->numFrames = synthesisFrames;
 			}
+		} else {
+			printf("Resynthesizing channel %d (%d of %d bins changed)\n", c + 1,
+					dirty_bins[c], HALF_FFT_SIZE);
+
+			//TODO: Create new exponential fit data based on top_vals and bottom_vals, not on impulse data.
+			Spectrogram *exp_fit = getExponentialFitFromGraph(
+					synth_impulse->numFrames / FFT_SIZE,
+					g_synthesis_cache.fitBlocks, c, cached->A, cached->b,
+					arena);
+
+			setTopValsBasedOnImpulseFFTBlocks(exp_fit, c);
+
+			//Then, filter white noise with this exponential fit data (as
+			//far as the preview goes).
+			free(cached->noise);
+			cached->noise = allocateChannelBuffer(synthesisFrames);
+			cached->numFrames = synthesisFrames;
+			extendFilteredWhiteNoise(cached->noise, 0, synthesisFrames,
+					exp_fit, g_noise_seed, c, arena);
+
+			// Keep it for the next resynthesis, with the graph (as it is after
+			// setTopValsBasedOnImpulseFFTBlocks()) that it was drawn from
+			memcpy(cached->top, top_vals[c], sizeof(cached->top));
+			memcpy(cached->bottom, bottom_vals[c], sizeof(cached->bottom));
 		}
 
-		for (i = 0; i < synth_impulse->numFrames; i++) {
-			synth_impulse->buffer1[i] /= max;
-		}
-
+		shapeSynthesizedChannel(synth_impulse, c, cached, g_noise_seed,
+				currentImpulse, amp_envelope, arena);
 	}
-	/*
-	 * If the impulse is STEREO
-	 */
-	else if (synth_impulse->numChannels == STEREO) {
-		//TODO: Create new exponential fit data based on top_vals and bottom_vals, not on impulse data.
-		float **exp_fit_left = getExponentialFitFromGraph(
-				synth_impulse->numFrames / FFT_SIZE, LEFT);
-		float **exp_fit_right = getExponentialFitFromGraph(
-				synth_impulse->numFrames / FFT_SIZE, RIGHT);
-
-		setTopValsBasedOnImpulseFFTBlocks(exp_fit_left, LEFT);
-		setTopValsBasedOnImpulseFFTBlocks(exp_fit_right, RIGHT);
-
-		//Then, filter white noise with this exponential fit data.
-		float *synthesized_impulse_buffer_left = getFilteredWhiteNoise(
-				synth_impulse, exp_fit_left);
-		float *synthesized_impulse_buffer_right = getFilteredWhiteNoise(
-				synth_impulse, exp_fit_right);
-
-		g_amp_envelope = getAmplitudeEnvelope(synth_impulse, LEFT);
-
-		//Then, apply amp envelope.
-		applyAmplitudeEnvelope(synth_impulse, synthesized_impulse_buffer_left,
-				g_amp_envelope);
-		applyAmplitudeEnvelope(synth_impulse, synthesized_impulse_buffer_right,
-				g_amp_envelope);
 
-		// crossfade between recorded impulse attack and synthesized tail
-		crossfadeRecordedAndSynthesizedImpulses(synthesized_impulse_buffer_left,
-				currentImpulse, LEFT);
-		crossfadeRecordedAndSynthesizedImpulses(synthesized_impulse_buffer_right,
-				currentImpulse, RIGHT);
+	free_Arena(arena);
 
-		// Write to a wav file
-		//		writeWavFile(synthesized_impulse_buffer, SAMPLE_RATE,
-		//				synth_impulse->numChannels, synth_impulse->numFrames, 1,
-		//				"11_10_2015_test.wav");
+	normalizeImpulse(synth_impulse);
 
-		// Put synthesized impulse in audioData struct
-		synth_impulse->buffer1 = synthesized_impulse_buffer_left;
-		synth_impulse->buffer2 = synthesized_impulse_buffer_right;
-
-		int i;
-		float max = 0.0f;
-		for (i = 0; i < synth_impulse->numFrames; i++) {
-			if (fabsf(synth_impulse->buffer1[i]) > max) {
-				max = fabsf(synth_impulse->buffer1[i]);
-			}
-			if (fabsf(synth_impulse->buffer2[i]) > max) {
-				max = fabsf(synth_impulse->buffer2[i]);
-			}
+	//Then, recalculate all the stuff in loadImpulse() based on the resynthesized impulse.
+	return synth_impulse;
+}
+
+/*
+ * This function returns whether the synthesis cache holds all the noise of
+ * an impulse of numFrames frames.
+ */
+bool isSynthesisComplete(int64_t numFrames) {
+	for (int c = 0; c < g_synthesis_cache.numChannels; c++) {
+		if (g_synthesis_cache.channels[c].numFrames < numFrames) {
+			return false;
 		}
+	}
+	return true;
+}
 
-		for (i = 0; i < synth_impulse->numFrames; i++) {
-			synth_impulse->buffer1[i] /= max;
-			synth_impulse->buffer2[i] /= max;
+void free_ImpulseRefinement(void *job) {
+	ImpulseRefinement *refinement = (ImpulseRefinement *) job;
+	for (int c = 0; c < refinement->numChannels; c++) {
+		free(refinement->channels[c].noise);
+	}
+	free(refinement->channels);
+	free_audioData(refinement->attack);
+	free_audioData(refinement->preview);
+	releaseFFTData(refinement->previewSpectra);
+	if (refinement->impulse) {
+		free_audioData(refinement->impulse);
+	}
+	// Spectra of their own (carried-over partitions are copies), unless
+	// they were installed
+	if (refinement->fftData) {
+		free_FFTData(refinement->fftData);
+	}
+	free(refinement);
+}
+
+/*
+ * This function sets up the refinement of a preview that was just put in
+ * the engine, with its own copies of everything it reads.
+ */
+ImpulseRefinement *createImpulseRefinement(audioData *attack,
+		audioData *preview, FFTData *previewSpectra, int64_t numFrames) {
+	int c;
+	ImpulseRefinement *refinement = (ImpulseRefinement *) calloc(1,
+			sizeof(ImpulseRefinement));
+	refinement->numChannels = g_synthesis_cache.numChannels;
+	refinement->numFrames = numFrames;
+	refinement->sampleRate = g_sample_rate;
+	refinement->blockLength = g_block_length;
+	refinement->seed = g_noise_seed;
+
+	refinement->channels = (ChannelSynthesis *) malloc(
+			sizeof(ChannelSynthesis) * refinement->numChannels);
+	for (c = 0; c < refinement->numChannels; c++) {
+		ChannelSynthesis *cached = &g_synthesis_cache.channels[c];
+		refinement->channels[c] = *cached;
+		refinement->channels[c].noise = allocateChannelBuffer(
+				cached->numFrames);
+		memcpy(refinement->channels[c].noise, cached->noise,
+				sizeof(float) * cached->numFrames);
+	}
+
+	// Only the frames the crossfade reads
+	int64_t attackFrames = crossover_point + crossover_length;
+	if (attackFrames > attack->numFrames) {
+		attackFrames = attack->numFrames;
+	}
+	refinement->attack = createAudioData(attack->numChannels, attackFrames,
+			attack->sampleRate);
+	for (c = 0; c < attack->numChannels; c++) {
+		memcpy(refinement->attack->channels[c], attack->channels[c],
+				sizeof(float) * attackFrames);
+	}
+
+	refinement->preview = copyAudioData(preview);
+	refinement->previewSpectra = previewSpectra;
+	acquireFFTData(previewSpectra);
+	refinement->target = preview;
+	return refinement;
+}
+
+/*
+ * This function makes the full impulse of a refinement, on the refiner's
+ * thread: the rest of each channel's noise, then the impulse exactly as
+ * resynthesizeImpulse() would have made it without a preview. Partitions
+ * the preview already had right keep their spectra.
+ */
+void refineImpulse(void *job) {
+	int c;
+	ImpulseRefinement *refinement = (ImpulseRefinement *) job;
+
+	audioData *impulse = createAudioData(refinement->numChannels,
+			refinement->numFrames, refinement->sampleRate);
+	Arena *arena = createArena(SYNTHESIS_ARENA_CHUNK_SIZE);
+
+	AmplitudeEnvelope *amp_envelope = analyzeAmplitudeEnvelope(
+			impulse->channels[0], impulse->numFrames, SMOOTHING_AMT, arena);
+
+	for (c = 0; c < refinement->numChannels; c++) {
+		ChannelSynthesis *channel = &refinement->channels[c];
+		channel->noise = extendNoise(channel->noise, channel->numFrames,
+				refinement->numFrames, channel->A, channel->b,
+				refinement->seed, c, arena);
+		if (channel->numFrames < refinement->numFrames) {
+			channel->numFrames = refinement->numFrames;
 		}
+		shapeSynthesizedChannel(impulse, c, channel, refinement->seed,
+				refinement->attack, amp_envelope, arena);
 	}
 
-	// Free all data from previous impulse
-	free(currentImpulse->buffer1);
-	free(currentImpulse->buffer2);
-	//	free(g_impulse);
-	g_impulse = synth_impulse;
+	free_Arena(arena);
+	normalizeImpulse(impulse);
 
-	//Then, recalculate all the stuff in loadImpulse() based on the resynthesized impulse.
-	return synth_impulse;
+	impulse = zeroPadToNextPowerOfTwo(impulse);
+	Vector blockLengthVector = determineBlockLengths(impulse,
+			refinement->blockLength);
+	refinement->fftData = updatePartitionSpectra(impulse, blockLengthVector,
+			refinement->preview, refinement->previewSpectra);
+	vector_free(&blockLengthVector);
+	refinement->impulse = impulse;
 }
 
 /*
- * This function synthesizes an impulse from an audio file.
+ * This function puts the full impulse in place of the preview it refines,
+ * once the refiner has made it. The engine takes up its spectra at its next
+ * block, as with live edits, and the synthesis cache keeps its noise.
  */
-audioData *synthesizeImpulse(char *fileName) {
+void installRefinedImpulse() {
+	int c;
+	ImpulseRefinement *refinement = (ImpulseRefinement *) takeRefinement(
+			g_refiner);
+	if (refinement == NULL) {
+		return;
+	}
 
-	// Preliminary calculations/processes
-	audioData *impulse_from_file = fileToBuffer(fileName);
-	audioData *synth_impulse = (audioData *) malloc(sizeof(audioData));
-	int length_before_zero_padding = impulse_from_file->numFrames;
-	zeroPadToNextPowerOfTwo(impulse_from_file);
-	int num_impulse_blocks = (impulse_from_file->numFrames / FFT_SIZE);
+	// Another impulse took the preview's place meanwhile
+	if (g_impulse != refinement->target || g_changingImpulse
+			|| __atomic_load_n(&g_pending_impulse, __ATOMIC_ACQUIRE)) {
+		free_ImpulseRefinement(refinement);
+		return;
+	}
 
-	int i;
+	printf("Refined impulse installed\n");
+	audioData *preview = g_impulse;
+	g_impulse = refinement->impulse;
+	refinement->impulse = NULL;
+	FFTData *previewSpectra = g_impulse_spectra;
+	g_impulse_spectra = refinement->fftData;
+	__atomic_store_n(&g_fftData_ptr, refinement->fftData, __ATOMIC_SEQ_CST);
+	refinement->fftData = NULL;
+	// Partitions may still be convolving with the preview's spectra
+	retireImpulse(previewSpectra, preview, -1);
+
+	// Nothing resynthesized since the refinement was posted, so the cache
+	// still is what it copied
+	for (c = 0; c < refinement->numChannels; c++) {
+		ChannelSynthesis *cached = &g_synthesis_cache.channels[c];
+		float *noise = cached->noise;
+		cached->noise = refinement->channels[c].noise;
+		cached->numFrames = refinement->channels[c].numFrames;
+		refinement->channels[c].noise = noise;
+	}
+	free_ImpulseRefinement(refinement);
+}
 
-	/*
-	 * If the impulse is MONO
-	 */
-	if (impulse_from_file->numChannels == MONO) {
+/*
+ * This function identifies the spectral model of an impulse: a hash of the
+ * source impulse and of every setting that changes what the analysis finds.
+ */
+uint64_t getModelKey(uint64_t sourceHash) {
+	int settings[] = { SPECTRAL_MODEL_VERSION, g_sample_rate, FFT_SIZE,
+			SMOOTHING_AMT };
+	return hashBytes(sourceHash, settings, sizeof(settings));
+}
 
-		float max = 0.0f;
-		for (i = 0; i < impulse_from_file->numFrames; i++) {
-			if (fabsf(impulse_from_file->buffer1[i]) > max) {
-				max = fabsf(impulse_from_file->buffer1[i]);
-			}
-		}
+/*
+ * This function analyzes an impulse (already zero-padded and normalized):
+ * the exponential decay of every frequency bin of every channel, and the
+ * average amplitude of the first channel.
+ */
+SpectralModel *analyzeImpulse(audioData *impulse_from_file,
+		int64_t length_before_zero_padding, Arena *arena) {
 
-		for (i = 0; i < impulse_from_file->numFrames; i++) {
-			impulse_from_file->buffer1[i] /= max;
-		}
+	int c;
+	int num_impulse_blocks = (int) (impulse_from_file->numFrames / FFT_SIZE);
+	int envelope_length = (int) (impulse_from_file->numFrames / SMOOTHING_AMT);
+
+	SpectralModel *model = createSpectralModel(impulse_from_file->numChannels,
+			HALF_FFT_SIZE, envelope_length);
+	model->numBlocks = num_impulse_blocks;
+	model->numFrames = impulse_from_file->numFrames;
+	model->envelopeSpacing = SMOOTHING_AMT;
+
+	for (c = 0; c < impulse_from_file->numChannels; c++) {
 
 		// Get the impulse FFT spectrogram
-		float **impulse_filter_env_blocks = getImpulseFFTBlocks(
-				impulse_from_file, LEFT);
+		Spectrogram *impulse_filter_env_blocks = getImpulseFFTBlocks(
+				impulse_from_file, c, arena);
 
 		/*
-		 * For each impulse_filter_env block, create exponential fit (to smooth out filter decay)
+		 * For each frequency bin, fit an exponential decay (to smooth out
+		 * filter decay)
 		 */
-		float **impulse_filter_env_blocks_exp_fit =
-				getExponentialFitForImpulseFFTBlocks(num_impulse_blocks,
-						length_before_zero_padding, impulse_filter_env_blocks);
+		fitExponentialDecay(length_before_zero_padding,
+				impulse_filter_env_blocks, model->A[c], model->b[c], arena);
+	}
 
-		// Use exponential fit data to draw impulse frequency response
-		setTopValsBasedOnImpulseFFTBlocks(impulse_filter_env_blocks_exp_fit, LEFT);
+	AmplitudeEnvelope *envelope = analyzeAmplitudeEnvelope(
+			impulse_from_file->channels[0], impulse_from_file->numFrames,
+			SMOOTHING_AMT, arena);
+	memcpy(model->envelope, envelope->average,
+			sizeof(float) * envelope_length);
+
+	return model;
+}
+
+/*
+ * This function synthesizes an impulse from the audio of an impulse file
+ * (which it frees). The analysis of the impulse is kept in a sidecar file
+ * next to it (<impulse>.model), so that it is only repeated when the impulse
+ * or the analysis settings change.
+ *
+ * The graph of the impulse is written to graphState (laid out as described
+ * at getGraphStateLength()) rather than to the graph on screen, so impulses
+ * can be synthesized away from the display thread.
+ */
+audioData *synthesizeImpulse(audioData *impulse_from_file,
+		uint64_t sourceHash, float *graphState) {
+
+	// Preliminary calculations/processes
+	int64_t length_before_zero_padding = impulse_from_file->numFrames;
+	zeroPadToNextPowerOfTwo(impulse_from_file);
+	int num_impulse_blocks = (int) (impulse_from_file->numFrames / FFT_SIZE);
+
+	audioData *synth_impulse = createAudioData(impulse_from_file->numChannels,
+			impulse_from_file->numFrames, g_sample_rate);
+
+	int c;
+	int numChannels = impulse_from_file->numChannels;
+
+	normalizeImpulse(impulse_from_file);
+
+	// Every temporary of the synthesis comes from here
+	Arena *arena = createArena(SYNTHESIS_ARENA_CHUNK_SIZE);
+
+	uint64_t modelKey = getModelKey(sourceHash);
+	size_t nameLength = strlen(impulse_from_file->fileName) + 7;
+	char *modelFileName = (char *) malloc(nameLength);
+	snprintf(modelFileName, nameLength, "%s.model",
+			impulse_from_file->fileName);
+
+	SpectralModel *model = readSpectralModel(modelFileName, modelKey);
+	if (model && (model->numChannels != impulse_from_file->numChannels
+			|| model->numBins != HALF_FFT_SIZE
+			|| model->numFrames != impulse_from_file->numFrames
+			|| model->envelopeSpacing != SMOOTHING_AMT)) {
+		free_SpectralModel(model);
+		model = NULL;
+	}
+	if (model == NULL) {
+		model = analyzeImpulse(impulse_from_file, length_before_zero_padding,
+				arena);
+		if (!writeSpectralModel(modelFileName, modelKey, model)) {
+			printf("Could not save the spectral model to %s\n", modelFileName);
+		}
+	}
+	free(modelFileName);
+
+	AmplitudeEnvelope *amp_envelope = createAmplitudeEnvelope(model->envelope,
+			model->envelopeLength, impulse_from_file->numFrames,
+			model->envelopeSpacing, arena);
+
+	graphState[0] = 0.0f;
+
+	for (c = 0; c < numChannels; c++) {
 
-		g_amp_envelope = getAmplitudeEnvelope(impulse_from_file, LEFT);
+		// Evaluate the exponential fit of every frequency bin over time
+		Spectrogram *impulse_filter_env_blocks_exp_fit = getExponentialFitFromModel(
+				model->A[c], model->b[c], num_impulse_blocks, &graphState[0],
+				arena);
+
+		// Use exponential fit data to draw impulse frequency response
+		setGraphValues(impulse_filter_env_blocks_exp_fit, graphState[0],
+				graphState + 1 + c * HALF_FFT_SIZE,
+				graphState + 1 + (numChannels + c) * HALF_FFT_SIZE);
 
 		// Filter white noise with exponential fit FFT data
 		float *synthesized_impulse_buffer = getFilteredWhiteNoise(
-				impulse_from_file, impulse_filter_env_blocks_exp_fit);
+				impulse_from_file, impulse_filter_env_blocks_exp_fit, sourceHash,
+				c, arena);
 
 		// Apply the amplitude envelope
 		applyAmplitudeEnvelope(impulse_from_file, synthesized_impulse_buffer,
-				g_amp_envelope);
+				amp_envelope);
 
 		// crossfade between recorded impulse attack and synthesized tail
 		crossfadeRecordedAndSynthesizedImpulses(synthesized_impulse_buffer,
-				impulse_from_file, LEFT);
-
-		//		// Write to a wav file
-		//		writeWavFile(synthesized_impulse_buffer, impulse_from_file->sampleRate,
-		//				impulse_from_file->numChannels, impulse_from_file->numFrames, 1,
-		//				"11_6_2015_test.wav");
+				impulse_from_file, c, arena);
 
 		// Put synthesized impulse in audioData struct
-		synth_impulse->buffer1 = synthesized_impulse_buffer;
-		synth_impulse->numChannels = impulse_from_file->numChannels;
-		synth_impulse->numFrames = impulse_from_file->numFrames;
-		synth_impulse->sampleRate = SAMPLE_RATE;
+		free(synth_impulse->channels[c]);
+		synth_impulse->channels[c] = synthesized_impulse_buffer;
 	}
-	/*
-	 * If the impulse is STEREO
-	 */
-	else if (impulse_from_file->numChannels == STEREO) {
-		float max = 0.0f;
-		for (i = 0; i < impulse_from_file->numFrames; i++) {
-			if (fabsf(impulse_from_file->buffer1[i]) > max) {
-				max = fabsf(impulse_from_file->buffer1[i]);
-			}
-			if (fabsf(impulse_from_file->buffer2[i]) > max) {
-				max = fabsf(impulse_from_file->buffer2[i]);
-			}
+
+	free_Arena(arena);
+	free_SpectralModel(model);
+	free_audioData(impulse_from_file);
+
+	return synth_impulse;
+}
+
+/*
+ * This function identifies a prepared impulse: a hash of the source impulse
+ * and of every setting that changes what is synthesized from it.
+ */
+uint64_t getImpulseKey(uint64_t sourceHash) {
+	int settings[] = { SPECTRA_FILE_VERSION, g_sample_rate, g_block_length,
+			FFT_SIZE, SMOOTHING_AMT, crossover_length, crossover_point,
+			use_attack_from_impulse };
+	float graph_height = g_height_top - g_height_bottom;
+	uint64_t key = hashBytes(sourceHash, settings, sizeof(settings));
+	return hashBytes(key, &graph_height, sizeof(graph_height));
+}
+
+/*
+ * This function writes the name of the prepared impulse file for a key into
+ * name (creating the directory that holds them if needed).
+ */
+void getSpectraFileName(uint64_t key, char *name, size_t size) {
+	mkdir(SPECTRA_CACHE_DIR, 0755);
+	snprintf(name, size, "%s/%016llx.spectra", SPECTRA_CACHE_DIR,
+			(unsigned long long) key);
+}
+
+/*
+ * The graph is saved with a prepared impulse as g_max followed by every
+ * channel's top values and then every channel's bottom values.
+ */
+int getGraphStateLength(int numChannels) {
+	return 1 + 2 * numChannels * HALF_FFT_SIZE;
+}
+
+void restoreGraphState(const float *state, int numChannels) {
+	allocateGraphValues(numChannels);
+	g_max = state[0];
+	memcpy(top_vals, state + 1, sizeof(float) * numChannels * HALF_FFT_SIZE);
+	memcpy(bottom_vals, state + 1 + numChannels * HALF_FFT_SIZE,
+			sizeof(float) * numChannels * HALF_FFT_SIZE);
+}
+
+/*
+ * This function keeps the graph as it is now as the one the engine's spectra
+ * were synthesized from. Live edits are measured from it, however the graph
+ * has been drawn on since.
+ */
+void saveSpectraGraph() {
+	size_t size = sizeof(float) * g_num_graph_channels * HALF_FFT_SIZE;
+	g_spectra_graph = (float *) realloc(g_spectra_graph, size);
+	memcpy(g_spectra_graph, top_vals, size);
+}
+
+/*
+ * This function prepares an impulse from a given filename for the engine. If
+ * an earlier run saved this impulse prepared with the same settings, its
+ * partition spectra are mapped straight from that file; otherwise the impulse
+ * is synthesized, partitioned and transformed, and then saved for next time.
+ *
+ * It only reads the engine's settings, so the impulse library calls it from
+ * its own thread.
+ */
+PreparedImpulse *prepareImpulse(const char *name) {
+	audioData *impulse_from_file = fileToBufferAtRate((char *) name,
+			g_sample_rate);
+	uint64_t sourceHash = hashAudioData(0, impulse_from_file);
+	uint64_t key = getImpulseKey(sourceHash);
+	char spectraFileName[256];
+	getSpectraFileName(key, spectraFileName, sizeof(spectraFileName));
+
+	PreparedImpulse *prepared = (PreparedImpulse *) calloc(1,
+			sizeof(PreparedImpulse));
+	prepared->noiseSeed = sourceHash;
+
+	PartitionSpectra *spectra = openSpectraFile(spectraFileName, key);
+	if (spectra && spectra->stateLength
+			== getGraphStateLength(spectra->impulse->numChannels)) {
+		free_audioData(impulse_from_file);
+		prepared->impulse = spectra->impulse;
+		prepared->fftData = spectra->fftData;
+		prepared->graphStateLength = spectra->stateLength;
+		prepared->graphState = (float *) malloc(
+				sizeof(float) * spectra->stateLength);
+		memcpy(prepared->graphState, spectra->state,
+				sizeof(float) * spectra->stateLength);
+		prepared->bytes = spectra->fftData->mappingLength;
+		free(spectra);
+	} else {
+		if (spectra) {
+			free_audioData(spectra->impulse);
+			free_FFTData(spectra->fftData);
+			free(spectra);
 		}
+		prepared->graphStateLength = getGraphStateLength(
+				impulse_from_file->numChannels);
+		prepared->graphState = (float *) malloc(
+				sizeof(float) * prepared->graphStateLength);
+		prepared->impulse = synthesizeImpulse(impulse_from_file, sourceHash,
+				prepared->graphState);
+		Vector blockLengthVector = determineBlockLengths(prepared->impulse,
+				g_block_length);
+		prepared->fftData = computePartitionSpectra(prepared->impulse,
+				blockLengthVector);
+
+		for (int i = 0; i < blockLengthVector.size; i++) {
+			prepared->bytes += sizeof(complex) * prepared->impulse->numChannels
+					* vector_get(&blockLengthVector, i);
+		}
+
+		writeSpectraFile(spectraFileName, key, prepared->impulse,
+				prepared->fftData, blockLengthVector, prepared->graphState,
+				prepared->graphStateLength);
+		vector_free(&blockLengthVector);
+	}
 
-		for (i = 0; i < impulse_from_file->numFrames; i++) {
-			impulse_from_file->buffer1[i] /= max;
-			impulse_from_file->buffer2[i] /= max;
+	prepared->bytes += sizeof(float) * prepared->impulse->numChannels
+			* prepared->impulse->numFrames;
+	return prepared;
+}
+
+/*
+ * This function makes a prepared impulse the one the engine convolves with.
+ */
+void useImpulse(PreparedImpulse *prepared) {
+	g_impulse = prepared->impulse;
+	g_impulse_spectra = prepared->fftData;
+	g_fftData_ptr = prepared->fftData;
+	g_impulse_length = g_impulse->numFrames;
+	g_impulse_edited = false;
+	g_noise_seed = prepared->noiseSeed;
+}
+
+/*
+ * This function shows a prepared impulse's graph and length.
+ */
+void showImpulse(PreparedImpulse *prepared) {
+	restoreGraphState(prepared->graphState, prepared->impulse->numChannels);
+	g_impulse_num_frames = prepared->impulse->numFrames;
+	invalidateSynthesisCache();
+	saveSpectraGraph();
+}
+
+/*
+ * This function loads an impulse from a given filename. Impulses in the
+ * library directory are prepared (or found prepared) by the library.
+ */
+void loadImpulse(char *name) {
+	PreparedImpulse *prepared;
+
+	g_library_index = g_library ? findLibraryImpulse(g_library, name) : -1;
+	if (g_library_index >= 0) {
+		prepared = acquireLibraryImpulse(g_library, g_library_index, true);
+	} else {
+		prepared = prepareImpulse(name);
+	}
+	if (prepared == NULL) {
+		printf("Error: could not prepare impulse: %s\n", name);
+		exit(1);
+	}
+
+	useImpulse(prepared);
+	showImpulse(prepared);
+}
+
+/*
+ * This function switches to another impulse of the library. If it is
+ * prepared the graph changes now and the engine changes at its next block;
+ * otherwise it is prepared in the background and switched to by
+ * checkLibraryImpulse() once it is ready.
+ */
+void switchToLibraryImpulse(int index) {
+	g_library_requested = index;
+	printf("Switching to %s\n", g_library->impulses[index].name);
+	checkLibraryImpulse();
+}
+
+/*
+ * This function keeps an impulse the engine is switching away from until no
+ * partition convolves with its spectra.
+ */
+void retireImpulse(FFTData *fftData, audioData *impulse, int libraryIndex) {
+	RetiredImpulse *retired = (RetiredImpulse *) malloc(
+			sizeof(RetiredImpulse));
+	retired->fftData = fftData;
+	retired->impulse = impulse;
+	retired->libraryIndex = libraryIndex;
+	retired->callbackCount = __atomic_load_n(&g_callback_count,
+			__ATOMIC_SEQ_CST);
+	retired->next = g_retired_impulses;
+	g_retired_impulses = retired;
+}
+
+/*
+ * This function lets go of the retired impulses whose spectra have no users
+ * left. Only call it when the engine has installed every switch made.
+ */
+void releaseRetiredImpulses() {
+	RetiredImpulse **link = &g_retired_impulses;
+	while (*link) {
+		RetiredImpulse *retired = *link;
+		if (isFFTDataInUse(retired->fftData) || __atomic_load_n(
+				&g_callback_count, __ATOMIC_SEQ_CST) == retired->callbackCount) {
+			link = &retired->next;
+			continue;
 		}
+		if (retired->libraryIndex >= 0) {
+			releaseLibraryImpulse(g_library, retired->libraryIndex);
+		} else {
+			free_FFTData(retired->fftData);
+			free_audioData(retired->impulse);
+		}
+		*link = retired->next;
+		free(retired);
+	}
+}
 
-		// Get the impulse FFT spectrogram
-		float **impulse_filter_env_blocks_left = getImpulseFFTBlocks(
-				impulse_from_file, LEFT);
-		float **impulse_filter_env_blocks_right = getImpulseFFTBlocks(
-				impulse_from_file, RIGHT);
+/*
+ * This function completes a pending switch to a library impulse once it is
+ * prepared, making the engine's buffers for it here rather than in the audio
+ * callback. The impulse the engine used before is retired: it stays valid
+ * until no partition convolves with it.
+ */
+void checkLibraryImpulse() {
+	if (__atomic_load_n(&g_pending_impulse, __ATOMIC_ACQUIRE)) {
+		return;
+	}
 
-		/*
-		 * For each impulse_filter_env block, create exponential fit (to smooth out filter decay)
-		 */
-		float **impulse_filter_env_blocks_exp_fit_left =
-				getExponentialFitForImpulseFFTBlocks(num_impulse_blocks,
-						length_before_zero_padding, impulse_filter_env_blocks_left);
-		float **impulse_filter_env_blocks_exp_fit_right =
-				getExponentialFitForImpulseFFTBlocks(num_impulse_blocks,
-						length_before_zero_padding, impulse_filter_env_blocks_right);
+	finishImpulseSwitch();
 
-		// Use exponential fit data to draw impulse frequency response
-		setTopValsBasedOnImpulseFFTBlocks(impulse_filter_env_blocks_exp_fit_left, LEFT);
-		setTopValsBasedOnImpulseFFTBlocks(impulse_filter_env_blocks_exp_fit_right, RIGHT);
+	int index = g_library_requested;
+	if (index < 0) {
+		return;
+	}
 
-		g_amp_envelope = getAmplitudeEnvelope(impulse_from_file, LEFT);
+	PreparedImpulse *prepared = acquireLibraryImpulse(g_library, index, false);
+	if (prepared == NULL) {
+		if (g_library->impulses[index].state == LIBRARY_IMPULSE_FAILED) {
+			printf("Could not prepare %s\n", g_library->impulses[index].name);
+			g_library_requested = -1;
+		}
+		return;
+	}
+	g_library_requested = -1;
 
-		// Filter white noise with exponential fit FFT data
-		float *synthesized_impulse_buffer_left = getFilteredWhiteNoise(
-				impulse_from_file, impulse_filter_env_blocks_exp_fit_left);
-		float *synthesized_impulse_buffer_right = getFilteredWhiteNoise(
-				impulse_from_file, impulse_filter_env_blocks_exp_fit_right);
+	// A resynthesis of the impulse switched away from is ours to free, and
+	// its refinement is out of date
+	if (g_impulse_edited) {
+		retireImpulse(g_impulse_spectra, g_impulse, -1);
+		if (g_refiner) {
+			postRefinement(g_refiner, NULL);
+		}
+	}
+	if (g_library_index >= 0) {
+		retireImpulse(g_library->impulses[g_library_index].prepared->fftData,
+				NULL, g_library_index);
+	}
+	g_library_index = index;
 
-		// Apply the amplitude envelope
-		applyAmplitudeEnvelope(impulse_from_file, synthesized_impulse_buffer_left,
-				g_amp_envelope);
-		applyAmplitudeEnvelope(impulse_from_file, synthesized_impulse_buffer_right,
-				g_amp_envelope);
+	showImpulse(prepared);
+	initializeImpulseLengthSlider();
+	ChannelSlider.max_val = g_num_graph_channels + 1;
+	if (g_current_channel_view >= g_num_graph_channels) {
+		g_current_channel_view = 0;
+		ChannelSlider.x_pos = ChannelSlider.x_min;
+		ChannelSlider.current_val = 1;
+	}
 
-		// crossfade between recorded impulse attack and synthesized tail
-		crossfadeRecordedAndSynthesizedImpulses(synthesized_impulse_buffer_left,
-				impulse_from_file, LEFT);
-		crossfadeRecordedAndSynthesizedImpulses(synthesized_impulse_buffer_right,
-				impulse_from_file, RIGHT);
+	publishImpulseSwitch(prepared, prepared->fftData,
+			prepared->impulse->numFrames, prepared->impulse->numChannels);
+}
+
+/*
+ * This function frees the last switch, with the buffers it replaced. Only
+ * call it when no switch is pending.
+ */
+void freeImpulseSwitch() {
+	if (g_impulse_switch) {
+		free_EngineBuffers(&g_impulse_switch->buffers);
+		free(g_impulse_switch);
+		g_impulse_switch = NULL;
+	}
+}
 
-		//		// Write to a wav file
-		//		writeWavFile(synthesized_impulse_buffer, impulse_from_file->sampleRate,
-		//				impulse_from_file->numChannels, impulse_from_file->numFrames, 1,
-		//				"11_6_2015_test.wav");
+/*
+ * This function frees the last switch and lets go of the retired impulses no
+ * longer in use. Only call it when no switch is pending.
+ */
+void finishImpulseSwitch() {
+	freeImpulseSwitch();
+	releaseRetiredImpulses();
+}
 
-		// Put synthesized impulse in audioData struct
-		synth_impulse->buffer1 = synthesized_impulse_buffer_left;
-		synth_impulse->buffer2 = synthesized_impulse_buffer_right;
-		synth_impulse->numChannels = impulse_from_file->numChannels;
-		synth_impulse->numFrames = impulse_from_file->numFrames;
-		synth_impulse->sampleRate = SAMPLE_RATE;
+/*
+ * This function hands the engine spectra for an impulse of numFrames frames
+ * and numChannels channels (with the prepared impulse they belong to, when
+ * switching to one). Their buffers are made here, off the audio thread; the
+ * audio callback installs them at its next block. Only call it when no
+ * switch is pending.
+ */
+void publishImpulseSwitch(PreparedImpulse *prepared, FFTData *fftData,
+		int numFrames, int numChannels) {
+	// Impulses retired for this switch are still the engine's until then
+	freeImpulseSwitch();
+	g_impulse_switch = (ImpulseSwitch *) malloc(sizeof(ImpulseSwitch));
+	g_impulse_switch->prepared = prepared;
+	g_impulse_switch->fftData = fftData;
+	initializeEngineBuffers(&g_impulse_switch->buffers, numFrames,
+			numChannels);
+	__atomic_store_n(&g_pending_impulse, g_impulse_switch, __ATOMIC_RELEASE);
+}
+
+/*
+ * This function installs the impulse switched to in the engine. It is called
+ * by the audio callback between blocks, so it allocates and frees nothing:
+ * the switch's buffers take the engine's place, and the engine's are left in
+ * the switch for finishImpulseSwitch() to free. Partitions of the previous
+ * impulse still being convolved see the generation change and drop their
+ * results.
+ */
+void installPendingImpulse() {
+	ImpulseSwitch *pending = __atomic_load_n(&g_pending_impulse,
+			__ATOMIC_ACQUIRE);
+	if (pending == NULL) {
+		return;
 	}
 
-	return synth_impulse;
+	pthread_mutex_lock(&mutex);
+	if (pending->prepared) {
+		useImpulse(pending->prepared);
+	} else {
+		__atomic_store_n(&g_fftData_ptr, pending->fftData, __ATOMIC_SEQ_CST);
+	}
+	swapEngineBuffers(&pending->buffers);
+	g_counter = 0;
+	g_impulse_generation++;
+	pthread_mutex_unlock(&mutex);
+
+	// Only now is the switch (and what it holds) the GUI thread's again
+	__atomic_store_n(&g_pending_impulse, NULL, __ATOMIC_RELEASE);
 }
 
 /*
- * This function loads an impulse from a given filename
+ * This function retires the spectral editor: its spectra may still be in use,
+ * so it is freed when the next one is retired.
  */
-void loadImpulse(char *name) {
-	g_impulse = synthesizeImpulse(name);
-	//	impulse = fileToBuffer("churchIR.wav");
-//	g_impulse = zeroPadToNextPowerOfTwo(g_impulse);
-	g_impulse_length = g_impulse->numFrames;
-	g_impulse_num_frames = g_impulse->numFrames;
-	Vector blockLengthVector = determineBlockLengths(g_impulse);
-	BlockData* data_ptr = allocateBlockBuffers(blockLengthVector, g_impulse);
-	partitionImpulseIntoBlocks(blockLengthVector, data_ptr, g_impulse);
-	g_fftData_ptr = allocateFFTBuffers(data_ptr, blockLengthVector, g_impulse);
-	for (int i=0; i<blockLengthVector.size; i++) {
-		free(data_ptr->audioBlocks1[i]);
-		free(data_ptr->audioBlocks2[i]);
-	}
-	free(data_ptr->audioBlocks1);
-	free(data_ptr->audioBlocks2);
-	free(data_ptr);
-	vector_free(&blockLengthVector);
+void retireSpectralEditor() {
+	free_SpectralEditor(g_previous_spectral_editor);
+	if (g_spectral_editor) {
+		stopSpectralEditor(g_spectral_editor);
+	}
+	g_previous_spectral_editor = g_spectral_editor;
+	g_spectral_editor = NULL;
+}
+
+/*
+ * This function keeps live editing up to date: it starts an editor on the
+ * engine's spectra when live editing is turned on (or the impulse changes
+ * under it), and posts the graph to it.
+ */
+void updateLiveEditing() {
+	// The engine's spectra were replaced (by a resynthesis or another impulse)
+	if (g_spectral_editor && !ownsSpectra(g_spectral_editor, g_fftData_ptr)) {
+		retireSpectralEditor();
+	}
+
+	// Wait for a switch to another impulse to reach the engine: the graph
+	// already shows the new impulse
+	if (!g_live_editing || g_changingImpulse || g_fftData_ptr == NULL
+			|| __atomic_load_n(&g_pending_impulse, __ATOMIC_ACQUIRE)
+			|| g_fftData_ptr->numChannels != g_num_graph_channels) {
+		return;
+	}
+
+	if (g_spectral_editor == NULL) {
+		FFTData *base = g_fftData_ptr;
+		Vector blockLengthVector = determineBlockLengths(g_impulse,
+				g_block_length);
+		g_spectral_editor = openSpectralEditor(base, &g_fftData_ptr,
+				blockLengthVector, g_spectra_graph, HALF_FFT_SIZE, FFT_SIZE,
+				g_height_top - g_height_bottom,
+				(float) (getGraphDecayBlocks() - 1));
+		vector_free(&blockLengthVector);
+		if (g_spectral_editor == NULL) {
+			return;
+		}
+		// Unless the audio callback installed another impulse meanwhile
+		if (!__atomic_compare_exchange_n(&g_fftData_ptr, &base,
+				g_spectral_editor->spectra[g_spectral_editor->published], false,
+				__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+			free_SpectralEditor(g_spectral_editor);
+			g_spectral_editor = NULL;
+			return;
+		}
+	}
+
+	postSpectralEdit(g_spectral_editor, &top_vals[0][0]);
 }
 
 /*
  * This function is responsible for generating the block lengths used in the
  * partitioning scheme for real-time convolution.
  */
-void initializePowerOf2Vector() {
-	vector_init(&g_powerOf2Vector);
+void initializePowerOf2Vector(Vector *vector, int max_factor) {
+	vector_init(vector);
 	int counter = 0;
-	while (pow(2, counter) <= g_max_factor) {
-		vector_append(&g_powerOf2Vector, pow(2, counter++));
+	while (pow(2, counter) <= max_factor) {
+		vector_append(vector, pow(2, counter++));
 	}
 	//	for (int i=0; i<g_powerOf2Vector.size; i++) {
 	//		printf("the powerOf2Vector[%d]: %d\n", i, vector_get(&g_powerOf2Vector, i));
@@ -3611,25 +4165,54 @@ void initializePowerOf2Vector() {
  * This function reloads an impulse after changes have been made
  */
 void reloadImpulse() {
-	//	free_audioData(g_impulse);
-	g_impulse = resynthesizeImpulse(g_impulse, g_impulse_num_frames);
-	g_impulse = zeroPadToNextPowerOfTwo(g_impulse);
-	g_impulse_length = g_impulse->numFrames;
-	Vector blockLengthVector = determineBlockLengths(g_impulse);
-	BlockData* data_ptr = allocateBlockBuffers(blockLengthVector, g_impulse);
-	partitionImpulseIntoBlocks(blockLengthVector, data_ptr, g_impulse);
+	// A switch the engine hasn't taken up yet wins: the graph may already
+	// show another impulse
+	if (__atomic_load_n(&g_pending_impulse, __ATOMIC_ACQUIRE)) {
+		return;
+	}
+	audioData *previousImpulse = g_impulse;
+	FFTData *previousSpectra = g_impulse_spectra;
+
+	// Noise past the preview is made in the background (without a refiner,
+	// the preview is the whole impulse)
+	int64_t previewFrames = g_refiner ?
+			(int64_t) PREVIEW_LENGTH_MS * g_sample_rate / 1000 :
+			g_impulse_num_frames;
+	audioData *impulse = resynthesizeImpulse(previousImpulse,
+			g_impulse_num_frames, previewFrames);
+	impulse = zeroPadToNextPowerOfTwo(impulse);
+	Vector blockLengthVector = determineBlockLengths(impulse, g_block_length);
 	//	free(g_fftData_ptr);
-	g_fftData_ptr = allocateFFTBuffers(data_ptr, blockLengthVector, g_impulse);
-	for (int i=0; i<blockLengthVector.size; i++) {
-		free(data_ptr->audioBlocks1[i]);
-		free(data_ptr->audioBlocks2[i]);
-	}
-	free(data_ptr->audioBlocks1);
-	free(data_ptr->audioBlocks2);
-	free(data_ptr);
+	// Partitions whose samples didn't change keep their spectra, even when
+	// the length did
+	g_impulse_spectra = updatePartitionSpectra(impulse, blockLengthVector,
+			previousImpulse, previousSpectra);
 	vector_free(&blockLengthVector);
-	initializeGlobalParameters();
-	initializePowerOf2Vector();
+
+	// Anything refined for the previous impulse is out of date
+	ImpulseRefinement *refinement = NULL;
+	if (g_refiner && !isSynthesisComplete(g_impulse_num_frames)) {
+		refinement = createImpulseRefinement(previousImpulse, impulse,
+				g_impulse_spectra, g_impulse_num_frames);
+	}
+	if (g_refiner) {
+		postRefinement(g_refiner, refinement);
+	}
+
+	g_impulse = impulse;
+	g_impulse_length = g_impulse->numFrames;
+	// The library's impulse isn't ours to free. A resynthesized one is
+	// freed with its spectra once no partition convolves with them.
+	if (g_impulse_edited) {
+		retireImpulse(previousSpectra, previousImpulse, -1);
+	}
+	g_impulse_edited = true;
+	// The resynthesized channels' graph values were refitted
+	saveSpectraGraph();
+	// The engine takes up the spectra, with buffers fitted to the new length,
+	// at its next block
+	publishImpulseSwitch(NULL, g_impulse_spectra, g_impulse->numFrames,
+			g_impulse->numChannels);
 }
 
 void setWindowRange() {
@@ -3665,20 +4248,20 @@ void initializeImpulseLengthSlider() {
 	int impulse_length_min = 235;
 	int impulse_length_max = 325;
 	int range = impulse_length_max - impulse_length_min;
-	int impulse_num_frames_min = 4410;
-	int impulse_num_frames_max = 44100 * 20;
+	int impulse_num_frames_min = g_sample_rate / 10;
+	int impulse_num_frames_max = g_sample_rate * 20;
 	int impulse_num_frames_range = impulse_num_frames_max
 			- impulse_num_frames_min;
-	float offset = (float) (g_impulse->numFrames - impulse_num_frames_min)
+	float offset = (float) (g_impulse_num_frames - impulse_num_frames_min)
 					/ (float) impulse_num_frames_range;
 	int sliderInitPos = offset * ((float) range) + impulse_length_min;
 	ImpulseLengthSlider.x_min = 235;
 	ImpulseLengthSlider.x_max = 325;
 	ImpulseLengthSlider.x_pos = sliderInitPos;
 	ImpulseLengthSlider.y = 65;
-	ImpulseLengthSlider.min_val = 44100;
-	ImpulseLengthSlider.max_val = 44100 * 20;
-	ImpulseLengthSlider.current_val = g_impulse->numFrames;
+	ImpulseLengthSlider.min_val = g_sample_rate;
+	ImpulseLengthSlider.max_val = g_sample_rate * 20;
+	ImpulseLengthSlider.current_val = g_impulse_num_frames;
 	ImpulseLengthSlider.label = "Length";
 	ImpulseLengthSlider.state = 0;
 	ImpulseLengthSlider.callbackFunction = ImpulseLengthSliderCallback;
@@ -3715,16 +4298,9 @@ GraphData *getValuesFromGraph(int current_channel) {
 	graphData->x_indices = (int *) malloc(sizeof(int) * length);
 	graphData->y_values = (float *) malloc(sizeof(float) * length);
 
-	if (current_channel == LEFT) {
-		for (int i=0; i<length; i++) {
-			graphData->x_indices[i] = x_values[graphData->first_index + i];
-			graphData->y_values[i] = top_vals_left[graphData->first_index + i];
-		}
-	} else if (current_channel == RIGHT) {
-		for (int i=0; i<length; i++) {
-			graphData->x_indices[i] = x_values[graphData->first_index + i];
-			graphData->y_values[i] = top_vals_right[graphData->first_index + i];
-		}
+	for (int i=0; i<length; i++) {
+		graphData->x_indices[i] = x_values[graphData->first_index + i];
+		graphData->y_values[i] = top_vals[current_channel][graphData->first_index + i];
 	}
 
 	return graphData;
@@ -3737,6 +4313,8 @@ int main(int argc, char **argv) {
 
 	srand(time(NULL));
 
+	setEngineSampleRate(ENGINE_SAMPLE_RATE);
+
 	for (int i=0; i<HALF_FFT_SIZE; i++) {
 		for (int j=0; j<16; j++) {
 			last_input_spectrum[j][i] = 0.0f;
@@ -3763,7 +4341,18 @@ int main(int argc, char **argv) {
 
 	setWindowRange();
 
+	g_library = openImpulseLibrary(IMPULSE_DIRECTORY,
+			(size_t) IMPULSE_CACHE_BUDGET_MB << 20, prepareImpulse);
+	if (g_library == NULL) {
+		printf("Could not read the impulse library in %s\n", IMPULSE_DIRECTORY);
+	}
+
+	// Without it, every resynthesis is made in full before it is heard
+	g_refiner = openRefiner(refineImpulse, free_ImpulseRefinement,
+			REFINEMENT_DELAY_MS);
+
 	loadImpulse(IMPULSE_FILE_NAME);
+	g_num_stream_channels = g_impulse->numChannels;
 
 	audio_file_name = AUDIO_FILE_NAME;
 
@@ -3774,8 +4363,8 @@ int main(int argc, char **argv) {
 	ChannelSlider.x_pos = 355;
 	ChannelSlider.y = 65;
 	ChannelSlider.min_val = 1;
-	ChannelSlider.max_val = 3;
-	ChannelSlider.current_val = LEFT;
+	ChannelSlider.max_val = g_impulse->numChannels + 1;
+	ChannelSlider.current_val = 1;
 	ChannelSlider.label = "Channel";
 	ChannelSlider.state = 0;
 	ChannelSlider.callbackFunction = ChannelSliderCallback;
@@ -3784,8 +4373,6 @@ int main(int argc, char **argv) {
 
 	initializeGlobalParameters();
 
-	initializePowerOf2Vector();
-
 	runPortAudio();
 
 	return 0;
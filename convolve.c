@@ -159,17 +159,13 @@ int convolve(float *x, float *h, int lenX, int lenH, float **output)
         exit(1);
     }
 
-    /* Get max absolute value in X */
+    /* Copy over real values, keeping the max absolute value in X */
     for (i = 0; i < lenX; i++) {
+        xComp[i].Re = x[i];
         if (fabsf(x[i]) > m) {
-            m = x[i];
+            m = fabsf(x[i]);
         }
     }
-
-    /* Copy over real values */
-    for (i = 0; i < lenX; i++) {
-        xComp[i].Re = x[i];
-    }
     for (i = 0; i < lenH; i++) {
         hComp[i].Re = h[i];
     }
@@ -14,11 +14,76 @@
 #include <math.h>
 #include <dirent.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
 #include "dawsonaudio.h"
 #include "convolve.h"
+#include "render.h"
+#include "mappedaudio.h"
+#include "sampleformat.h"
+#include "resample.h"
+
+float *allocateChannelBuffer(int64_t numFrames) {
+	void *buffer = NULL;
+	size_t size = sizeof(float) * (size_t) (numFrames > 0 ? numFrames : 1);
+	if (posix_memalign(&buffer, AUDIO_BUFFER_ALIGNMENT, size) != 0) {
+		printf("Error: unable to allocate memory for audio. Exiting.\n");
+		exit(1);
+	}
+	memset(buffer, 0, size);
+	return (float *) buffer;
+}
+
+float *resizeChannelBuffer(float *buffer, int64_t numFrames,
+		int64_t newNumFrames) {
+	if (newNumFrames == numFrames) {
+		return buffer;
+	}
+	float *resized = allocateChannelBuffer(newNumFrames);
+	memcpy(resized, buffer,
+			sizeof(float) * (size_t) (numFrames < newNumFrames ?
+					numFrames : newNumFrames));
+	free(buffer);
+	return resized;
+}
+
+audioData *createAudioData(int numChannels, int64_t numFrames, int sampleRate) {
+	int c;
+	audioData *audio = (audioData *) malloc(sizeof(audioData));
+	audio->numChannels = numChannels;
+	audio->numFrames = numFrames;
+	audio->sampleRate = sampleRate;
+	audio->fileName = NULL;
+	audio->channels = (float **) malloc(sizeof(float *) * numChannels);
+	for (c = 0; c < numChannels; c++) {
+		audio->channels[c] = allocateChannelBuffer(numFrames);
+	}
+	return audio;
+}
+
+audioData *copyAudioData(const audioData *audio) {
+	int c;
+	audioData *copy = createAudioData(audio->numChannels, audio->numFrames,
+			audio->sampleRate);
+	for (c = 0; c < audio->numChannels; c++) {
+		memcpy(copy->channels[c], audio->channels[c],
+				sizeof(float) * audio->numFrames);
+	}
+	if (audio->fileName) {
+		copy->fileName = malloc(strlen(audio->fileName) + 1);
+		strcpy(copy->fileName, audio->fileName);
+	}
+	return copy;
+}
 
 void free_audioData(audioData *audio) {
+	int c;
 	if (audio) {
+		for (c = 0; c < audio->numChannels; c++) {
+			free(audio->channels[c]);
+		}
+		free(audio->channels);
+		free(audio->fileName);
 		free(audio);
 	}
 }
@@ -26,34 +91,64 @@ void free_audioData(audioData *audio) {
 // This function takes a buffer, finds its maximum absolute value, and normalizes it so that the maximum
 // is 1 (or -1)
 float *normalizeBuffer(float *buffer, int length) {
-	float max = 0;
-	int i;
-	// Find maximum
-	for (i = 0; i < length; i++) {
-		if (fabs(buffer[i]) > max) {
-			max = fabs(buffer[i]);
-		}
+	// Find maximum, then scale by its reciprocal (a silent buffer is left alone)
+	GainStage *stage = createGainStage(GAIN_TWO_PASS, 1.0f, MONO, 0);
+	gainStageTrack(stage, buffer, length);
+	gainStageProcess(stage, buffer, buffer, length);
+	free_GainStage(stage);
+	return buffer;
+}
+
+// Frames converted per block when reading a file into planar buffers
+#define READ_BLOCK_FRAMES		4096
+
+// Splits a block of interleaved frames into the channel buffers at first
+static void deinterleaveIntoChannels(audioData *audio, const float *block,
+		int64_t first, long count) {
+
+	int c;
+	float *targets[audio->numChannels];
+
+	for (c = 0; c < audio->numChannels; c++) {
+		targets[c] = audio->channels[c] + first;
 	}
-	// Normalize
-	for (i = 0; i < length; i++) {
-		buffer[i] /= max;
+	deinterleave(block, targets, audio->numChannels, count);
+}
+
+// Converts a mapped file into planar buffers, block by block across channels so
+// each page is touched once
+static audioData *readMappedFile(MappedAudioFile *mapped) {
+
+	int64_t first;
+
+	audioData *audio = createAudioData(mapped->numChannels, mapped->numFrames,
+			mapped->sampleRate);
+
+	// Mono converts straight into its buffer
+	if (audio->numChannels == MONO) {
+		readInterleavedBlock(mapped, 0, audio->numFrames, audio->channels[0]);
+		return audio;
 	}
-	return buffer;
+
+	float *block = (float *) malloc(
+			sizeof(float) * READ_BLOCK_FRAMES * mapped->numChannels);
+	for (first = 0; first < audio->numFrames; first += READ_BLOCK_FRAMES) {
+		long count = readInterleavedBlock(mapped, first, READ_BLOCK_FRAMES,
+				block);
+		deinterleaveIntoChannels(audio, block, first, count);
+	}
+	free(block);
+	return audio;
 }
 
-//-----------------------------------------------------------------------------
-// name: fileToBuffer()
-// desc: This function opens a .wav file and places it in an appropriately sized
-// buffer. It returns a pointer to an audioData struct containing information
-// about the file.
-//-----------------------------------------------------------------------------
-audioData *fileToBuffer(char *fileName) {
+// Decodes a file with libsndfile into planar buffers, one block of interleaved
+// audio at a time
+static audioData *readSndFile(char *fileName) {
 
 	SNDFILE *file;
 	SF_INFO fileInfo;
+	int64_t first;
 
-	audioData *newAudioFile;
-	newAudioFile = (audioData *) malloc(sizeof(audioData));
 	memset(&fileInfo, 0, sizeof(SF_INFO));
 	file = sf_open(fileName, SFM_READ, &fileInfo);
 
@@ -64,200 +159,312 @@ audioData *fileToBuffer(char *fileName) {
 		exit(1);
 	}
 
-	int length = fileInfo.frames * fileInfo.channels;
+	audioData *audio = createAudioData(fileInfo.channels, fileInfo.frames,
+			fileInfo.samplerate);
 
-	newAudioFile->numChannels = fileInfo.channels;
-	newAudioFile->numFrames = (int) fileInfo.frames;
-	newAudioFile->sampleRate = fileInfo.samplerate;
-	newAudioFile->buffer1 = (float *) malloc(sizeof(float) * length);
-	newAudioFile->buffer2 = (float *) malloc(sizeof(float) * length);
-	newAudioFile->fileName = malloc(sizeof(char *) * strlen(fileName));
-	strcpy(newAudioFile->fileName, fileName);
+	float *block = (float *) malloc(
+			sizeof(float) * READ_BLOCK_FRAMES * fileInfo.channels);
+	for (first = 0; first < audio->numFrames; first += READ_BLOCK_FRAMES) {
+		long count = sf_readf_float(file, block, READ_BLOCK_FRAMES);
+		if (count <= 0) {
+			break;
+		}
+		deinterleaveIntoChannels(audio, block, first, count);
+	}
+
+	free(block);
+	sf_close(file);
+	return audio;
+}
 
-	// If the file is a mono file
-	if (fileInfo.channels == MONO) {
+//-----------------------------------------------------------------------------
+// name: fileToBuffer()
+// desc: This function opens a .wav file and places it in an appropriately sized
+// buffer. It returns a pointer to an audioData struct containing information
+// about the file.
+//
+// Uncompressed WAV/AIFF files are memory-mapped and converted straight into the
+// channel buffers; anything else is decoded by libsndfile. Every channel of the
+// file is kept.
+//-----------------------------------------------------------------------------
+audioData *fileToBuffer(char *fileName) {
 
-		// Copy the mono audio into buffer 1
-		sf_readf_float(file, newAudioFile->buffer1, length);
+	audioData *newAudioFile;
 
+	MappedAudioFile *mapped = openMappedAudioFile(fileName);
+	if (mapped) {
+		newAudioFile = readMappedFile(mapped);
+		closeMappedAudioFile(mapped);
+	} else {
+		newAudioFile = readSndFile(fileName);
 	}
 
-	// If the file is a stereo file
-	if (fileInfo.channels == STEREO) {
+	newAudioFile->fileName = malloc(strlen(fileName) + 1);
+	strcpy(newAudioFile->fileName, fileName);
 
-		// Create temporary buffer to store interleaved stereo audio
-		float *stereoAudio = (float *) malloc(sizeof(float) * length);
+//	printf("File name: %s\n", newAudioFile->fileName);
+//	printf("	Channels: %d\n", newAudioFile->numChannels);
+//	printf("	Frames: %lld\n", (long long) newAudioFile->numFrames);
+//	printf("	Sample rate: %d\n", newAudioFile->sampleRate);
+//	printf("	Length: %f seconds\n", (float)newAudioFile->numFrames/newAudioFile->sampleRate);
 
-		// Read file into temp buffer
-		sf_readf_float(file, stereoAudio, length);
+	return newAudioFile;
+}
 
-		int i;
-		for (i = 0; i < length / 2; i++) {
+// Files converted by fileToBufferAtRate that are kept for the next load
+#define CONVERTED_FILE_CACHE_SIZE	8
 
-			// Copy left channel into buffer 1
-			newAudioFile->buffer1[i] = stereoAudio[2 * i];
+typedef struct ConvertedFile {
+	char *fileName;
+	time_t modified;
+	off_t size;
+	audioData *audio; // at audio->sampleRate
+} ConvertedFile;
 
-			// Copy right channel into buffer 2
-			newAudioFile->buffer2[i] = stereoAudio[2 * i + 1];
-		}
+static ConvertedFile g_converted_files[CONVERTED_FILE_CACHE_SIZE];
+static int g_next_converted_file = 0;
+static pthread_mutex_t g_converted_files_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-		free(stereoAudio);
+//-----------------------------------------------------------------------------
+// name: fileToBufferAtRate()
+// desc: As fileToBuffer, converted to sampleRate if the file is at another
+// rate. Converted files are cached (until the file changes on disk), so
+// switching back to a file doesn't resample it again.
+//-----------------------------------------------------------------------------
+audioData *fileToBufferAtRate(char *fileName, int sampleRate) {
 
+	struct stat info;
+	int i;
+
+	bool haveInfo = stat(fileName, &info) == 0;
+
+	if (haveInfo) {
+		pthread_mutex_lock(&g_converted_files_mutex);
+		for (i = 0; i < CONVERTED_FILE_CACHE_SIZE; i++) {
+			ConvertedFile *entry = &g_converted_files[i];
+			if (entry->audio && entry->audio->sampleRate == sampleRate
+					&& entry->modified == info.st_mtime
+					&& entry->size == info.st_size
+					&& strcmp(entry->fileName, fileName) == 0) {
+				audioData *copy = copyAudioData(entry->audio);
+				pthread_mutex_unlock(&g_converted_files_mutex);
+				return copy;
+			}
+		}
+		pthread_mutex_unlock(&g_converted_files_mutex);
 	}
 
-	sf_close(file);
+	audioData *audio = fileToBuffer(fileName);
+	if (audio->sampleRate == sampleRate) {
+		return audio;
+	}
 
-//	printf("File name: %s\n", newAudioFile->fileName);
-//	printf("	Channels: %d\n", newAudioFile->numChannels);
-//	printf("	Frames: %d\n", newAudioFile->numFrames);
-//	printf("	Sample rate: %d\n", newAudioFile->sampleRate);
-//	printf("	Length: %f seconds\n", (float)newAudioFile->numFrames/newAudioFile->sampleRate);
+	printf("Converting %s from %d Hz to %d Hz\n", fileName, audio->sampleRate,
+			sampleRate);
+	audioData *converted = resampleAudioData(audio, sampleRate);
+	free_audioData(audio);
+
+	if (haveInfo) {
+		pthread_mutex_lock(&g_converted_files_mutex);
+		ConvertedFile *entry = &g_converted_files[g_next_converted_file];
+		free(entry->fileName);
+		free_audioData(entry->audio);
+		entry->fileName = malloc(strlen(fileName) + 1);
+		strcpy(entry->fileName, fileName);
+		entry->modified = info.st_mtime;
+		entry->size = info.st_size;
+		entry->audio = copyAudioData(converted);
+		g_next_converted_file = (g_next_converted_file + 1)
+				% CONVERTED_FILE_CACHE_SIZE;
+		pthread_mutex_unlock(&g_converted_files_mutex);
+	}
 
-	return newAudioFile;
+	return converted;
 }
 
+// Frames mixed, gained and written per chunk of offline output
+#define OUTPUT_CHUNK_FRAMES		4096
+
 //-----------------------------------------------------------------------------
 // name: writeWavFile()
-// desc: This function takes an array of floats and writes the data to a .wav file.
+// desc: This function takes an array of floats and writes the data to a .wav file
+// in the given format, streaming it through a background writer.
+// Mono input is duplicated to every output channel, input is averaged for mono
+// output, and otherwise output channel c takes input channel c (wrapping).
 //-----------------------------------------------------------------------------
-void writeWavFile(float *audio, int sample_rate, int numChannels, int numFrames,
-		int numOutChannels, char *outFileName) {
-	int i;
+void writeWavFile(float *audio, int sample_rate, int numChannels,
+		int64_t numFrames, int numOutChannels, OutputFormat format,
+		char *outFileName) {
 
-	SNDFILE *outfile;
-	SF_INFO sfinfo_out;
+	int64_t first;
+	int c;
 
-	memset(&sfinfo_out, 0, sizeof(SF_INFO));
-	sfinfo_out.samplerate = sample_rate;
-	sfinfo_out.channels = numChannels;
-	sfinfo_out.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16;
-	if (!sf_format_check(&sfinfo_out)) {
-		printf("error: incorrect audio file format\n");
+	AudioWriter *writer = openAudioWriter(outFileName, sample_rate,
+			numOutChannels, format, OUTPUT_CHUNK_FRAMES);
+	if (writer == NULL) {
 		return;
 	}
 
-	if ((outfile = sf_open(outFileName, SFM_WRITE, &sfinfo_out)) == NULL) {
-		printf("error, couldn't open the file\n");
-		return;
+	if (numChannels == numOutChannels) {
+		// Already in the output layout
+		audioWriterWrite(writer, audio, numFrames);
+	} else {
+		for (first = 0; first < numFrames; first += OUTPUT_CHUNK_FRAMES) {
+			long count = numFrames - first < OUTPUT_CHUNK_FRAMES ?
+					numFrames - first : OUTPUT_CHUNK_FRAMES;
+			const float *in = audio + first * numChannels;
+			float *chunk = audioWriterGetChunk(writer);
+			if (numOutChannels == MONO) {
+				downmixToMono(in, chunk, numChannels, count);
+			} else if (numChannels == MONO) {
+				float *source[numOutChannels];
+				for (c = 0; c < numOutChannels; c++) {
+					source[c] = (float *) in;
+				}
+				interleave(source, chunk, numOutChannels, count);
+			} else {
+				long i;
+				for (i = 0; i < count; i++) {
+					for (c = 0; c < numOutChannels; c++) {
+						chunk[i * numOutChannels + c] = in[i * numChannels
+								+ c % numChannels];
+					}
+				}
+			}
+			audioWriterSubmit(writer, (int) count);
+		}
 	}
 
-	// get the number of samples in the input audio
-	int inputLength = numChannels * numFrames;
-
-	// mono input to mono output
-	if (numChannels == 1 && numOutChannels == 1) {
-		// allocate the appropriate number of samples in the output audio
-		float *output = (float *) malloc(sizeof(float) * inputLength);
-		for (i = 0; i < inputLength; i++) {
-			output[i] = audio[i];
-		}
-		sf_writef_float(outfile, output, inputLength);
-		free(output);
-	}
-	// sTEREO INPUT to MONO OUTPUT
-	else if (numChannels == 2 && numOutChannels == 1) {
-		// Allocate the appropriate number of samples in the output audio
-		float *output = (float *) malloc(sizeof(float) * inputLength / 2);
-		for (i = 0; i < inputLength / 2; i++) {
-			output[i] = (audio[2 * i] + audio[2 * i + 1]) / 2;
-		}
-		sf_writef_float(outfile, output, inputLength / 2);
-		free(output);
-	}
-	// MONO INPUT to STEREO OUTPUT
-	else if (numChannels == 1 && numOutChannels == 2) {
-		// Allocate the appropriate number of samples in the output audio
-		float *output = (float *) malloc(sizeof(float) * inputLength * 2);
-		for (i = 0; i < inputLength; i++) {
-			output[2 * i] = audio[i];
-			output[2 * i + 1] = audio[i];
-		}
-		sf_writef_float(outfile, output, inputLength);
-		free(output);
-	}
-	// STEREO INPUT to STEREO OUTPUT
-	else if (numChannels == 2 && numOutChannels == 2) {
-		// Allocate the appropriate number of samples in the output audio
-		float *output = (float *) malloc(sizeof(float) * inputLength);
-		for (i = 0; i < inputLength; i++) {
-			output[i] = audio[i];
-		}
-		sf_writef_float(outfile, output, inputLength / 2);
-		free(output);
+	if (!closeAudioWriter(writer)) {
+		printf("error: couldn't write %s\n", outFileName);
 	}
-	sf_close(outfile);
 }
 
 // Takes audioData struct containing a buffer with audio data in it and zero-pads
 // the buffer to the next power of two, updating the numFrames information as well
 audioData *zeroPadToNextPowerOfTwo(audioData *audio) {
 
-	int i;
+	int c;
 
-	// If the audio data is mono
-	if (audio->numChannels == MONO) {
-		// find the next power of two
-		int newLength = calculateNextPowerOfTwo(
-				audio->numChannels * audio->numFrames);
-		// Create new buffer
-		float *newBuffer = (float *) calloc(newLength, sizeof(float));
-		// initialize the buffer with all zeros
-		for (i = 0; i < newLength; i++) {
-			newBuffer[i] = 0.0f;
-		}
-		// Copy data into new buffer
-		for (i = 0; i < audio->numChannels * audio->numFrames; i++) {
-			newBuffer[i] = audio->buffer1[i];
-		}
-		// free the old buffer
-		free(audio->buffer1);
-		// add the new buffer to the audioData struct
-		audio->buffer1 = newBuffer;
-		// calculate new numFrames variable
-		audio->numFrames = newLength;
-		// return the new buffer
+	int64_t newLength = calculateNextPowerOfTwo(audio->numFrames);
 
+	for (c = 0; c < audio->numChannels; c++) {
+		// Create new (zeroed) buffer and copy data into it
+		float *newBuffer = allocateChannelBuffer(newLength);
+		memcpy(newBuffer, audio->channels[c], sizeof(float) * audio->numFrames);
+		// free the old buffer and add the new one to the audioData struct
+		free(audio->channels[c]);
+		audio->channels[c] = newBuffer;
 	}
 
-	// If the audio data is stereo
-	if (audio->numChannels == STEREO) {
+	// calculate new numFrames variable
+	audio->numFrames = newLength;
 
-		int newLength = calculateNextPowerOfTwo(audio->numFrames);
+	return audio;
+}
 
-		float *newLeftBuffer = (float *) calloc(newLength, sizeof(float));
-		float *newRightBuffer = (float *) calloc(newLength, sizeof(float));
+// Takes an integer (length) and determines the next power of 2 that will be reached
+// if we continue to increase the integer
+int64_t calculateNextPowerOfTwo(int64_t length) {
+	int64_t x = 1;
+	while (x < length) {
+		x <<= 1;
+	}
+	return x;
+}
 
-		for (i = 0; i < newLength; i++) {
-			newLeftBuffer[i] = 0.0f;
-			newRightBuffer[i] = 0.0f;
+// A wet (convolved) signal and the dry signal it is mixed with, each scaled
+// by its gain
+typedef struct DryWetMix {
+	float **signalChannels;
+	int numSignalChannels;
+	int64_t numSignalFrames;
+	float **wet;
+	int numOutChannels;
+	int64_t length;
+	float wet_gain;
+	float dry_gain;
+} DryWetMix;
+
+// Mixes frames [first, first + numFrames) of each channel into the planar
+// scratch, then interleaves them into the chunk
+static void mixChunk(DryWetMix *mix, int64_t first, int numFrames,
+		float **scratch, float *chunk) {
+
+	int i, c;
+
+	for (c = 0; c < mix->numOutChannels; c++) {
+		float *out = scratch[c];
+		float *wet = mix->wet[c] + first;
+		float *dry = mix->signalChannels[c % mix->numSignalChannels] + first;
+		int64_t dryFramesLeft = mix->numSignalFrames - first;
+		int numDryFrames = dryFramesLeft > numFrames ? numFrames :
+				dryFramesLeft < 0 ? 0 : (int) dryFramesLeft;
+		for (i = 0; i < numDryFrames; i++) {
+			out[i] = wet[i] * mix->wet_gain + dry[i] * mix->dry_gain;
+		}
+		for (; i < numFrames; i++) {
+			out[i] = wet[i] * mix->wet_gain;
 		}
+	}
+	interleave(scratch, chunk, mix->numOutChannels, numFrames);
+}
 
-		for (i = 0; i < audio->numFrames; i++) {
-			newLeftBuffer[i] = audio->buffer1[i];
-			newRightBuffer[i] = audio->buffer2[i];
-		}
+// Streams the mix through a gain stage to a .wav file one chunk at a time, so
+// the full-length output is never materialized. Each chunk is mixed straight
+// into the writer's buffer while the previous one is written.
+static void writeDryWetMix(DryWetMix *mix, GainMode gainMode, float gainValue,
+		int sample_rate, OutputFormat format, char *outFileName) {
 
-		free(audio->buffer1);
-		free(audio->buffer2);
+	int64_t first;
+	int numOutChannels = mix->numOutChannels;
 
-		audio->buffer1 = newLeftBuffer;
-		audio->buffer2 = newRightBuffer;
+	AudioWriter *writer = openAudioWriter(outFileName, sample_rate,
+			numOutChannels, format, OUTPUT_CHUNK_FRAMES);
+	if (writer == NULL) {
+		return;
+	}
 
-		audio->numFrames = newLength;
+	GainStage *stage = createGainStage(gainMode, gainValue, numOutChannels,
+			sample_rate);
+	float *chunk;
+	float *scratch[numOutChannels];
+	int c;
+	for (c = 0; c < numOutChannels; c++) {
+		scratch[c] = (float *) malloc(sizeof(float) * OUTPUT_CHUNK_FRAMES);
+	}
 
+	// Cheap first pass: only the peak of the mix is kept
+	if (gainMode == GAIN_TWO_PASS) {
+		chunk = (float *) malloc(
+				sizeof(float) * OUTPUT_CHUNK_FRAMES * numOutChannels);
+		for (first = 0; first < mix->length; first += OUTPUT_CHUNK_FRAMES) {
+			int numFrames = mix->length - first < OUTPUT_CHUNK_FRAMES ?
+					(int) (mix->length - first) : OUTPUT_CHUNK_FRAMES;
+			mixChunk(mix, first, numFrames, scratch, chunk);
+			gainStageTrack(stage, chunk, numFrames);
+		}
+		free(chunk);
 	}
 
-	return audio;
-}
+	for (first = 0; first < mix->length; first += OUTPUT_CHUNK_FRAMES) {
+		int numFrames = mix->length - first < OUTPUT_CHUNK_FRAMES ?
+				(int) (mix->length - first) : OUTPUT_CHUNK_FRAMES;
+		chunk = audioWriterGetChunk(writer);
+		mixChunk(mix, first, numFrames, scratch, chunk);
+		audioWriterSubmit(writer,
+				gainStageProcess(stage, chunk, chunk, numFrames));
+	}
+	chunk = audioWriterGetChunk(writer);
+	audioWriterSubmit(writer, gainStageFlush(stage, chunk));
 
-// Takes an integer (length) and determines the next power of 2 that will be reached
-// if we continue to increase the integer
-int calculateNextPowerOfTwo(int length) {
-	unsigned int x = length;
-	while (x != (x & (~x + 1))) {
-		x++;
+	if (!closeAudioWriter(writer)) {
+		printf("error: couldn't write %s\n", outFileName);
 	}
-	return x;
+	for (c = 0; c < numOutChannels; c++) {
+		free(scratch[c]);
+	}
+	free_GainStage(stage);
 }
 
 // This function convolves two signals together (frequency domain multiplication)
@@ -265,6 +472,20 @@ int calculateNextPowerOfTwo(int length) {
 // and 1 is completely wet
 void fastConvolve(audioData *signal, audioData *impulse, float dry_wet,
 		char *outFileName) {
+	fastConvolveWithGain(signal, impulse, dry_wet, GAIN_TWO_PASS, 1.0f,
+			OUTPUT_PCM_16, outFileName);
+}
+
+// As fastConvolve, with the output level set by a gain stage (gainValue is the
+// gain for GAIN_FIXED and the target peak otherwise) and the output written in
+// the given format
+//
+// Short impulses are convolved directly and long ones with segmented FFT convolution,
+// whichever autoConvolve predicts to be faster on this machine. Either way the work is
+// split across worker threads (all channels at once).
+void fastConvolveWithGain(audioData *signal, audioData *impulse, float dry_wet,
+		GainMode gainMode, float gainValue, OutputFormat format,
+		char *outFileName) {
 
 	// Check for realistic dry_wet values
 	if (dry_wet < 0 || dry_wet > 1) {
@@ -272,228 +493,59 @@ void fastConvolve(audioData *signal, audioData *impulse, float dry_wet,
 		return;
 	}
 
-	int i;
-	int outputLength = 0;
-
-	// If the signal is mono and the impulse is mono
-	if (signal->numChannels == 1 && impulse->numChannels == 1) {
-		float max = 0;
-//		printf("signal: mono\nimpulse: mono\n");
-		float *outputBuffer;
-		// Convolve
-		int length = convolve(signal->buffer1, impulse->buffer1,
-				signal->numFrames, impulse->numFrames, &outputBuffer);
-		// For normalizing later on
-		for (i = 0; i < signal->numFrames; i++) {
-			if (fabs(signal->buffer1[i]) > max) {
-				max = fabs(signal->buffer1[i]);
-			}
-		}
-		// Normalize signal buffer, multiply by dry/wet coefficient
-		for (i = 0; i < signal->numFrames; i++) {
-			signal->buffer1[i] *= (1 - dry_wet) / max;
-		}
-		// Add dry signal to output buffer
-		for (i = 0; i < signal->numFrames; i++) {
-			outputBuffer[i] += signal->buffer1[i];
-		}
-		// Normalize output buffer again
-		max = 0;
-		for (i = 0; i < length; i++) {
-			if (fabs(outputBuffer[i]) > max) {
-				max = fabs(outputBuffer[i]);
-			}
-		}
-		for (i = 0; i < length; i++) {
-			outputBuffer[i] /= max;
-		}
-		// Write to wav file
-		writeWavFile(outputBuffer, 44100, 1, length, 1, outFileName);
-	}
-
-	// If the signal is stereo but the impulse is mono
-	if (signal->numChannels == 2 && impulse->numChannels == 1) {
-		float max = 0;
-//		printf("signal: stereo\nimpulse: mono\n");
-		float *outLeft;
-		float *outRight;
-		// Create buffer for left channel of signal
-		float *signal_left = (float *) malloc(
-				sizeof(float) * signal->numFrames);
-		// Create buffer for right channel of signal
-		float *signal_right = (float *) malloc(
-				sizeof(float) * signal->numFrames);
-		// Copy signal data into buffers
-		for (i = 0; i < signal->numFrames; i++) {
-			signal_left[i] = signal->buffer1[2 * i];
-			signal_right[i] = signal->buffer1[2 * i + 1];
-			// For normalizing later on
-			if (fabs(signal->buffer1[2 * i]) > max) {
-				max = fabs(signal->buffer1[2 * i]);
-			}
-			if (fabs(signal->buffer1[2 * i + 1]) > max) {
-				max = fabs(signal->buffer1[2 * i + 1]);
-			}
-		}
-		// Convolve
-		int length = convolve(signal_left, impulse->buffer1, signal->numFrames,
-				impulse->numFrames, &outLeft);
-		convolve(signal_right, impulse->buffer1, signal->numFrames,
-				impulse->numFrames, &outRight);
-		// Recombine left and right channels
-		float *outputBuffer = (float *) malloc(sizeof(float) * length * 2);
-		for (i = 0; i < length; i++) {
-			outputBuffer[2 * i] = outLeft[i] * dry_wet;
-			outputBuffer[2 * i + 1] = outRight[i] * dry_wet;
-		}
-		// Normalize signal buffer, multiply by dry/wet coefficient
-		for (i = 0; i < signal->numFrames * 2; i++) {
-			signal->buffer1[i] *= (1 - dry_wet) / max;
-		}
-		// Add dry signal to output buffer
-		for (i = 0; i < signal->numFrames; i++) {
-			outputBuffer[2 * i] += signal->buffer1[2 * i];
-			outputBuffer[2 * i + 1] += signal->buffer1[2 * i + 1];
-		}
-		// Normalize output buffer again
-		max = 0;
-		for (i = 0; i < length * 2; i++) {
-			if (fabs(outputBuffer[i]) > max) {
-				max = fabs(outputBuffer[i]);
-			}
-		}
-		for (i = 0; i < length * 2; i++) {
-			outputBuffer[i] /= max;
-		}
-		// Write to wav file
-		writeWavFile(outputBuffer, 44100, 2, length, 2, outFileName);
-	}
-
-	// If the signal is mono but the impulse is stereo
-	if (signal->numChannels == 1 && impulse->numChannels == 2) {
-		float max = 0;
-//		printf("signal: mono\nimpulse: stereo\n");
-		float *outLeft;
-		float *outRight;
-		// Create buffer for left channel of impulse
-		float *impulse_left = (float *) malloc(
-				sizeof(float) * impulse->numFrames);
-		// Create buffer for right channel of impulse
-		float *impulse_right = (float *) malloc(
-				sizeof(float) * impulse->numFrames);
-		// Copy impulse data into buffers
-		for (i = 0; i < impulse->numFrames; i++) {
-			impulse_left[i] = impulse->buffer1[2 * i];
-			impulse_right[i] = impulse->buffer1[2 * i + 1];
-		}
-		// For normalizing later on
-		for (i = 0; i < signal->numFrames; i++) {
-			if (fabs(signal->buffer1[i]) > max) {
-				max = fabs(signal->buffer1[i]);
-			}
-		}
-		// Convolve
-		int length = convolve(signal->buffer1, impulse_left, signal->numFrames,
-				impulse->numFrames, &outLeft);
-		convolve(signal->buffer1, impulse_right, signal->numFrames,
-				impulse->numFrames, &outRight);
-		// Recombine left and right channels
-		float *outputBuffer = (float *) malloc(sizeof(float) * length * 2);
-		for (i = 0; i < length; i++) {
-			outputBuffer[2 * i] = outLeft[i] * dry_wet;
-			outputBuffer[2 * i + 1] = outRight[i] * dry_wet;
-		}
-		// Normalize signal buffer, multiply by dry/wet coefficient
-		for (i = 0; i < signal->numFrames; i++) {
-			signal->buffer1[i] *= (1 - dry_wet) / max;
-		}
-		// Add dry signal to output buffer
-		for (i = 0; i < signal->numFrames; i++) {
-			outputBuffer[2 * i] += signal->buffer1[i];
-			outputBuffer[2 * i + 1] += signal->buffer1[i];
-		}
-		// Normalize output buffer again
-		max = 0;
-		for (i = 0; i < length * 2; i++) {
-			if (fabs(outputBuffer[i]) > max) {
-				max = fabs(outputBuffer[i]);
-			}
-		}
-		for (i = 0; i < length * 2; i++) {
-			outputBuffer[i] /= max;
-		}
-		// Write to wav file
-		writeWavFile(outputBuffer, 44100, 2, length, 2, outFileName);
-	}
-
-	// If the signal is stereo and the impulse is stereo
-	if (signal->numChannels == 2 && impulse->numChannels == 2) {
-		float max = 0;
-//		printf("signal: stereo\nimpulse: stereo\n");
-		float *outLeft;
-		float *outRight;
-		// Create buffer for left channel of signal
-		float *signal_left = (float *) malloc(
-				sizeof(float) * signal->numFrames);
-		// Create buffer for right channel of signal
-		float *signal_right = (float *) malloc(
-				sizeof(float) * signal->numFrames);
-		// Create buffer for left channel of impulse
-		float *impulse_left = (float *) malloc(
-				sizeof(float) * impulse->numFrames);
-		// Create buffer for right channel of impulse
-		float *impulse_right = (float *) malloc(
-				sizeof(float) * impulse->numFrames);
-		// Copy signal data into buffers
-		for (i = 0; i < signal->numFrames; i++) {
-			signal_left[i] = signal->buffer1[2 * i];
-			signal_right[i] = signal->buffer1[2 * i + 1];
-			// For normalizing later on
-			if (fabs(signal->buffer1[2 * i]) > max) {
-				max = fabs(signal->buffer1[2 * i]);
-			}
-			if (fabs(signal->buffer1[2 * i + 1]) > max) {
-				max = fabs(signal->buffer1[2 * i + 1]);
-			}
-		}
-		// Copy impulse data into buffers
-		for (i = 0; i < impulse->numFrames; i++) {
-			impulse_left[i] = impulse->buffer1[2 * i];
-			impulse_right[i] = impulse->buffer1[2 * i + 1];
-		}
-		// Convolve
-		int length = convolve(signal_left, impulse_left, signal->numFrames,
-				impulse->numFrames, &outLeft);
-		convolve(signal_right, impulse_right, signal->numFrames,
-				impulse->numFrames, &outRight);
-		// Recombine left and right channels
-		float *outputBuffer = (float *) malloc(sizeof(float) * length * 2);
-		for (i = 0; i < length; i++) {
-			outputBuffer[2 * i] = outLeft[i] * dry_wet;
-			outputBuffer[2 * i + 1] = outRight[i] * dry_wet;
-		}
-		// Normalize signal buffer, multiply by dry/wet coefficient
-		for (i = 0; i < signal->numFrames * 2; i++) {
-			signal->buffer1[i] *= (1 - dry_wet) / max;
-		}
-		// Add dry signal to output buffer
-		for (i = 0; i < signal->numFrames; i++) {
-			outputBuffer[2 * i] += signal->buffer1[2 * i];
-			outputBuffer[2 * i + 1] += signal->buffer1[2 * i + 1];
-		}
-		// Normalize output buffer again
-		max = 0;
-		for (i = 0; i < length * 2; i++) {
-			if (fabs(outputBuffer[i]) > max) {
-				max = fabs(outputBuffer[i]);
-			}
-		}
-		for (i = 0; i < length * 2; i++) {
-			outputBuffer[i] /= max;
-		}
-		// Write to wav file
-		writeWavFile(outputBuffer, 44100, 2, length, 2, outFileName);
+	int c;
+
+	// The impulse is applied at the signal's rate
+	audioData *converted = NULL;
+	if (impulse->sampleRate != signal->sampleRate) {
+		impulse = converted = resampleAudioData(impulse, signal->sampleRate);
+	}
+	if (impulse->numFrames > MAX_RENDER_IMPULSE_FRAMES) {
+		printf("Error: the impulse is too long (%lld frames)\n",
+				(long long) impulse->numFrames);
+		free_audioData(converted);
+		return;
+	}
+
+	// Both signal and impulse are planar (as read by fileToBuffer)
+	float **signalChannels = signal->channels;
+	float **impulseChannels = impulse->channels;
+
+	int numOutChannels = signal->numChannels > impulse->numChannels ?
+			signal->numChannels : impulse->numChannels;
+
+	// Convolve
+	float **wet = autoConvolve(signalChannels, signal->numChannels,
+			signal->numFrames, impulseChannels, impulse->numChannels,
+			impulse->numFrames, numOutChannels);
+	int64_t length = signal->numFrames + impulse->numFrames - 1;
+
+	// Peaks, for matching the wet level to the dry level
+	float signal_max = 0;
+	for (c = 0; c < signal->numChannels; c++) {
+		signal_max = fmaxf(signal_max,
+				findPeak(signalChannels[c], signal->numFrames));
+	}
+	float wet_max = 0;
+	for (c = 0; c < numOutChannels; c++) {
+		wet_max = fmaxf(wet_max, findPeak(wet[c], length));
 	}
+
+	// Scale the wet signal to the level of the dry signal, and normalize the
+	// dry signal, each multiplied by its dry/wet coefficient
+	DryWetMix mix = { signalChannels, signal->numChannels, signal->numFrames,
+			wet, numOutChannels, length };
+	mix.wet_gain = wet_max > 0 ? dry_wet * signal_max / wet_max : 0;
+	mix.dry_gain = signal_max > 0 ? (1 - dry_wet) / signal_max : 0;
+
+	writeDryWetMix(&mix, gainMode, gainValue, signal->sampleRate, format,
+			outFileName);
+
+	for (c = 0; c < numOutChannels; c++) {
+		free(wet[c]);
+	}
+	free(wet);
+	free_audioData(converted);
 }
 
 // This function performs time-domain multiplication (slow convolution)
@@ -501,6 +553,15 @@ void fastConvolve(audioData *signal, audioData *impulse, float dry_wet,
 // and 1 is completely wet
 void slowConvolve(audioData *signal, audioData *impulse, float dry_wet,
 		char *outFileName) {
+	slowConvolveWithGain(signal, impulse, dry_wet, GAIN_TWO_PASS, 1.0f,
+			OUTPUT_PCM_16, outFileName);
+}
+
+// As slowConvolve, with the output level set by a gain stage and the output
+// written in the given format
+void slowConvolveWithGain(audioData *signal, audioData *impulse, float dry_wet,
+		GainMode gainMode, float gainValue, OutputFormat format,
+		char *outFileName) {
 
 	// Check for realistic dry_wet values
 	if (dry_wet < 0 || dry_wet > 1) {
@@ -508,42 +569,43 @@ void slowConvolve(audioData *signal, audioData *impulse, float dry_wet,
 		return;
 	}
 
-	int i, j, k;
-	if (signal->numChannels == 1 && impulse->numChannels == 1) {
-	}
-	if (signal->numChannels == 2 && impulse->numChannels == 1) {
-	}
-	if (signal->numChannels == 1 && impulse->numChannels == 2) {
+	int c;
+
+	// The impulse is applied at the signal's rate
+	audioData *converted = NULL;
+	if (impulse->sampleRate != signal->sampleRate) {
+		impulse = converted = resampleAudioData(impulse, signal->sampleRate);
 	}
-	if (signal->numChannels == 2 && impulse->numChannels == 2) {
-		// Find new length
-		int newLength = signal->numFrames + impulse->numFrames - 1;
-		// Create buffer for output
-		float *outputBuffer = (float *) malloc(sizeof(float) * newLength * 2);
-		// Zero out buffer
-		memset(outputBuffer, 0, sizeof(float) * newLength * 2);
-		// Perform convolution
-		for (j = 0; j < signal->numFrames; j++) {
-			for (k = 0; k < impulse->numFrames; k++) {
-				outputBuffer[2 * (j + k)] += signal->buffer1[2 * j]
-						* impulse->buffer1[2 * k];
-				outputBuffer[2 * (j + k) + 1] += signal->buffer1[2 * j + 1]
-						* impulse->buffer1[2 * k + 1];
-			}
-		}
-		// Multiply by dry/wet coefficient
-		for (i = 0; i < newLength * 2; i++) {
-			outputBuffer[i] *= dry_wet;
-		}
-		// Add dry signal to output buffer, multiply by dry/wet coefficient
-		for (i = 0; i < signal->numFrames * 2; i++) {
-			outputBuffer[i] += signal->buffer1[i] * (1 - dry_wet);
-		}
-		// Normalize
-		outputBuffer = normalizeBuffer(outputBuffer, newLength * 2);
-		// Write to wav file
-		writeWavFile(outputBuffer, 44100, 2, newLength, 2, outFileName);
+	if (impulse->numFrames > MAX_RENDER_IMPULSE_FRAMES) {
+		printf("Error: the impulse is too long (%lld frames)\n",
+				(long long) impulse->numFrames);
+		free_audioData(converted);
+		return;
 	}
 
-}
+	// Both signal and impulse are planar (as read by fileToBuffer)
+	float **signalChannels = signal->channels;
+	float **impulseChannels = impulse->channels;
+
+	int numOutChannels = signal->numChannels > impulse->numChannels ?
+			signal->numChannels : impulse->numChannels;
 
+	// Perform convolution
+	float **wet = directConvolve(signalChannels, signal->numChannels,
+			signal->numFrames, impulseChannels, impulse->numChannels,
+			impulse->numFrames, numOutChannels);
+	int64_t newLength = signal->numFrames + impulse->numFrames - 1;
+
+	// Add dry signal to output buffer, multiply each by dry/wet coefficient
+	DryWetMix mix = { signalChannels, signal->numChannels, signal->numFrames,
+			wet, numOutChannels, newLength, dry_wet, 1 - dry_wet };
+
+	writeDryWetMix(&mix, gainMode, gainValue, signal->sampleRate, format,
+			outFileName);
+
+	for (c = 0; c < numOutChannels; c++) {
+		free(wet[c]);
+	}
+	free(wet);
+	free_audioData(converted);
+}
@@ -8,21 +8,41 @@
 #ifndef DAWSONAUDIO_H_
 #define DAWSONAUDIO_H_
 
+#include <stdint.h>
+#include "gain.h"
+#include "writer.h"
+
 #define MONO				1
 #define STEREO				2
 
-// Struct for audio data
+// Alignment (in bytes) of every channel buffer, enough for any vector load
+#define AUDIO_BUFFER_ALIGNMENT	32
+
+// Struct for audio data: one buffer of numFrames samples per channel
 typedef struct audioData {
 
 	int numChannels;
-	int numFrames;
+	int64_t numFrames;
 	int sampleRate;
 	char *fileName;
-	float *buffer1;
-	float *buffer2;
+	float **channels;
 
 } audioData;
 
+// Allocate a zeroed, aligned channel buffer (exits if out of memory)
+float *allocateChannelBuffer(int64_t numFrames);
+
+// Resize a channel buffer of numFrames frames to newNumFrames, keeping the
+// frames they have in common and zeroing the rest (exits if out of memory)
+float *resizeChannelBuffer(float *buffer, int64_t numFrames,
+		int64_t newNumFrames);
+
+// Allocate audio data with numChannels zeroed channel buffers
+audioData *createAudioData(int numChannels, int64_t numFrames, int sampleRate);
+
+// Allocate a copy of audio data, including its file name
+audioData *copyAudioData(const audioData *audio);
+
 void free_audioData(audioData *audio);
 
 float *normalizeBuffer(float *buffer, int length);
@@ -30,19 +50,28 @@ float *normalizeBuffer(float *buffer, int length);
 // Read audio data to buffer
 audioData *fileToBuffer( char *fileName );
 
+// Read audio data to buffer, converted to sampleRate (cached)
+audioData *fileToBufferAtRate(char *fileName, int sampleRate);
+
 // Write data in buffer to .wav file
-void writeWavFile( float *audio, int sample_rate, int numChannels, int numFrames, int numOutChannels, char *outFileName );
+void writeWavFile( float *audio, int sample_rate, int numChannels, int64_t numFrames, int numOutChannels, OutputFormat format, char *outFileName );
 
 // Zero-pad audioData buffer to next power of two
 audioData *zeroPadToNextPowerOfTwo(audioData *audio);
 
 // Calculates the next power of two
-int calculateNextPowerOfTwo(int length);
+int64_t calculateNextPowerOfTwo(int64_t length);
 
 // FFT convolution
 void fastConvolve(audioData *signal, audioData *impulse, float dry_wet, char *outFileName);
 
+// FFT convolution, output level set by a gain stage instead of normalization
+void fastConvolveWithGain(audioData *signal, audioData *impulse, float dry_wet, GainMode gainMode, float gainValue, OutputFormat format, char *outFileName);
+
 // Direct convolution
 void slowConvolve(audioData *signal, audioData *impulse, float dry_wet, char *outFileName);
 
+// Direct convolution, output level set by a gain stage instead of normalization
+void slowConvolveWithGain(audioData *signal, audioData *impulse, float dry_wet, GainMode gainMode, float gainValue, OutputFormat format, char *outFileName);
+
 #endif /* DAWSONAUDIO_H_ */
@@ -0,0 +1,57 @@
+/*
+ * fastmath.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#include <math.h>
+#include "fastmath.h"
+
+// Values summed in float lanes before they are added to a double
+#define SUM_CHUNK			1024
+
+void sumLogs(const float *in, int64_t n, double *sumLog, double *sumLogTimesX) {
+
+	int64_t j = 0;
+	double total = 0.0, totalTimesX = 0.0;
+
+	while (j < n) {
+		int64_t end = j + SUM_CHUNK < n ? j + SUM_CHUNK : n;
+		int64_t first = j;
+
+		// Within a chunk, x is summed relative to its start:
+		// sum (first + k) y = first sum y + sum k y
+		v4sf sum = v4sf_set1(0.0f), sumTimesK = v4sf_set1(0.0f);
+		v4sf k = { 0.0f, 1.0f, 2.0f, 3.0f };
+		for (; j + SIMD_WIDTH <= end; j += SIMD_WIDTH) {
+			v4sf y = v4sf_log(v4sf_load(in + j));
+			sum += y;
+			sumTimesK += y * k;
+			k += (float) SIMD_WIDTH;
+		}
+		double chunkSum = v4sf_sum(sum);
+		double chunkSumTimesK = v4sf_sum(sumTimesK);
+		for (; j < end; j++) {
+			double y = logf(in[j]);
+			chunkSum += y;
+			chunkSumTimesK += y * (j - first);
+		}
+
+		total += chunkSum;
+		totalTimesX += chunkSumTimesK + (double) first * chunkSum;
+	}
+
+	*sumLog = total;
+	*sumLogTimesX = totalTimesX;
+}
+
+void fitLine(int64_t n, double sumY, double sumYTimesX, float *a, float *b) {
+	double N = (double) n;
+	double sumX = N * (N - 1.0) / 2.0;
+	double sumXTimesX = (N - 1.0) * N * (2.0 * N - 1.0) / 6.0;
+
+	*b = (float) ((N * sumYTimesX - sumX * sumY)
+			/ (N * sumXTimesX - sumX * sumX));
+	*a = (float) ((sumY - *b * sumX) / N);
+}
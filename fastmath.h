@@ -0,0 +1,84 @@
+/*
+ * fastmath.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#ifndef FASTMATH_H_
+#define FASTMATH_H_
+
+#include <stdint.h>
+#include "simd.h"
+
+/*
+ * Four-lane exp() and log() after the Cephes single-precision versions:
+ * range reduction to a power of 2 and a short polynomial. Over the range
+ * the synthesis uses, both are within 2 ulps of expf() and logf().
+ */
+
+// 1.5 * 2^23: adding it rounds a float (of magnitude under 2^22) to an
+// integer held in the low bits of the mantissa
+#define FASTMATH_ROUNDING_MAGIC		12582912.0f
+#define FASTMATH_ROUNDING_BITS		0x4B400000
+
+static inline v4sf v4sf_exp(v4sf x) {
+	x = v4sf_min(v4sf_max(x, v4sf_set1(-87.3f)), v4sf_set1(88.3f));
+
+	// x = n ln 2 + r, |r| <= ln 2 / 2
+	v4sf t = x * 1.44269504088896341f + FASTMATH_ROUNDING_MAGIC;
+	v4si n = (v4si) t - FASTMATH_ROUNDING_BITS;
+	v4sf nf = t - FASTMATH_ROUNDING_MAGIC;
+	v4sf r = x - nf * 0.693359375f + nf * 2.12194440e-4f;
+
+	v4sf p = v4sf_set1(1.9875691500e-4f);
+	p = p * r + 1.3981999507e-3f;
+	p = p * r + 8.3334519073e-3f;
+	p = p * r + 4.1665795894e-2f;
+	p = p * r + 1.6666665459e-1f;
+	p = p * r + 5.0000001201e-1f;
+	v4sf y = p * r * r + r + 1.0f;
+
+	// Multiply by 2^n through the exponent bits
+	return (v4sf) ((v4si) y + (n << 23));
+}
+
+// For x > 0 (smaller values are treated as the smallest normal float)
+static inline v4sf v4sf_log(v4sf x) {
+	x = v4sf_max(x, v4sf_set1(1.17549435e-38f));
+
+	// x = m 2^e with m in [sqrt(1/2), sqrt(2))
+	v4si bits = (v4si) x;
+	v4si e = ((bits >> 23) & 0xff) - 126;
+	v4sf m = (v4sf) ((bits & 0x007fffff) | 0x3f000000); // [0.5, 1)
+	v4si small = m < 0.707106781186547524f;
+	e = e + small; // the mask is -1 where set
+	m = m - 1.0f + (v4sf) ((v4si) m & small);
+	v4sf ef = (v4sf) (e + FASTMATH_ROUNDING_BITS) - FASTMATH_ROUNDING_MAGIC;
+
+	v4sf z = m * m;
+	v4sf p = v4sf_set1(7.0376836292e-2f);
+	p = p * m - 1.1514610310e-1f;
+	p = p * m + 1.1676998740e-1f;
+	p = p * m - 1.2420140846e-1f;
+	p = p * m + 1.4249322787e-1f;
+	p = p * m - 1.6668057665e-1f;
+	p = p * m + 2.0000714765e-1f;
+	p = p * m - 2.4999993993e-1f;
+	p = p * m + 3.3333331174e-1f;
+	v4sf y = p * m * z;
+
+	y = y - ef * 2.12194440e-4f;
+	y = y - 0.5f * z;
+	return m + y + ef * 0.693359375f;
+}
+
+// Sums of log(in[j]) and j * log(in[j]) over j in [0, n), as needed for a
+// least-squares fit of A * exp(b * j) to in
+void sumLogs(const float *in, int64_t n, double *sumLog, double *sumLogTimesX);
+
+// The least-squares line through (j, y[j]) for j in [0, n), from the sums
+// of y and j * y: y = a + b * j. The sums of j and j^2 are closed-form.
+void fitLine(int64_t n, double sumY, double sumYTimesX, float *a, float *b);
+
+#endif /* FASTMATH_H_ */
@@ -0,0 +1,243 @@
+/*
+ * gain.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "gain.h"
+#include "simd.h"
+
+#define LIMITER_LOOKAHEAD_MS		5
+#define LIMITER_RELEASE_MS			100
+
+/*
+ * Catmull-Rom weights for points 1/4, 1/2 and 3/4 of the way between the
+ * middle two of four samples, used to estimate inter-sample (true) peaks.
+ */
+static const float true_peak_weights[3][4] = {
+	{ -0.0703125f, 0.8671875f, 0.2265625f, -0.0234375f },
+	{ -0.0625f, 0.5625f, 0.5625f, -0.0625f },
+	{ -0.0234375f, 0.2265625f, 0.8671875f, -0.0703125f }
+};
+
+GainStage *createGainStage(GainMode mode, float value, int numChannels,
+		int sampleRate) {
+
+	GainStage *stage = (GainStage *) calloc(1, sizeof(GainStage));
+
+	stage->mode = mode;
+	stage->numChannels = numChannels;
+	stage->gain = mode == GAIN_FIXED ? value : 1.0f;
+	stage->target = value;
+	stage->peak = 0.0f;
+
+	if (mode == GAIN_LIMITER) {
+		stage->lookahead = sampleRate * LIMITER_LOOKAHEAD_MS / 1000;
+		if (stage->lookahead < 1) {
+			stage->lookahead = 1;
+		}
+		stage->releaseCoef = 1.0f
+				- expf(-1000.0f / (LIMITER_RELEASE_MS * (float) sampleRate));
+		stage->delay = (float *) calloc(stage->lookahead * numChannels,
+				sizeof(float));
+		stage->history = (float *) calloc(3 * numChannels, sizeof(float));
+		// The hold window spans lookahead + 2 frames, because a true peak is
+		// only detected a frame or two after the samples around it
+		stage->holdValues = (float *) malloc(
+				sizeof(float) * (stage->lookahead + 3));
+		stage->holdTimes = (long *) malloc(sizeof(long) * (stage->lookahead + 3));
+		stage->boxRing = (float *) malloc(sizeof(float) * stage->lookahead);
+		for (int i = 0; i < stage->lookahead; i++) {
+			stage->boxRing[i] = 1.0f;
+		}
+		stage->boxSum = stage->lookahead;
+		stage->envelope = 1.0f;
+	}
+
+	return stage;
+}
+
+void free_GainStage(GainStage *stage) {
+	if (stage) {
+		free(stage->delay);
+		free(stage->history);
+		free(stage->holdValues);
+		free(stage->holdTimes);
+		free(stage->boxRing);
+		free(stage);
+	}
+}
+
+float findPeak(const float *buffer, long length) {
+
+	long i = 0;
+	float peak = 0.0f;
+
+	v4sf peaks = v4sf_set1(0.0f);
+	for (; i + SIMD_WIDTH <= length; i += SIMD_WIDTH) {
+		peaks = v4sf_max(peaks, v4sf_abs(v4sf_load(buffer + i)));
+	}
+	for (int lane = 0; lane < SIMD_WIDTH; lane++) {
+		if (peaks[lane] > peak) {
+			peak = peaks[lane];
+		}
+	}
+	for (; i < length; i++) {
+		if (fabsf(buffer[i]) > peak) {
+			peak = fabsf(buffer[i]);
+		}
+	}
+
+	return peak;
+}
+
+void gainStageTrack(GainStage *stage, const float *chunk, int numFrames) {
+
+	float peak = findPeak(chunk, (long) numFrames * stage->numChannels);
+	if (peak > stage->peak) {
+		stage->peak = peak;
+		stage->gain = peak > 0.0f ? stage->target / peak : 1.0f;
+	}
+}
+
+static void applyGain(float *buffer, long length, float gain) {
+
+	long i = 0;
+
+	v4sf g = v4sf_set1(gain);
+	for (; i + SIMD_WIDTH <= length; i += SIMD_WIDTH) {
+		v4sf_store(buffer + i, v4sf_load(buffer + i) * g);
+	}
+	for (; i < length; i++) {
+		buffer[i] *= gain;
+	}
+}
+
+/*
+ * Pushes one frame through the limiter and writes the frame that leaves
+ * the lookahead delay to out. Returns 0 while the delay is still filling.
+ */
+static int limitFrame(GainStage *stage, const float *frame, float *out) {
+
+	int c, k;
+	int numChannels = stage->numChannels;
+	int holdCapacity = stage->lookahead + 3;
+
+	// Sample and inter-sample peak of the frame
+	float peak = 0.0f;
+	for (c = 0; c < numChannels; c++) {
+		float *h = stage->history + 3 * c;
+		float sample = frame[c];
+		if (fabsf(sample) > peak) {
+			peak = fabsf(sample);
+		}
+		for (k = 0; k < 3; k++) {
+			float interpolated = true_peak_weights[k][0] * h[0]
+					+ true_peak_weights[k][1] * h[1]
+					+ true_peak_weights[k][2] * h[2]
+					+ true_peak_weights[k][3] * sample;
+			if (fabsf(interpolated) > peak) {
+				peak = fabsf(interpolated);
+			}
+		}
+		h[0] = h[1];
+		h[1] = h[2];
+		h[2] = sample;
+	}
+	float required = peak > stage->target ? stage->target / peak : 1.0f;
+
+	// Sliding minimum of the required gain over the hold window
+	while (stage->holdCount > 0) {
+		int last = (stage->holdHead + stage->holdCount - 1) % holdCapacity;
+		if (stage->holdValues[last] < required) {
+			break;
+		}
+		stage->holdCount--;
+	}
+	int tail = (stage->holdHead + stage->holdCount) % holdCapacity;
+	stage->holdValues[tail] = required;
+	stage->holdTimes[tail] = stage->time;
+	stage->holdCount++;
+	if (stage->holdTimes[stage->holdHead] < stage->time - stage->lookahead - 1) {
+		stage->holdHead = (stage->holdHead + 1) % holdCapacity;
+		stage->holdCount--;
+	}
+	float held = stage->holdValues[stage->holdHead];
+
+	// Instant attack (the lookahead already anticipates it), smooth release
+	if (held < stage->envelope) {
+		stage->envelope = held;
+	} else {
+		stage->envelope += (held - stage->envelope) * stage->releaseCoef;
+	}
+
+	// Average over the lookahead so the gain ramps down instead of stepping
+	stage->boxSum += stage->envelope - stage->boxRing[stage->boxPos];
+	stage->boxRing[stage->boxPos] = stage->envelope;
+	stage->boxPos = (stage->boxPos + 1) % stage->lookahead;
+	float gain = (float) (stage->boxSum / stage->lookahead);
+
+	stage->time++;
+
+	// Swap the frame into the delay line
+	float *delayed = stage->delay + stage->delayPos * numChannels;
+	stage->delayPos = (stage->delayPos + 1) % stage->lookahead;
+	if (stage->delayFilled < stage->lookahead) {
+		memcpy(delayed, frame, sizeof(float) * numChannels);
+		stage->delayFilled++;
+		return 0;
+	}
+	for (c = 0; c < numChannels; c++) {
+		float sample = frame[c];
+		out[c] = delayed[c] * gain;
+		delayed[c] = sample;
+	}
+	return 1;
+}
+
+int gainStageProcess(GainStage *stage, const float *in, float *out,
+		int numFrames) {
+
+	int i;
+
+	if (stage->mode != GAIN_LIMITER) {
+		if (out != in) {
+			memcpy(out, in, sizeof(float) * numFrames * stage->numChannels);
+		}
+		applyGain(out, (long) numFrames * stage->numChannels, stage->gain);
+		return numFrames;
+	}
+
+	// Output never runs ahead of input, so this is safe in place
+	int written = 0;
+	for (i = 0; i < numFrames; i++) {
+		written += limitFrame(stage, in + i * stage->numChannels,
+				out + written * stage->numChannels);
+	}
+	return written;
+}
+
+int gainStageFlush(GainStage *stage, float *out) {
+
+	if (stage->mode != GAIN_LIMITER) {
+		return 0;
+	}
+
+	// Push silence until every real frame still in the delay line is out
+	// (a short input may not have filled the line yet)
+	float *silence = (float *) calloc(stage->numChannels, sizeof(float));
+	int held = stage->delayFilled;
+	int written = 0;
+	while (written < held) {
+		written += limitFrame(stage, silence, out + written * stage->numChannels);
+	}
+	free(silence);
+
+	stage->delayFilled = 0;
+	return written;
+}
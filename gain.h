@@ -0,0 +1,68 @@
+/*
+ * gain.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#ifndef GAIN_H_
+#define GAIN_H_
+
+typedef enum GainMode {
+	GAIN_FIXED,		// multiply by a fixed gain
+	GAIN_TWO_PASS,	// find the peak in a first pass, then scale it to the target
+	GAIN_LIMITER	// lookahead true-peak limiter holding the output under the target
+} GainMode;
+
+/*
+ * A gain stage that works on interleaved chunks of any size. The limiter
+ * delays its output by its lookahead, so gainStageProcess may return fewer
+ * frames than it was given and gainStageFlush returns the rest.
+ */
+typedef struct GainStage {
+	GainMode mode;
+	float target; // peak target (GAIN_TWO_PASS, GAIN_LIMITER)
+	float gain; // gain applied by GAIN_FIXED and GAIN_TWO_PASS
+	float peak; // peak tracked by gainStageTrack
+	int numChannels;
+
+	// Limiter state
+	int lookahead; // frames
+	float releaseCoef;
+	float *delay; // lookahead frames of delayed input (interleaved)
+	int delayPos;
+	int delayFilled;
+	float *history; // last 3 input frames, for the true-peak estimate
+	float *holdValues; // sliding minimum of the required gain
+	long *holdTimes;
+	int holdHead;
+	int holdCount;
+	float envelope;
+	float *boxRing; // box filter smoothing the gain over the lookahead
+	double boxSum;
+	int boxPos;
+	long time;
+} GainStage;
+
+// value is the gain for GAIN_FIXED, and the target peak otherwise
+GainStage *createGainStage(GainMode mode, float value, int numChannels,
+		int sampleRate);
+
+void free_GainStage(GainStage *stage);
+
+// Largest absolute sample value in a buffer
+float findPeak(const float *buffer, long length);
+
+// First pass for GAIN_TWO_PASS: track the peak of a chunk
+void gainStageTrack(GainStage *stage, const float *chunk, int numFrames);
+
+// Apply the gain to numFrames interleaved frames. in and out may be the same
+// buffer. Returns the number of frames written to out.
+int gainStageProcess(GainStage *stage, const float *in, float *out,
+		int numFrames);
+
+// Write any frames still held back by the limiter. Returns the number of
+// frames written to out (at most stage->lookahead).
+int gainStageFlush(GainStage *stage, float *out);
+
+#endif /* GAIN_H_ */
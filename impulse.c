@@ -19,10 +19,12 @@
 #include <ncurses.h>
 #include <sys/resource.h>
 #include <sys/times.h>
+#include <sys/mman.h>
 #include "dawsonaudio.h"
 #include "convolve.h"
 #include "vector.h"
 #include "impulse.h"
+#include "parallel.h"
 
 bool isEmpty(complex *buffer, int size) {
 
@@ -79,175 +81,259 @@ ConvResultData *allocateConvResultDataBuffers(Vector vector) {
 
 }
 
-BlockData *allocateBlockBuffers(Vector vector, audioData *impulse) {
+typedef struct PartitionArgs {
+	audioData *impulse;
+	audioData *previousImpulse; // NULL, or as many channels as impulse
+	FFTData *previousSpectra; // of previousImpulse
+	Vector blockLengths;
+	int64_t *offsets; // first frame of each partition
+	int numPairs; // channels are transformed two at a time
+	FFTData *fftData;
+	complex **scratch; // one per worker thread, as long as the largest block
+} PartitionArgs;
+
+static bool isSilent(const float *samples, int64_t count) {
+	int64_t j;
+	for (j = 0; j < count; j++) {
+		if (samples[j] != 0.0f) {
+			return false;
+		}
+	}
+	return true;
+}
 
-	BlockData* data_ptr = (BlockData*) malloc(sizeof(BlockData));
-	data_ptr->audioBlocks1 = (float**) malloc(sizeof(float*) * vector.size);
-	data_ptr->audioBlocks2 = (float**) malloc(sizeof(float*) * vector.size);
-	data_ptr->size = vector.size;
+/*
+ * Whether a partition of a channel holds the same samples as it did in the
+ * previous impulse (whose spectrum can then be copied). Frames past the end
+ * of either impulse are silent, so impulses of different lengths share the
+ * partitions they have in common: the partitions of a longer impulse begin
+ * with those of a shorter one.
+ */
+static bool isPartitionUnchanged(PartitionArgs *args, int c, int blockNumber,
+		int64_t offset, int64_t count) {
 
-	// If the impulse was mono
-	if (impulse->numChannels == MONO) {
+	if (args->previousImpulse == NULL
+			|| blockNumber >= args->previousSpectra->size) {
+		return false;
+	}
 
-		int i;
-		for (i = 0; i < vector.size; i++) {
-			data_ptr->audioBlocks1[i] = (float*) calloc(vector_get(&vector, i),
-					sizeof(float));
-		}
+	const float *samples = args->impulse->channels[c] + offset;
+	const float *previous = args->previousImpulse->channels[c] + offset;
+	int64_t previousFrames = args->previousImpulse->numFrames;
+	int64_t previousCount = vector_get(&args->blockLengths, blockNumber) / 2;
+	if (offset + previousCount > previousFrames) {
+		previousCount = previousFrames > offset ? previousFrames - offset : 0;
+	}
 
+	int64_t common = count < previousCount ? count : previousCount;
+	if (common > 0 && memcmp(samples, previous, sizeof(float) * common) != 0) {
+		return false;
 	}
+	return count > previousCount ?
+			isSilent(samples + common, count - common) :
+			isSilent(previous + common, previousCount - common);
+}
 
-	// If the impulse was stereo
-	if (impulse->numChannels == STEREO) {
+/*
+ * Transforms one partition of one or two channels. The samples of a second
+ * channel go in the imaginary part, and the two spectra are separated using
+ * their conjugate symmetry:
+ *
+ *   X[k] = (Z[k] + conj(Z[N - k])) / 2,  Y[k] = (Z[k] - conj(Z[N - k])) / 2i
+ */
+static void transformPartition(int taskIndex, int threadIndex, void *arg) {
+
+	PartitionArgs *args = (PartitionArgs *) arg;
+	audioData *impulse = args->impulse;
+	complex ***blocks = args->fftData->fftBlocks;
+	int64_t j;
+	int c, k;
+
+	// The largest (last) partitions first, so the small ones fill in at the end
+	int blockNumber = args->blockLengths.size - 1 - taskIndex / args->numPairs;
+	int firstChannel = (taskIndex % args->numPairs) * 2;
+	int endChannel = firstChannel + 2 < impulse->numChannels ?
+			firstChannel + 2 : impulse->numChannels;
+
+	int blockSize = vector_get(&args->blockLengths, blockNumber);
+	int64_t offset = args->offsets[blockNumber];
+	int64_t count = blockSize / 2;
+	// The last block may run past the end of the impulse
+	if (offset + count > impulse->numFrames) {
+		count = impulse->numFrames > offset ? impulse->numFrames - offset : 0;
+	}
 
-		int i;
-		for (i = 0; i < vector.size; i++) {
-			data_ptr->audioBlocks1[i] = (float*) calloc(vector_get(&vector, i),
-					sizeof(float));
-			data_ptr->audioBlocks2[i] = (float*) calloc(vector_get(&vector, i),
-					sizeof(float));
-		}
+	if (count == 0) {
+		return; // silent; the spectra are already zero
+	}
 
+	// Copy the spectra of the channels whose samples didn't change. Silent
+	// ones (such as the end of a preview) are already zero.
+	int changed[2], numChanged = 0;
+	for (c = firstChannel; c < endChannel; c++) {
+		if (isPartitionUnchanged(args, c, blockNumber, offset, count)) {
+			memcpy(blocks[c][blockNumber],
+					args->previousSpectra->fftBlocks[c][blockNumber],
+					sizeof(complex) * blockSize);
+		} else if (!isSilent(impulse->channels[c] + offset, count)) {
+			changed[numChanged++] = c;
+		}
+	}
+	if (numChanged == 0) {
+		return;
 	}
 
-	return data_ptr;
-}
+	bool paired = numChanged == 2;
+	complex *x = blocks[changed[0]][blockNumber];
+	complex *y = paired ? blocks[changed[1]][blockNumber] : NULL;
 
-void partitionImpulseIntoBlocks(Vector vector, BlockData* data_ptr,
-		audioData* impulse) {
-
-	int blockNumber, sampleIndex;
-	int offset = 0;
-
-	// If impulse is mono
-	if (impulse->numChannels == MONO) {
-
-		// For each block
-		for (blockNumber = 0; blockNumber < vector.size; blockNumber++) {
-			// Copy the appropriate samples from the impulse
-			for (sampleIndex = 0;
-					sampleIndex < vector_get(&vector, blockNumber) / 2;
-					sampleIndex++) {
-				data_ptr->audioBlocks1[blockNumber][sampleIndex] =
-						impulse->buffer1[sampleIndex + offset];
-				//			printf("data_ptr->audioBlocks[%d][%d] = %f, impulse->buffer[%d]\n",
-				//					blockNumber, sampleIndex,
-				//					impulse->buffer[sampleIndex + offset],
-				//					(sampleIndex + offset));
-			}
-			// Increase the offset by the size of the last block added
-			offset += vector_get(&vector, blockNumber) / 2;
+	// The upper half of x (and all of y) are already zero
+	for (j = 0; j < count; j++) {
+		x[j].Re = impulse->channels[changed[0]][offset + j];
+		if (paired) {
+			x[j].Im = impulse->channels[changed[1]][offset + j];
 		}
-
 	}
 
-	// If impulse is stereo
-	if (impulse->numChannels == STEREO) {
-
-		// For each block
-		for (blockNumber = 0; blockNumber < vector.size; blockNumber++) {
-			// Copy the appropriate samples from the impulse
-			for (sampleIndex = 0;
-					sampleIndex < vector_get(&vector, blockNumber) / 2;
-					sampleIndex++) {
+	fft(x, blockSize, args->scratch[threadIndex]);
 
-				// Copy left channel of impulse
-				data_ptr->audioBlocks1[blockNumber][sampleIndex] =
-						impulse->buffer1[sampleIndex + offset];
+	if (paired) {
+		// k only runs over the lower half, so bin N - k is still untouched
+		// when it is read
+		for (k = 0; k <= blockSize / 2; k++) {
+			int m = (blockSize - k) % blockSize;
+			complex zk = x[k], zm = x[m];
 
-				// Copy right channel of impulse
-				data_ptr->audioBlocks2[blockNumber][sampleIndex] =
-						impulse->buffer2[sampleIndex + offset];
+			x[k].Re = (zk.Re + zm.Re) / 2;
+			x[k].Im = (zk.Im - zm.Im) / 2;
+			y[k].Re = (zk.Im + zm.Im) / 2;
+			y[k].Im = (zm.Re - zk.Re) / 2;
 
-			}
-			// Increase the offset by the size of the last block added
-			offset += vector_get(&vector, blockNumber) / 2;
+			x[m].Re = x[k].Re;
+			x[m].Im = -x[k].Im;
+			y[m].Re = y[k].Re;
+			y[m].Im = -y[k].Im;
 		}
-
 	}
+}
 
+FFTData *computePartitionSpectra(audioData *impulse, Vector blockLengths) {
+	return updatePartitionSpectra(impulse, blockLengths, NULL, NULL);
 }
 
-FFTData* allocateFFTBuffers(BlockData* data_ptr, Vector vector,
-		audioData *impulse) {
+FFTData *updatePartitionSpectra(audioData *impulse, Vector blockLengths,
+		audioData *previousImpulse, FFTData *previousSpectra) {
 
-	// Pre-compute ffts of each impulse block
 	FFTData* fftData_ptr = (FFTData*) malloc(sizeof(FFTData));
 
-	fftData_ptr->size = data_ptr->size;
-
-	fftData_ptr->fftBlocks1 = (complex**) malloc(
-			sizeof(complex*) * fftData_ptr->size);
+	fftData_ptr->size = blockLengths.size;
+	fftData_ptr->numChannels = impulse->numChannels;
+	fftData_ptr->mapping = NULL;
+	fftData_ptr->mappingLength = 0;
+	fftData_ptr->users = 0;
 
-	fftData_ptr->fftBlocks2 = (complex**) malloc(
-			sizeof(complex*) * fftData_ptr->size);
+	fftData_ptr->fftBlocks = (complex***) malloc(
+			sizeof(complex**) * impulse->numChannels);
 
-	int i, j;
-	for (i = 0; i < fftData_ptr->size; i++) {
+	int c, i;
+	int maxBlockSize = 0;
 
-		// all blockSizes are already powers of 2
-		fftData_ptr->fftBlocks1[i] = (complex*) malloc(
-				sizeof(complex) * vector_get(&vector, i));
+	for (c = 0; c < impulse->numChannels; c++) {
+		fftData_ptr->fftBlocks[c] = (complex**) malloc(
+				sizeof(complex*) * fftData_ptr->size);
+		for (i = 0; i < fftData_ptr->size; i++) {
+			// all blockSizes are already powers of 2
+			fftData_ptr->fftBlocks[c][i] = (complex*) calloc(
+					vector_get(&blockLengths, i), sizeof(complex));
+		}
+	}
 
-		fftData_ptr->fftBlocks2[i] = (complex*) malloc(
-				sizeof(complex) * vector_get(&vector, i));
+	PartitionArgs args;
+	args.impulse = impulse;
+	// Spectra can only be carried over channel for channel
+	args.previousImpulse = NULL;
+	args.previousSpectra = NULL;
+	if (previousImpulse && previousSpectra
+			&& previousImpulse->numChannels == impulse->numChannels
+			&& previousSpectra->numChannels == impulse->numChannels) {
+		args.previousImpulse = previousImpulse;
+		args.previousSpectra = previousSpectra;
+	}
+	args.blockLengths = blockLengths;
+	args.numPairs = (impulse->numChannels + 1) / 2;
+	args.fftData = fftData_ptr;
+	args.offsets = (int64_t *) malloc(sizeof(int64_t) * blockLengths.size);
+
+	int64_t offset = 0;
+	for (i = 0; i < blockLengths.size; i++) {
+		args.offsets[i] = offset;
+		offset += vector_get(&blockLengths, i) / 2;
+		if (vector_get(&blockLengths, i) > maxBlockSize) {
+			maxBlockSize = vector_get(&blockLengths, i);
+		}
+	}
 
+	int numThreads = getNumWorkerThreads();
+	args.scratch = (complex **) malloc(sizeof(complex *) * numThreads);
+	for (i = 0; i < numThreads; i++) {
+		args.scratch[i] = (complex *) malloc(sizeof(complex) * maxBlockSize);
 	}
 
-	// If the impulse is mono
-	if (impulse->numChannels == MONO) {
+	parallelFor(blockLengths.size * args.numPairs, transformPartition, &args);
 
-		// Actually calculate FFTs
-		complex *temp = NULL;
-		for (i = 0; i < fftData_ptr->size; i++) {
-			temp = calloc(vector_get(&vector, i), sizeof(complex));
-			for (j = 0; j < vector_get(&vector, i); j++) {
-				fftData_ptr->fftBlocks1[i][j].Re = data_ptr->audioBlocks1[i][j];
-			}
-			fft(fftData_ptr->fftBlocks1[i], vector_get(&vector, i), temp);
-		}
+	for (i = 0; i < numThreads; i++) {
+		free(args.scratch[i]);
+	}
+	free(args.scratch);
+	free(args.offsets);
 
-		free(temp);
+	return fftData_ptr;
+}
 
-	}
+void free_FFTData(FFTData *fftData_ptr) {
 
-	// If the impulse is stereo
-	if (impulse->numChannels == STEREO) {
+	int c, i;
 
-		// Actually calculate FFTs
-		complex *temp = NULL;
-		complex *temp2 = NULL;
-		for (i = 0; i < fftData_ptr->size; i++) {
-			temp = calloc(vector_get(&vector, i), sizeof(complex));
-			temp2 = calloc(vector_get(&vector, i), sizeof(complex));
-			for (j = 0; j < vector_get(&vector, i); j++) {
-				fftData_ptr->fftBlocks1[i][j].Re = data_ptr->audioBlocks1[i][j]; // left channel
-				fftData_ptr->fftBlocks2[i][j].Re = data_ptr->audioBlocks2[i][j]; // right channel
+	if (fftData_ptr->mapping) {
+		munmap(fftData_ptr->mapping, fftData_ptr->mappingLength);
+	} else {
+		for (c = 0; c < fftData_ptr->numChannels; c++) {
+			for (i = 0; i < fftData_ptr->size; i++) {
+				free(fftData_ptr->fftBlocks[c][i]);
 			}
-			fft(fftData_ptr->fftBlocks1[i], vector_get(&vector, i), temp);
-			fft(fftData_ptr->fftBlocks2[i], vector_get(&vector, i), temp2);
 		}
+	}
+	for (c = 0; c < fftData_ptr->numChannels; c++) {
+		free(fftData_ptr->fftBlocks[c]);
+	}
+	free(fftData_ptr->fftBlocks);
+	free(fftData_ptr);
+}
 
-		free(temp);
-		free(temp2);
+void acquireFFTData(FFTData *fftData_ptr) {
+	__atomic_add_fetch(&fftData_ptr->users, 1, __ATOMIC_SEQ_CST);
+}
 
-	}
+void releaseFFTData(FFTData *fftData_ptr) {
+	__atomic_sub_fetch(&fftData_ptr->users, 1, __ATOMIC_SEQ_CST);
+}
 
-	return fftData_ptr;
+bool isFFTDataInUse(FFTData *fftData_ptr) {
+	return __atomic_load_n(&fftData_ptr->users, __ATOMIC_SEQ_CST) > 0;
 }
 
-Vector determineBlockLengths(audioData* impulse) {
+Vector determineBlockLengths(audioData* impulse, int blockLength) {
 	Vector vector;
 	vector_init(&vector);
-	int remaining_length = impulse->numFrames;
+	int64_t remaining_length = impulse->numFrames;
 	bool increment = false;
 	// Block 1
-	int blockSize = 2 * MIN_FFT_BLOCK_SIZE;
+	int blockSize = 2 * blockLength;
 	vector_append(&vector, blockSize * 2);
 	remaining_length -= blockSize;
 //	printf("block size: %d\n", blockSize * 2);
 	//	printf("Remaining length: %d\n", length);
-	blockSize = MIN_FFT_BLOCK_SIZE;
+	blockSize = blockLength;
 	// Subsequent blocks
 	while (remaining_length > 0) {
 		remaining_length -= blockSize;
@@ -8,21 +8,18 @@
 #ifndef IMPULSE_H_
 #define IMPULSE_H_
 
-#define SAMPLE_RATE			44100
+#define SAMPLE_RATE			44100 // default engine rate
 #define MONO				1
 #define STEREO				2
-#define MIN_FFT_BLOCK_SIZE	512
-
-typedef struct BlockData {
-	float **audioBlocks1;
-	float **audioBlocks2;
-	int size;
-} BlockData;
+#define MIN_FFT_BLOCK_SIZE	512 // engine block length at 44.1/48 kHz
 
 typedef struct FFTData {
-	complex **fftBlocks1;
-	complex **fftBlocks2;
+	complex ***fftBlocks; // [channel][block]
+	int numChannels;
 	int size;
+	void *mapping; // non-NULL when the blocks point into a mapped file
+	size_t mappingLength;
+	int users; // partitions being convolved with these spectra
 } FFTData;
 
 typedef struct InputAudioData {
@@ -52,13 +49,26 @@ InputAudioData *allocateInputAudioDataBuffers(Vector vector);
 
 ConvResultData *allocateConvResultDataBuffers(Vector vector);
 
-BlockData *allocateBlockBuffers(Vector vector, audioData *impulse);
+// The spectra of the impulse's partitions (each zero-padded to its block
+// length), transformed straight from the impulse across the worker threads
+FFTData *computePartitionSpectra(audioData *impulse, Vector blockLengths);
+
+// The same, copying the spectra of partitions whose samples are the same as
+// in previousImpulse (partitioned for the same block length, with spectra
+// previousSpectra) instead of transforming them again. The impulses may
+// differ in length.
+FFTData *updatePartitionSpectra(audioData *impulse, Vector blockLengths,
+		audioData *previousImpulse, FFTData *previousSpectra);
 
-void partitionImpulseIntoBlocks(Vector vector, BlockData* data_ptr,
-		audioData* impulse);
+void free_FFTData(FFTData *fftData_ptr);
 
-FFTData* allocateFFTBuffers(BlockData* data_ptr, Vector vector, audioData *impulse);
+// Count a user of the spectra (on another thread) in or out. Spectra that
+// were replaced are only rewritten or freed once they have no users.
+void acquireFFTData(FFTData *fftData_ptr);
+void releaseFFTData(FFTData *fftData_ptr);
+bool isFFTDataInUse(FFTData *fftData_ptr);
 
-Vector determineBlockLengths(audioData* impulse);
+// Partition sizes for an engine processing blockLength frames per callback
+Vector determineBlockLengths(audioData* impulse, int blockLength);
 
 #endif /* IMPULSE_H_ */
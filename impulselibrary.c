@@ -0,0 +1,268 @@
+/*
+ * impulselibrary.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include "impulselibrary.h"
+
+void free_PreparedImpulse(PreparedImpulse *prepared) {
+	if (prepared) {
+		free_audioData(prepared->impulse);
+		free_FFTData(prepared->fftData);
+		free(prepared->graphState);
+		free(prepared);
+	}
+}
+
+static bool isAudioFileName(const char *name) {
+	static const char *extensions[] = { ".wav", ".aif", ".aiff", ".flac",
+			".ogg", ".caf" };
+	const char *extension = strrchr(name, '.');
+	size_t i;
+
+	if (extension == NULL || name[0] == '.') {
+		return false;
+	}
+	for (i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++) {
+		if (strcasecmp(extension, extensions[i]) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static int compareImpulseNames(const void *a, const void *b) {
+	return strcmp(((const LibraryImpulse *) a)->name,
+			((const LibraryImpulse *) b)->name);
+}
+
+/*
+ * Frees the least recently used prepared impulses that nobody is using until
+ * the rest fit in the budget. Called with the mutex held; the evicted
+ * impulses are returned in evicted (a NULL-terminated list) to be freed
+ * after the mutex is released.
+ */
+static void evictImpulses(ImpulseLibrary *library, PreparedImpulse **evicted) {
+
+	int i, numEvicted = 0;
+
+	while (library->used > library->budget) {
+		LibraryImpulse *oldest = NULL;
+		for (i = 0; i < library->numImpulses; i++) {
+			LibraryImpulse *impulse = &library->impulses[i];
+			if (impulse->state == LIBRARY_IMPULSE_READY && impulse->users == 0
+					&& (oldest == NULL || impulse->lastUsed < oldest->lastUsed)) {
+				oldest = impulse;
+			}
+		}
+		if (oldest == NULL) {
+			break;
+		}
+		library->used -= oldest->prepared->bytes;
+		evicted[numEvicted++] = oldest->prepared;
+		oldest->prepared = NULL;
+		oldest->state = LIBRARY_IMPULSE_NOT_PREPARED;
+	}
+	evicted[numEvicted] = NULL;
+}
+
+static void *preparationThread(void *arg) {
+
+	ImpulseLibrary *library = (ImpulseLibrary *) arg;
+	int i;
+
+	PreparedImpulse **evicted = (PreparedImpulse **) malloc(
+			sizeof(PreparedImpulse *) * (library->numImpulses + 1));
+
+	pthread_mutex_lock(&library->mutex);
+	while (library->running) {
+
+		// Prepare impulses in the order they were asked for
+		LibraryImpulse *next = NULL;
+		for (i = 0; i < library->numImpulses; i++) {
+			LibraryImpulse *impulse = &library->impulses[i];
+			if (impulse->state == LIBRARY_IMPULSE_QUEUED
+					&& (next == NULL || impulse->queuedAt < next->queuedAt)) {
+				next = impulse;
+			}
+		}
+		if (next == NULL) {
+			pthread_cond_wait(&library->changed, &library->mutex);
+			continue;
+		}
+
+		next->state = LIBRARY_IMPULSE_PREPARING;
+		pthread_mutex_unlock(&library->mutex);
+
+		printf("Preparing %s...\n", next->name);
+		PreparedImpulse *prepared = library->prepare(next->fileName);
+
+		pthread_mutex_lock(&library->mutex);
+		if (prepared) {
+			next->prepared = prepared;
+			next->state = LIBRARY_IMPULSE_READY;
+			next->lastUsed = ++library->clock;
+			library->used += prepared->bytes;
+		} else {
+			next->state = LIBRARY_IMPULSE_FAILED;
+		}
+		evictImpulses(library, evicted);
+		pthread_cond_broadcast(&library->changed);
+
+		if (evicted[0]) {
+			pthread_mutex_unlock(&library->mutex);
+			for (i = 0; evicted[i]; i++) {
+				free_PreparedImpulse(evicted[i]);
+			}
+			pthread_mutex_lock(&library->mutex);
+		}
+	}
+	pthread_mutex_unlock(&library->mutex);
+
+	free(evicted);
+	return NULL;
+}
+
+ImpulseLibrary *openImpulseLibrary(const char *directory, size_t budget,
+		PrepareImpulseFunction prepare) {
+
+	DIR *dir = opendir(directory);
+	if (dir == NULL) {
+		return NULL;
+	}
+
+	ImpulseLibrary *library = (ImpulseLibrary *) calloc(1,
+			sizeof(ImpulseLibrary));
+	library->prepare = prepare;
+	library->budget = budget;
+
+	int capacity = 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (!isAudioFileName(entry->d_name)) {
+			continue;
+		}
+		if (library->numImpulses == capacity) {
+			capacity = capacity ? capacity * 2 : 16;
+			library->impulses = (LibraryImpulse *) realloc(library->impulses,
+					sizeof(LibraryImpulse) * capacity);
+		}
+		LibraryImpulse *impulse = &library->impulses[library->numImpulses++];
+		memset(impulse, 0, sizeof(LibraryImpulse));
+		size_t length = strlen(directory) + strlen(entry->d_name) + 2;
+		impulse->fileName = (char *) malloc(length);
+		snprintf(impulse->fileName, length, "%s/%s", directory, entry->d_name);
+		impulse->name = impulse->fileName + strlen(directory) + 1;
+	}
+	closedir(dir);
+
+	qsort(library->impulses, library->numImpulses, sizeof(LibraryImpulse),
+			compareImpulseNames);
+
+	pthread_mutex_init(&library->mutex, NULL);
+	pthread_cond_init(&library->changed, NULL);
+	library->running = true;
+	if (pthread_create(&library->thread, NULL, preparationThread, library)
+			!= 0) {
+		library->running = false;
+		closeImpulseLibrary(library);
+		return NULL;
+	}
+	return library;
+}
+
+void closeImpulseLibrary(ImpulseLibrary *library) {
+
+	int i;
+
+	pthread_mutex_lock(&library->mutex);
+	bool running = library->running;
+	library->running = false;
+	pthread_cond_broadcast(&library->changed);
+	pthread_mutex_unlock(&library->mutex);
+
+	// An impulse being prepared is finished first
+	if (running) {
+		pthread_join(library->thread, NULL);
+	}
+
+	for (i = 0; i < library->numImpulses; i++) {
+		free_PreparedImpulse(library->impulses[i].prepared);
+		free(library->impulses[i].fileName);
+	}
+	free(library->impulses);
+	pthread_mutex_destroy(&library->mutex);
+	pthread_cond_destroy(&library->changed);
+	free(library);
+}
+
+int findLibraryImpulse(ImpulseLibrary *library, const char *fileName) {
+
+	int i;
+	const char *name = strrchr(fileName, '/');
+	name = name ? name + 1 : fileName;
+
+	for (i = 0; i < library->numImpulses; i++) {
+		if (strcmp(library->impulses[i].name, name) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// Called with the mutex held
+static void queueImpulse(ImpulseLibrary *library, LibraryImpulse *impulse) {
+	if (impulse->state == LIBRARY_IMPULSE_NOT_PREPARED) {
+		impulse->state = LIBRARY_IMPULSE_QUEUED;
+		impulse->queuedAt = ++library->clock;
+		pthread_cond_broadcast(&library->changed);
+	}
+}
+
+void prefetchLibraryImpulse(ImpulseLibrary *library, int index) {
+	pthread_mutex_lock(&library->mutex);
+	queueImpulse(library, &library->impulses[index]);
+	pthread_mutex_unlock(&library->mutex);
+}
+
+PreparedImpulse *acquireLibraryImpulse(ImpulseLibrary *library, int index,
+		bool wait) {
+
+	LibraryImpulse *impulse = &library->impulses[index];
+	PreparedImpulse *prepared = NULL;
+
+	pthread_mutex_lock(&library->mutex);
+	queueImpulse(library, impulse);
+	while (wait && library->running
+			&& (impulse->state == LIBRARY_IMPULSE_QUEUED
+					|| impulse->state == LIBRARY_IMPULSE_PREPARING)) {
+		pthread_cond_wait(&library->changed, &library->mutex);
+	}
+	if (impulse->state == LIBRARY_IMPULSE_READY) {
+		impulse->users++;
+		impulse->lastUsed = ++library->clock;
+		prepared = impulse->prepared;
+	}
+	pthread_mutex_unlock(&library->mutex);
+
+	return prepared;
+}
+
+void releaseLibraryImpulse(ImpulseLibrary *library, int index) {
+
+	LibraryImpulse *impulse = &library->impulses[index];
+
+	pthread_mutex_lock(&library->mutex);
+	if (impulse->users > 0) {
+		impulse->users--;
+	}
+	impulse->lastUsed = ++library->clock;
+	pthread_mutex_unlock(&library->mutex);
+}
@@ -0,0 +1,99 @@
+/*
+ * impulselibrary.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#ifndef IMPULSELIBRARY_H_
+#define IMPULSELIBRARY_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "dawsonaudio.h"
+#include "convolve.h"
+#include "vector.h"
+#include "impulse.h"
+
+/*
+ * An impulse ready for the engine: the synthesized impulse, the spectra of
+ * its partitions, and the graph it was drawn from.
+ */
+typedef struct PreparedImpulse {
+	audioData *impulse;
+	FFTData *fftData;
+	float *graphState;
+	int graphStateLength;
+	uint64_t noiseSeed; // the impulse's noise, for resynthesizing it
+	size_t bytes; // memory held by the impulse and its spectra
+} PreparedImpulse;
+
+void free_PreparedImpulse(PreparedImpulse *prepared);
+
+// Prepares the impulse in a file, or returns NULL if it can't
+typedef PreparedImpulse *(*PrepareImpulseFunction)(const char *fileName);
+
+typedef enum LibraryImpulseState {
+	LIBRARY_IMPULSE_NOT_PREPARED,
+	LIBRARY_IMPULSE_QUEUED,
+	LIBRARY_IMPULSE_PREPARING,
+	LIBRARY_IMPULSE_READY,
+	LIBRARY_IMPULSE_FAILED
+} LibraryImpulseState;
+
+typedef struct LibraryImpulse {
+	char *fileName;
+	const char *name; // fileName without its directory
+	LibraryImpulseState state;
+	PreparedImpulse *prepared;
+	unsigned long queuedAt; // preparation order
+	unsigned long lastUsed; // for evicting the least recently used
+	int users; // acquired and not yet released (never evicted)
+} LibraryImpulse;
+
+/*
+ * The impulses in a directory. They are prepared on demand on a background
+ * thread and kept prepared, least recently used first out, while they fit in
+ * the memory budget, so going back to a room heard recently costs nothing.
+ */
+typedef struct ImpulseLibrary {
+	LibraryImpulse *impulses; // sorted by name
+	int numImpulses;
+	PrepareImpulseFunction prepare;
+
+	size_t budget;
+	size_t used; // bytes held by prepared impulses
+	unsigned long clock;
+
+	bool running;
+	pthread_mutex_t mutex;
+	pthread_cond_t changed;
+	pthread_t thread;
+} ImpulseLibrary;
+
+// Index the audio files in a directory and start the preparation thread.
+// Returns NULL if the directory can't be read.
+ImpulseLibrary *openImpulseLibrary(const char *directory, size_t budget,
+		PrepareImpulseFunction prepare);
+
+// Stop the preparation thread and free every prepared impulse
+void closeImpulseLibrary(ImpulseLibrary *library);
+
+// Index of the impulse in fileName, or -1 if it isn't in the library
+int findLibraryImpulse(ImpulseLibrary *library, const char *fileName);
+
+// Queue an impulse for preparation (if it isn't prepared already)
+void prefetchLibraryImpulse(ImpulseLibrary *library, int index);
+
+// Take an impulse for use, queueing it if it isn't prepared yet. Without
+// wait, returns NULL until it is ready; with wait, blocks until it is ready
+// (or returns NULL if it failed). A taken impulse is never evicted until it
+// is released.
+PreparedImpulse *acquireLibraryImpulse(ImpulseLibrary *library, int index,
+		bool wait);
+
+void releaseLibraryImpulse(ImpulseLibrary *library, int index);
+
+#endif /* IMPULSELIBRARY_H_ */
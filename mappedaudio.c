@@ -0,0 +1,333 @@
+/*
+ * mappedaudio.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mappedaudio.h"
+#include "sampleformat.h"
+
+#define WAVE_FORMAT_PCM			0x0001
+#define WAVE_FORMAT_IEEE_FLOAT	0x0003
+#define WAVE_FORMAT_EXTENSIBLE	0xFFFE
+
+static uint16_t readLE16(const unsigned char *p) {
+	return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+static uint32_t readLE32(const unsigned char *p) {
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16)
+			| ((uint32_t) p[3] << 24);
+}
+
+static uint16_t readBE16(const unsigned char *p) {
+	return (uint16_t) ((p[0] << 8) | p[1]);
+}
+
+static uint32_t readBE32(const unsigned char *p) {
+	return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16)
+			| ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+// AIFF stores its sample rate as an 80-bit IEEE extended float
+static double readExtended(const unsigned char *p) {
+	int exponent = ((p[0] & 0x7F) << 8) | p[1];
+	uint64_t mantissa = ((uint64_t) readBE32(p + 2) << 32) | readBE32(p + 6);
+	if (exponent == 0 && mantissa == 0) {
+		return 0.0;
+	}
+	double value = ldexp((double) mantissa, exponent - 16383 - 63);
+	return (p[0] & 0x80) ? -value : value;
+}
+
+static bool setSampleFormat(MappedAudioFile *file, int bitsPerSample,
+		bool isFloat, bool unsigned8) {
+
+	if (isFloat) {
+		if (bitsPerSample != 32) {
+			return false;
+		}
+		file->sampleFormat = MAPPED_FLOAT_32;
+	} else if (bitsPerSample == 8) {
+		file->sampleFormat = unsigned8 ? MAPPED_PCM_U8 : MAPPED_PCM_S8;
+	} else if (bitsPerSample == 16) {
+		file->sampleFormat = MAPPED_PCM_16;
+	} else if (bitsPerSample == 24) {
+		file->sampleFormat = MAPPED_PCM_24;
+	} else if (bitsPerSample == 32) {
+		file->sampleFormat = MAPPED_PCM_32;
+	} else {
+		return false;
+	}
+	file->bytesPerSample = bitsPerSample / 8;
+	return true;
+}
+
+static bool parseWav(MappedAudioFile *file, const unsigned char *bytes,
+		size_t length) {
+
+	size_t pos = 12;
+	bool haveFormat = false;
+
+	while (pos + 8 <= length) {
+		const unsigned char *chunk = bytes + pos;
+		size_t chunkSize = readLE32(chunk + 4);
+
+		// The fields read below must lie inside the file
+		bool isFormat = memcmp(chunk, "fmt ", 4) == 0;
+		if (isFormat && pos + 8 + chunkSize > length) {
+			return false;
+		}
+
+		if (isFormat && chunkSize >= 16) {
+			int formatTag = readLE16(chunk + 8);
+			file->numChannels = readLE16(chunk + 10);
+			if (file->numChannels < 1) {
+				return false;
+			}
+			file->sampleRate = (int) readLE32(chunk + 12);
+			int bitsPerSample = readLE16(chunk + 22);
+			// The sub-format GUID of an extensible header starts with the tag
+			if (formatTag == WAVE_FORMAT_EXTENSIBLE && chunkSize >= 40) {
+				formatTag = readLE16(chunk + 32);
+			}
+			if (formatTag != WAVE_FORMAT_PCM
+					&& formatTag != WAVE_FORMAT_IEEE_FLOAT) {
+				return false;
+			}
+			if (!setSampleFormat(file, bitsPerSample,
+					formatTag == WAVE_FORMAT_IEEE_FLOAT, true)) {
+				return false;
+			}
+			haveFormat = true;
+		} else if (memcmp(chunk, "data", 4) == 0 && haveFormat) {
+			if (pos + 8 + chunkSize > length) {
+				chunkSize = length - pos - 8;
+			}
+			file->bigEndian = false;
+			file->frameStride = (size_t) file->numChannels * file->bytesPerSample;
+			file->data = chunk + 8;
+			file->numFrames = (long) (chunkSize / file->frameStride);
+			return true;
+		}
+
+		// Chunks are padded to an even length
+		pos += 8 + chunkSize + (chunkSize & 1);
+	}
+	return false;
+}
+
+static bool parseAiff(MappedAudioFile *file, const unsigned char *bytes,
+		size_t length, bool isAifc) {
+
+	size_t pos = 12;
+	bool haveFormat = false;
+	bool littleEndian = false;
+	bool isFloat = false;
+
+	while (pos + 8 <= length) {
+		const unsigned char *chunk = bytes + pos;
+		size_t chunkSize = readBE32(chunk + 4);
+
+		// The fields read below must lie inside the file
+		bool isFormat = memcmp(chunk, "COMM", 4) == 0;
+		bool isSound = memcmp(chunk, "SSND", 4) == 0;
+		if ((isFormat || isSound) && pos + 8 + chunkSize > length) {
+			return false;
+		}
+
+		if (isFormat && chunkSize >= 18) {
+			file->numChannels = readBE16(chunk + 8);
+			file->numFrames = readBE32(chunk + 10);
+			int bitsPerSample = readBE16(chunk + 14);
+			file->sampleRate = (int) readExtended(chunk + 16);
+			if (isAifc && chunkSize >= 22) {
+				const unsigned char *compression = chunk + 26;
+				if (memcmp(compression, "sowt", 4) == 0) {
+					littleEndian = true;
+				} else if (memcmp(compression, "fl32", 4) == 0
+						|| memcmp(compression, "FL32", 4) == 0) {
+					isFloat = true;
+				} else if (memcmp(compression, "NONE", 4) != 0) {
+					return false;
+				}
+			}
+			if (!setSampleFormat(file, bitsPerSample, isFloat, false)) {
+				return false;
+			}
+			haveFormat = true;
+		} else if (isSound && haveFormat && chunkSize >= 8) {
+			size_t offset = readBE32(chunk + 8);
+			if (pos + 16 + offset > length || file->numChannels <= 0) {
+				return false;
+			}
+			file->bigEndian = !littleEndian;
+			file->frameStride = (size_t) file->numChannels * file->bytesPerSample;
+			file->data = chunk + 16 + offset;
+			size_t available = length - (size_t) (file->data - bytes);
+			if ((size_t) file->numFrames * file->frameStride > available) {
+				file->numFrames = (long) (available / file->frameStride);
+			}
+			return true;
+		}
+
+		pos += 8 + chunkSize + (chunkSize & 1);
+	}
+	return false;
+}
+
+MappedAudioFile *openMappedAudioFile(const char *fileName) {
+
+	int fd = open(fileName, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size < 12) {
+		close(fd);
+		return NULL;
+	}
+
+	size_t length = (size_t) info.st_size;
+	void *mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		return NULL;
+	}
+
+	MappedAudioFile *file = (MappedAudioFile *) calloc(1,
+			sizeof(MappedAudioFile));
+	file->mapping = mapping;
+	file->mappingLength = length;
+
+	const unsigned char *bytes = (const unsigned char *) mapping;
+	bool parsed = false;
+	if (memcmp(bytes, "RIFF", 4) == 0 && memcmp(bytes + 8, "WAVE", 4) == 0) {
+		parsed = parseWav(file, bytes, length);
+	} else if (memcmp(bytes, "FORM", 4) == 0
+			&& (memcmp(bytes + 8, "AIFF", 4) == 0
+					|| memcmp(bytes + 8, "AIFC", 4) == 0)) {
+		parsed = parseAiff(file, bytes, length, memcmp(bytes + 8, "AIFC", 4) == 0);
+	}
+
+	if (!parsed || file->numChannels < 1 || file->numFrames < 0) {
+		closeMappedAudioFile(file);
+		return NULL;
+	}
+
+	// Blocks are usually converted front to back
+	madvise(mapping, length, MADV_SEQUENTIAL);
+
+	return file;
+}
+
+void closeMappedAudioFile(MappedAudioFile *file) {
+	if (file) {
+		munmap(file->mapping, file->mappingLength);
+		free(file);
+	}
+}
+
+static bool isNativeBigEndian() {
+	const uint16_t probe = 1;
+	return *(const unsigned char *) &probe == 0;
+}
+
+static float convertSample(const MappedAudioFile *file, const unsigned char *p) {
+
+	uint32_t bits;
+	int32_t value;
+
+	switch (file->sampleFormat) {
+	case MAPPED_PCM_U8:
+		return ((int) p[0] - 128) / 128.0f;
+	case MAPPED_PCM_S8:
+		return (signed char) p[0] / 128.0f;
+	case MAPPED_PCM_16:
+		value = (int16_t) (file->bigEndian ? readBE16(p) : readLE16(p));
+		return value / 32768.0f;
+	case MAPPED_PCM_24:
+		bits = file->bigEndian ?
+				((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) :
+				((uint32_t) p[2] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[0] << 8);
+		return (int32_t) bits / 2147483648.0f;
+	case MAPPED_PCM_32:
+		value = (int32_t) (file->bigEndian ? readBE32(p) : readLE32(p));
+		return value / 2147483648.0f;
+	case MAPPED_FLOAT_32: {
+		float f;
+		bits = file->bigEndian ? readBE32(p) : readLE32(p);
+		memcpy(&f, &bits, sizeof(float));
+		return f;
+	}
+	}
+	return 0.0f;
+}
+
+static long clampBlock(const MappedAudioFile *file, long firstFrame,
+		long numFrames) {
+	if (firstFrame >= file->numFrames) {
+		return 0;
+	}
+	if (firstFrame + numFrames > file->numFrames) {
+		numFrames = file->numFrames - firstFrame;
+	}
+	return numFrames;
+}
+
+long readInterleavedBlock(MappedAudioFile *file, long firstFrame,
+		long numFrames, float *out) {
+
+	long i, length;
+	int c;
+
+	numFrames = clampBlock(file, firstFrame, numFrames);
+	length = numFrames * file->numChannels;
+
+	const unsigned char *p = file->data + firstFrame * file->frameStride;
+
+	// Little-endian data on a little-endian host goes through the vector
+	// kernels (frames are always packed, one sample per channel, in files
+	// this parser accepts); everything else is converted one sample at a time
+	if (!file->bigEndian && !isNativeBigEndian()) {
+		switch (file->sampleFormat) {
+		case MAPPED_PCM_16:
+			int16ToFloat((const int16_t *) p, out, length);
+			return numFrames;
+		case MAPPED_PCM_24:
+			int24ToFloat(p, out, length);
+			return numFrames;
+		case MAPPED_PCM_32:
+			int32ToFloat((const int32_t *) p, out, length);
+			return numFrames;
+		case MAPPED_FLOAT_32:
+			memcpy(out, p, sizeof(float) * length);
+			return numFrames;
+		default:
+			break;
+		}
+	} else if (file->bigEndian && !isNativeBigEndian()
+			&& file->sampleFormat == MAPPED_FLOAT_32) {
+		swapFloat32ToFloat(p, out, length);
+		return numFrames;
+	}
+
+	for (i = 0; i < numFrames; i++) {
+		for (c = 0; c < file->numChannels; c++) {
+			*out++ = convertSample(file, p + (size_t) c * file->bytesPerSample);
+		}
+		p += file->frameStride;
+	}
+	return numFrames;
+}
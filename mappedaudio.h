@@ -0,0 +1,52 @@
+/*
+ * mappedaudio.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#ifndef MAPPEDAUDIO_H_
+#define MAPPEDAUDIO_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Sample encodings that can be read straight out of a mapped file
+typedef enum MappedSampleFormat {
+	MAPPED_PCM_U8, // unsigned 8-bit (WAV)
+	MAPPED_PCM_S8, // signed 8-bit (AIFF)
+	MAPPED_PCM_16,
+	MAPPED_PCM_24,
+	MAPPED_PCM_32,
+	MAPPED_FLOAT_32
+} MappedSampleFormat;
+
+/*
+ * An uncompressed WAV or AIFF file mapped into memory. Nothing is read until
+ * a block of it is asked for, so pages are faulted in on demand.
+ */
+typedef struct MappedAudioFile {
+	int numChannels;
+	long numFrames;
+	int sampleRate;
+	MappedSampleFormat sampleFormat;
+	int bytesPerSample;
+	bool bigEndian;
+	size_t frameStride; // bytes between consecutive frames
+	const unsigned char *data; // first sample of the first frame
+	void *mapping;
+	size_t mappingLength;
+} MappedAudioFile;
+
+// Map a file, or return NULL if it is not an uncompressed WAV/AIFF file
+// (callers should fall back to libsndfile)
+MappedAudioFile *openMappedAudioFile(const char *fileName);
+
+void closeMappedAudioFile(MappedAudioFile *file);
+
+// Convert frames [firstFrame, firstFrame + numFrames) of every channel to
+// interleaved float. Returns the number of frames written to out.
+long readInterleavedBlock(MappedAudioFile *file, long firstFrame,
+		long numFrames, float *out);
+
+#endif /* MAPPEDAUDIO_H_ */
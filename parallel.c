@@ -0,0 +1,110 @@
+/*
+ * parallel.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "parallel.h"
+
+typedef struct ParallelJob {
+	ParallelTask task;
+	void *arg;
+	int numTasks;
+	int nextTask;
+	pthread_mutex_t mutex;
+} ParallelJob;
+
+typedef struct ParallelWorker {
+	ParallelJob *job;
+	int threadIndex;
+} ParallelWorker;
+
+int getNumWorkerThreads() {
+	long numCores = sysconf(_SC_NPROCESSORS_ONLN);
+	if (numCores < 1) {
+		numCores = 1;
+	}
+	return (int) numCores;
+}
+
+/*
+ * Each worker keeps pulling the next unclaimed task index until there are
+ * none left, so uneven task lengths still balance across cores.
+ */
+static void *parallelWorker(void *incomingWorker) {
+
+	ParallelWorker *worker = (ParallelWorker *) incomingWorker;
+	ParallelJob *job = worker->job;
+
+	while (1) {
+		pthread_mutex_lock(&job->mutex);
+		int taskIndex = job->nextTask++;
+		pthread_mutex_unlock(&job->mutex);
+
+		if (taskIndex >= job->numTasks) {
+			break;
+		}
+		job->task(taskIndex, worker->threadIndex, job->arg);
+	}
+
+	return NULL;
+}
+
+void parallelFor(int numTasks, ParallelTask task, void *arg) {
+
+	int i;
+
+	if (numTasks <= 0) {
+		return;
+	}
+
+	int numThreads = getNumWorkerThreads();
+	if (numThreads > numTasks) {
+		numThreads = numTasks;
+	}
+
+	// Nothing to gain from spawning threads
+	if (numThreads == 1) {
+		for (i = 0; i < numTasks; i++) {
+			task(i, 0, arg);
+		}
+		return;
+	}
+
+	ParallelJob job;
+	job.task = task;
+	job.arg = arg;
+	job.numTasks = numTasks;
+	job.nextTask = 0;
+	pthread_mutex_init(&job.mutex, NULL);
+
+	pthread_t *threads = (pthread_t *) malloc(sizeof(pthread_t) * numThreads);
+	ParallelWorker *workers = (ParallelWorker *) malloc(
+			sizeof(ParallelWorker) * numThreads);
+
+	// The calling thread acts as worker 0
+	for (i = 1; i < numThreads; i++) {
+		workers[i].job = &job;
+		workers[i].threadIndex = i;
+		if (pthread_create(&threads[i], NULL, parallelWorker, &workers[i]) != 0) {
+			printf("Error: could not create worker thread\n");
+			exit(1);
+		}
+	}
+	workers[0].job = &job;
+	workers[0].threadIndex = 0;
+	parallelWorker(&workers[0]);
+
+	for (i = 1; i < numThreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	pthread_mutex_destroy(&job.mutex);
+	free(threads);
+	free(workers);
+}
@@ -0,0 +1,26 @@
+/*
+ * parallel.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+/*
+ * A unit of work run by parallelFor(). taskIndex is the index of the task
+ * (0 to numTasks - 1), and threadIndex identifies the worker running it
+ * (0 to getNumWorkerThreads() - 1) so that callers can hand out per-thread
+ * scratch buffers.
+ */
+typedef void (*ParallelTask)(int taskIndex, int threadIndex, void *arg);
+
+// Number of worker threads used by parallelFor (one per online core)
+int getNumWorkerThreads();
+
+// Run task(i) for every i in [0, numTasks) across the worker threads and
+// return once all of them have completed
+void parallelFor(int numTasks, ParallelTask task, void *arg);
+
+#endif /* PARALLEL_H_ */
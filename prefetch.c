@@ -0,0 +1,305 @@
+/*
+ * prefetch.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "prefetch.h"
+#include "sampleformat.h"
+
+#define NANOSECONDS_IN_A_SECOND		1000000000L
+
+// How often a reader with a full ring checks for a free slot, in fractions
+// of a block's duration
+#define CHECKS_PER_BLOCK			4
+
+static unsigned int loadCount(unsigned int *count) {
+	return __atomic_load_n(count, __ATOMIC_ACQUIRE);
+}
+
+static void storeCount(unsigned int *count, unsigned int value) {
+	__atomic_store_n(count, value, __ATOMIC_RELEASE);
+}
+
+// Reads up to numFrames frames in the file's layout. Returns the number read.
+static long readFrames(PrefetchReader *reader, float *out, long numFrames) {
+	if (reader->mapped) {
+		long count = readInterleavedBlock(reader->mapped,
+				reader->mappedPosition, numFrames, out);
+		reader->mappedPosition += count;
+		return count;
+	}
+	return sf_readf_float(reader->file, out, numFrames);
+}
+
+static bool rewindFile(PrefetchReader *reader) {
+	if (reader->mapped) {
+		reader->mappedPosition = 0;
+		return true;
+	}
+	return sf_seek(reader->file, 0, SEEK_SET) >= 0;
+}
+
+/*
+ * Reads one block in the file's layout, wrapping to the start when looping.
+ * Anything past the end of a non-looping file is silence. Returns false once
+ * there is nothing left to read.
+ */
+static bool decodeBlock(PrefetchReader *reader) {
+
+	int numFileChannels = reader->numFileChannels;
+	bool wrapped = false;
+	long total = 0;
+
+	while (total < reader->blockFrames) {
+		long count = readFrames(reader,
+				reader->decodeBuffer + total * numFileChannels,
+				reader->blockFrames - total);
+		if (count > 0) {
+			total += count;
+			wrapped = false;
+			continue;
+		}
+		// End of file. Stop if not looping, or if the file has no frames at
+		// all and wrapping would read nothing again.
+		if (!reader->loop || wrapped || !rewindFile(reader)) {
+			break;
+		}
+		wrapped = true;
+	}
+
+	if (total == 0) {
+		return false;
+	}
+	memset(reader->decodeBuffer + total * numFileChannels, 0,
+			sizeof(float) * (reader->blockFrames - total) * numFileChannels);
+	return true;
+}
+
+/*
+ * Decodes the next block, converts it to the delivered channels and rate, and
+ * appends it to the pending frames. At the end of the file the resampler's
+ * tail is flushed instead.
+ */
+static void convertBlock(PrefetchReader *reader) {
+
+	int c;
+	float *pending[reader->numChannels];
+
+	for (c = 0; c < reader->numChannels; c++) {
+		pending[c] = reader->pending[c] + reader->pendingFrames;
+	}
+
+	if (!decodeBlock(reader)) {
+		reader->ended = true;
+		reader->pendingFrames += resamplerFlush(reader->resampler, pending);
+		return;
+	}
+
+	if (reader->numChannels == reader->numFileChannels) {
+		deinterleave(reader->decodeBuffer, reader->planar, reader->numChannels,
+				reader->blockFrames);
+	} else {
+		downmixToMono(reader->decodeBuffer, reader->planar[0],
+				reader->numFileChannels, reader->blockFrames);
+	}
+	reader->pendingFrames += resamplerProcess(reader->resampler,
+			reader->planar, reader->blockFrames, pending);
+}
+
+// Moves one block of pending frames into a slot (padding the last one with
+// silence)
+static void takePending(PrefetchReader *reader, float *slot) {
+
+	int c;
+	long count = reader->pendingFrames < reader->blockFrames ?
+			reader->pendingFrames : reader->blockFrames;
+
+	for (c = 0; c < reader->numChannels; c++) {
+		memset(reader->pending[c] + count, 0,
+				sizeof(float) * (reader->blockFrames - count));
+	}
+	interleave(reader->pending, slot, reader->numChannels, reader->blockFrames);
+
+	reader->pendingFrames -= count;
+	for (c = 0; c < reader->numChannels; c++) {
+		memmove(reader->pending[c], reader->pending[c] + count,
+				sizeof(float) * reader->pendingFrames);
+	}
+}
+
+static void *prefetchThread(void *arg) {
+
+	PrefetchReader *reader = (PrefetchReader *) arg;
+
+	struct timespec poll = { 0, (long) ((double) NANOSECONDS_IN_A_SECOND
+			* reader->blockFrames / reader->sampleRate / CHECKS_PER_BLOCK) };
+
+	while (reader->running) {
+
+		// Convert until a whole block is ready
+		if (reader->resampler) {
+			if (reader->pendingFrames < reader->blockFrames && !reader->ended) {
+				convertBlock(reader);
+				continue;
+			}
+			if (reader->pendingFrames == 0) {
+				break;
+			}
+		}
+
+		unsigned int writeCount = reader->writeCount;
+
+		// Wait for the consumer to release a slot
+		if (writeCount - loadCount(&reader->readCount)
+				>= (unsigned int) reader->numSlots) {
+			nanosleep(&poll, NULL);
+			continue;
+		}
+
+		float *slot = reader->slots[writeCount % reader->numSlots];
+		if (reader->resampler) {
+			takePending(reader, slot);
+		} else if (!decodeBlock(reader)) {
+			break;
+		} else if (reader->numChannels == reader->numFileChannels) {
+			memcpy(slot, reader->decodeBuffer,
+					sizeof(float) * reader->blockFrames * reader->numChannels);
+		} else {
+			downmixToMono(reader->decodeBuffer, slot, reader->numFileChannels,
+					reader->blockFrames);
+		}
+
+		// Publish the block
+		storeCount(&reader->writeCount, writeCount + 1);
+	}
+
+	return NULL;
+}
+
+PrefetchReader *openPrefetchReader(const char *fileName, int blockFrames,
+		int readAheadBlocks, int sampleRate, bool downmix, bool loop) {
+
+	SF_INFO fileInfo;
+	int i;
+
+	// Uncompressed files are read in place; libsndfile decodes the rest
+	memset(&fileInfo, 0, sizeof(SF_INFO));
+	SNDFILE *file = NULL;
+	MappedAudioFile *mapped = openMappedAudioFile(fileName);
+	if (mapped) {
+		fileInfo.samplerate = mapped->sampleRate;
+		fileInfo.channels = mapped->numChannels;
+	} else {
+		file = sf_open(fileName, SFM_READ, &fileInfo);
+		if (file == NULL) {
+			return NULL;
+		}
+	}
+
+	PrefetchReader *reader = (PrefetchReader *) calloc(1,
+			sizeof(PrefetchReader));
+	reader->file = file;
+	reader->mapped = mapped;
+	reader->fileRate = fileInfo.samplerate;
+	reader->sampleRate = sampleRate;
+	reader->numFileChannels = fileInfo.channels;
+	reader->numChannels = downmix ? 1 : fileInfo.channels;
+	reader->blockFrames = blockFrames;
+	reader->loop = loop;
+
+	reader->numSlots = (readAheadBlocks > 0 ? readAheadBlocks : 1) + 1;
+	reader->slots = (float **) malloc(sizeof(float *) * reader->numSlots);
+	for (i = 0; i < reader->numSlots; i++) {
+		reader->slots[i] = (float *) calloc(blockFrames * reader->numChannels,
+				sizeof(float));
+	}
+	reader->decodeBuffer = (float *) malloc(
+			sizeof(float) * blockFrames * reader->numFileChannels);
+
+	if (reader->fileRate != sampleRate) {
+		Resampler *resampler = createResampler(reader->fileRate, sampleRate,
+				reader->numChannels);
+		// Leftover frames, plus the most that one block (or the flush) produces
+		long capacity = blockFrames
+				+ (long) ((int64_t) (2 * resampler->numTaps + blockFrames)
+						* resampler->upFactor / resampler->downFactor) + 2;
+		reader->resampler = resampler;
+		reader->planar = (float **) malloc(sizeof(float *) * reader->numChannels);
+		reader->pending = (float **) malloc(
+				sizeof(float *) * reader->numChannels);
+		for (i = 0; i < reader->numChannels; i++) {
+			reader->planar[i] = (float *) malloc(sizeof(float) * blockFrames);
+			reader->pending[i] = (float *) malloc(sizeof(float) * capacity);
+		}
+	}
+
+	reader->running = true;
+	if (pthread_create(&reader->thread, NULL, prefetchThread, reader) != 0) {
+		reader->running = false;
+		closePrefetchReader(reader);
+		return NULL;
+	}
+
+	return reader;
+}
+
+const float *prefetchReaderPop(PrefetchReader *reader) {
+
+	unsigned int readCount = reader->readCount;
+
+	// Hand the previous block back to the reader thread
+	if (reader->holding) {
+		readCount++;
+		storeCount(&reader->readCount, readCount);
+		reader->holding = false;
+	}
+
+	if (loadCount(&reader->writeCount) == readCount) {
+		reader->underruns++;
+		return NULL;
+	}
+
+	reader->holding = true;
+	return reader->slots[readCount % reader->numSlots];
+}
+
+void closePrefetchReader(PrefetchReader *reader) {
+
+	int i;
+
+	if (!reader) {
+		return;
+	}
+
+	if (reader->running) {
+		reader->running = false;
+		pthread_join(reader->thread, NULL);
+	}
+
+	if (reader->mapped) {
+		closeMappedAudioFile(reader->mapped);
+	} else {
+		sf_close(reader->file);
+	}
+	for (i = 0; i < reader->numSlots; i++) {
+		free(reader->slots[i]);
+	}
+	free(reader->slots);
+	free(reader->decodeBuffer);
+	if (reader->resampler) {
+		for (i = 0; i < reader->numChannels; i++) {
+			free(reader->planar[i]);
+			free(reader->pending[i]);
+		}
+		free(reader->planar);
+		free(reader->pending);
+		free_Resampler(reader->resampler);
+	}
+	free(reader);
+}
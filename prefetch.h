@@ -0,0 +1,72 @@
+/*
+ * prefetch.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#ifndef PREFETCH_H_
+#define PREFETCH_H_
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <sndfile.h>
+#include "resample.h"
+#include "mappedaudio.h"
+
+/*
+ * Decodes an audio file ahead of playback on its own thread. Blocks of
+ * blockFrames frames go into a single-producer, single-consumer ring, so the
+ * audio callback only ever takes a pointer to a block that is already
+ * decoded; it never touches the file or waits on a lock. Files at another
+ * rate are resampled on the reader's thread as well. Uncompressed WAV/AIFF
+ * files are mapped and converted a block at a time, so only the part being
+ * played is ever read from disk.
+ */
+typedef struct PrefetchReader {
+	SNDFILE *file; // NULL when the file is mapped
+	MappedAudioFile *mapped;
+	long mappedPosition; // next frame to convert from mapped
+	int fileRate;
+	int sampleRate; // rate of delivered blocks
+	int numFileChannels;
+	int numChannels; // channels per delivered block (1 when downmixing)
+	int blockFrames;
+	bool loop; // seek back to the start at the end of the file
+
+	int numSlots; // read-ahead depth + the block held by the consumer
+	float **slots; // interleaved blocks
+	float *decodeBuffer; // one block in the file's layout
+
+	// Rate conversion (resampler is NULL when the file is at sampleRate)
+	Resampler *resampler;
+	float **planar; // one decoded block per delivered channel
+	float **pending; // converted frames not yet in a slot
+	long pendingFrames;
+	bool ended;
+
+	unsigned int writeCount; // blocks produced (written by the reader thread)
+	unsigned int readCount; // blocks released (written by the consumer)
+	bool holding; // the consumer still holds slot readCount
+	unsigned int underruns;
+
+	volatile bool running;
+	pthread_t thread;
+} PrefetchReader;
+
+// Open a file and start decoding readAheadBlocks blocks ahead, converted to
+// sampleRate. With downmix set, blocks are delivered as mono. Returns NULL if
+// the file can't be opened.
+PrefetchReader *openPrefetchReader(const char *fileName, int blockFrames,
+		int readAheadBlocks, int sampleRate, bool downmix, bool loop);
+
+// Take the next decoded block (blockFrames * numChannels interleaved samples),
+// which stays valid until the next call. Returns NULL, and counts an
+// underrun, if the reader has fallen behind or reached the end of the file.
+// Safe to call from the audio callback.
+const float *prefetchReaderPop(PrefetchReader *reader);
+
+// Stop the reader thread and close (or unmap) the file
+void closePrefetchReader(PrefetchReader *reader);
+
+#endif /* PREFETCH_H_ */
@@ -0,0 +1,124 @@
+/*
+ * prng.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#include <math.h>
+#include "prng.h"
+
+// Steps a splitmix64 sequence; used to spread seeds over generator states
+static uint64_t splitmix64(uint64_t *x) {
+	uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+uint64_t getNoiseSeed(uint64_t impulseSeed, int channel, int block) {
+	uint64_t x = impulseSeed;
+	x = splitmix64(&x) + (uint64_t) channel;
+	x = splitmix64(&x) + (uint64_t) block;
+	return splitmix64(&x);
+}
+
+void seedNoiseGenerator(NoiseGenerator *generator, uint64_t seed) {
+	int i, lane;
+	for (lane = 0; lane < SIMD_WIDTH; lane++) {
+		for (i = 0; i < 4; i += 2) {
+			uint64_t z = splitmix64(&seed);
+			generator->s[i][lane] = (unsigned int) z;
+			generator->s[i + 1][lane] = (unsigned int) (z >> 32);
+		}
+	}
+	// An all-zero state would only ever produce zeros
+	for (lane = 0; lane < SIMD_WIDTH; lane++) {
+		if ((generator->s[0][lane] | generator->s[1][lane]
+				| generator->s[2][lane] | generator->s[3][lane]) == 0) {
+			generator->s[0][lane] = 1;
+		}
+	}
+}
+
+static inline v4su rotateLeft(v4su x, int k) {
+	return (x << k) | (x >> (32 - k));
+}
+
+// Next four outputs (xoshiro128+)
+static inline v4su nextOutputs(NoiseGenerator *generator) {
+	v4su *s = generator->s;
+	v4su result = s[0] + s[3];
+	v4su t = s[1] << 9;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotateLeft(s[3], 11);
+
+	return result;
+}
+
+/*
+ * The top 23 bits of each output become the mantissa of a float in [1, 2),
+ * which is then mapped onto (0, 1] so the samples can be logged. (The low
+ * bits of xoshiro128+ are its weakest, so they are the ones dropped.)
+ */
+static inline v4sf toUnitSamples(v4su bits) {
+	v4sf unit = (v4sf) ((bits >> 9) | 0x3f800000);
+	return 2.0f - unit;
+}
+
+void generateUnitNoise(NoiseGenerator *generator, float *out, int numSamples) {
+
+	int i;
+
+	for (i = 0; i + SIMD_WIDTH <= numSamples; i += SIMD_WIDTH) {
+		v4sf_store(out + i, toUnitSamples(nextOutputs(generator)));
+	}
+	if (i < numSamples) {
+		float tail[SIMD_WIDTH];
+		v4sf_store(tail, toUnitSamples(nextOutputs(generator)));
+		for (int j = 0; i < numSamples; i++, j++) {
+			out[i] = tail[j];
+		}
+	}
+}
+
+/*
+ * Each of the fftSize uniform samples (variance 1/3) adds to the real and
+ * imaginary parts of every bin, so a bin's real and imaginary parts are
+ * (near enough) independent Gaussians of variance fftSize / 6; the DC and
+ * Nyquist bins are real, of variance fftSize / 3. A pair of independent
+ * Gaussians of variance s^2 is a magnitude s * sqrt(-2 ln u1) at a phase
+ * 2 pi u2 (Box-Muller).
+ */
+void generateNoiseSpectrum(NoiseGenerator *generator, complex *bins,
+		int fftSize, float *scratch) {
+
+	int k;
+	int half = fftSize / 2;
+	float *u = scratch; // two per bin from 0 to half
+
+	generateUnitNoise(generator, u, 2 * (half + 1));
+
+	float variance = (float) fftSize / 6.0f;
+	for (k = 1; k < half; k++) {
+		float magnitude = sqrtf(-2.0f * variance * logf(u[2 * k]));
+		float phase = 2.0f * (float) M_PI * u[2 * k + 1];
+		bins[k].Re = magnitude * cosf(phase);
+		bins[k].Im = magnitude * sinf(phase);
+		bins[fftSize - k].Re = bins[k].Re;
+		bins[fftSize - k].Im = -bins[k].Im;
+	}
+
+	// Real bins, of twice the variance
+	bins[0].Re = sqrtf(-4.0f * variance * logf(u[0]))
+			* cosf(2.0f * (float) M_PI * u[1]);
+	bins[0].Im = 0.0f;
+	bins[half].Re = sqrtf(-4.0f * variance * logf(u[2 * half]))
+			* cosf(2.0f * (float) M_PI * u[2 * half + 1]);
+	bins[half].Im = 0.0f;
+}
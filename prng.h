@@ -0,0 +1,41 @@
+/*
+ * prng.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#ifndef PRNG_H_
+#define PRNG_H_
+
+#include <stdint.h>
+#include "simd.h"
+#include "convolve.h"
+
+/*
+ * Four xoshiro128+ generators, one per vector lane, producing uniform random
+ * samples four at a time. A generator is seeded from a 64-bit value, so the
+ * noise of each (impulse, channel, block) can be seeded on its own: blocks
+ * can then be generated in any order, on any thread, and come out the same
+ * every time.
+ */
+typedef struct NoiseGenerator {
+	v4su s[4];
+} NoiseGenerator;
+
+// Seed for one block of one channel of the noise of an impulse
+uint64_t getNoiseSeed(uint64_t impulseSeed, int channel, int block);
+
+void seedNoiseGenerator(NoiseGenerator *generator, uint64_t seed);
+
+// Fill out with numSamples uniform samples in (0, 1]
+void generateUnitNoise(NoiseGenerator *generator, float *out, int numSamples);
+
+// Fill bins with the spectrum (as fft() would compute it) of fftSize samples
+// of white noise uniform in [-1, 1): Rayleigh-distributed magnitudes and
+// uniform phases, Hermitian-symmetric like the spectrum of any real signal.
+// scratch holds fftSize + 2 floats.
+void generateNoiseSpectrum(NoiseGenerator *generator, complex *bins,
+		int fftSize, float *scratch);
+
+#endif /* PRNG_H_ */
@@ -0,0 +1,141 @@
+/*
+ * refiner.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Dawson
+ */
+
+#include <stdlib.h>
+#include "refiner.h"
+
+static struct timespec addMilliseconds(struct timespec time, int ms) {
+	time.tv_sec += ms / 1000;
+	time.tv_nsec += (long) (ms % 1000) * 1000000L;
+	if (time.tv_nsec >= 1000000000L) {
+		time.tv_sec++;
+		time.tv_nsec -= 1000000000L;
+	}
+	return time;
+}
+
+static bool isBefore(struct timespec a, struct timespec b) {
+	return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec);
+}
+
+static void *refinerThread(void *arg) {
+
+	Refiner *refiner = (Refiner *) arg;
+
+	pthread_mutex_lock(&refiner->mutex);
+	while (refiner->running) {
+
+		if (refiner->pending == NULL) {
+			pthread_cond_wait(&refiner->changed, &refiner->mutex);
+			continue;
+		}
+
+		// Wait for the posts to stop; each one moves the start back
+		struct timespec now, start = addMilliseconds(refiner->postedAt,
+				refiner->delay);
+		clock_gettime(CLOCK_REALTIME, &now);
+		if (isBefore(now, start)) {
+			pthread_cond_timedwait(&refiner->changed, &refiner->mutex, &start);
+			continue;
+		}
+
+		void *job = refiner->pending;
+		unsigned long postCount = refiner->postCount;
+		refiner->pending = NULL;
+		pthread_mutex_unlock(&refiner->mutex);
+
+		refiner->refine(job);
+
+		pthread_mutex_lock(&refiner->mutex);
+		void *stale = job;
+		if (refiner->postCount == postCount) {
+			stale = refiner->finished;
+			refiner->finished = job;
+		}
+		if (stale) {
+			pthread_mutex_unlock(&refiner->mutex);
+			refiner->freeJob(stale);
+			pthread_mutex_lock(&refiner->mutex);
+		}
+	}
+	pthread_mutex_unlock(&refiner->mutex);
+
+	return NULL;
+}
+
+Refiner *openRefiner(RefineFunction refine, FreeJobFunction freeJob,
+		int delay) {
+
+	Refiner *refiner = (Refiner *) calloc(1, sizeof(Refiner));
+	refiner->refine = refine;
+	refiner->freeJob = freeJob;
+	refiner->delay = delay;
+
+	pthread_mutex_init(&refiner->mutex, NULL);
+	pthread_cond_init(&refiner->changed, NULL);
+	refiner->running = true;
+	if (pthread_create(&refiner->thread, NULL, refinerThread, refiner) != 0) {
+		refiner->running = false;
+		closeRefiner(refiner);
+		return NULL;
+	}
+	return refiner;
+}
+
+void postRefinement(Refiner *refiner, void *job) {
+
+	pthread_mutex_lock(&refiner->mutex);
+	void *pending = refiner->pending;
+	void *finished = refiner->finished;
+	refiner->pending = job;
+	refiner->finished = NULL;
+	refiner->postCount++;
+	clock_gettime(CLOCK_REALTIME, &refiner->postedAt);
+	pthread_cond_signal(&refiner->changed);
+	pthread_mutex_unlock(&refiner->mutex);
+
+	// Whatever they would have made is out of date
+	if (pending) {
+		refiner->freeJob(pending);
+	}
+	if (finished) {
+		refiner->freeJob(finished);
+	}
+}
+
+void *takeRefinement(Refiner *refiner) {
+
+	pthread_mutex_lock(&refiner->mutex);
+	void *job = refiner->finished;
+	refiner->finished = NULL;
+	pthread_mutex_unlock(&refiner->mutex);
+
+	return job;
+}
+
+void closeRefiner(Refiner *refiner) {
+
+	pthread_mutex_lock(&refiner->mutex);
+	bool running = refiner->running;
+	refiner->running = false;
+	pthread_cond_signal(&refiner->changed);
+	pthread_mutex_unlock(&refiner->mutex);
+
+	if (running) {
+		pthread_join(refiner->thread, NULL);
+	}
+
+	if (refiner->pending) {
+		refiner->freeJob(refiner->pending);
+	}
+	if (refiner->finished) {
+		refiner->freeJob(refiner->finished);
+	}
+	pthread_mutex_destroy(&refiner->mutex);
+	pthread_cond_destroy(&refiner->changed);
+	free(refiner);
+}
@@ -0,0 +1,56 @@
+/*
+ * refiner.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Dawson
+ */
+
+#ifndef REFINER_H_
+#define REFINER_H_
+
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+
+// Does the work of a job on the refiner's thread
+typedef void (*RefineFunction)(void *job);
+
+typedef void (*FreeJobFunction)(void *job);
+
+/*
+ * Does slow work in the background once a burst of requests for it is over.
+ * Only the job posted last matters: a job posted before another starts is
+ * dropped, and the result of one that was running is dropped when it
+ * finishes. Work starts delay milliseconds after the last post.
+ */
+typedef struct Refiner {
+	RefineFunction refine;
+	FreeJobFunction freeJob;
+	int delay; // in milliseconds
+
+	void *pending; // posted, not started
+	struct timespec postedAt;
+	unsigned long postCount;
+	void *finished; // done, and still the last job posted
+
+	bool running;
+	pthread_mutex_t mutex;
+	pthread_cond_t changed;
+	pthread_t thread;
+} Refiner;
+
+// Start the refiner's thread. Returns NULL if it can't be started.
+Refiner *openRefiner(RefineFunction refine, FreeJobFunction freeJob,
+		int delay);
+
+// Post a job (or NULL, to cancel), replacing any job posted before
+void postRefinement(Refiner *refiner, void *job);
+
+// Take the last job posted once it is done, or NULL if it isn't
+void *takeRefinement(Refiner *refiner);
+
+// Stop the refiner's thread (a running job is finished first) and free it
+// with the jobs it holds
+void closeRefiner(Refiner *refiner);
+
+#endif /* REFINER_H_ */
@@ -0,0 +1,410 @@
+/*
+ * render.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include "dawsonaudio.h"
+#include "convolve.h"
+#include "parallel.h"
+#include "render.h"
+#include "simd.h"
+
+// Smallest FFT used per segment, so that short impulses still get long
+// segments instead of thousands of tiny transforms
+#define MIN_SEGMENT_FFT_SIZE	4096
+
+// Output samples computed per direct-convolution task; the accumulator for a
+// block stays in L1 while the taps stream past it
+#define DIRECT_BLOCK_SIZE		2048
+
+// Taps per inner tile of the direct kernel, so the input window it reads
+// (DIRECT_BLOCK_SIZE + DIRECT_TAP_TILE samples) also stays in cache
+#define DIRECT_TAP_TILE			1024
+
+// Problem sizes used to time each kernel once per process
+#define BENCH_FFT_SIZE			4096
+#define BENCH_DIRECT_TAPS		512
+
+typedef struct SpectrumArgs {
+	ImpulseSpectrum *spectrum;
+	float **impulse;
+} SpectrumArgs;
+
+typedef struct DirectArgs {
+	float **signal;
+	int numSignalChannels;
+	int64_t lenX;
+	float **impulse;
+	int numImpulseChannels;
+	int lenH;
+	int64_t lenY;
+	int numOutChannels;
+	float **output;
+} DirectArgs;
+
+typedef struct SegmentArgs {
+	ImpulseSpectrum *spectrum;
+	float **signal;
+	int numSignalChannels;
+	int64_t lenX;
+	int64_t lenY;
+	int numOutChannels;
+	int phase; // 0 = even segments, 1 = odd segments
+	float **output;
+	complex **scratch; // two fftSize buffers per worker thread
+} SegmentArgs;
+
+/*
+ * Mono sources feed every output channel; otherwise output channel c reads
+ * source channel c.
+ */
+static int sourceChannel(int outChannel, int numSourceChannels) {
+	return outChannel % numSourceChannels;
+}
+
+static void transformImpulseChannel(int channel, int threadIndex, void *arg) {
+
+	SpectrumArgs *args = (SpectrumArgs *) arg;
+	ImpulseSpectrum *spectrum = args->spectrum;
+	int i;
+
+	complex *bins = (complex *) calloc(spectrum->fftSize, sizeof(complex));
+	complex *temp = (complex *) calloc(spectrum->fftSize, sizeof(complex));
+
+	for (i = 0; i < spectrum->length; i++) {
+		bins[i].Re = args->impulse[channel][i];
+	}
+	fft(bins, spectrum->fftSize, temp);
+
+	spectrum->spectra[channel] = bins;
+	free(temp);
+}
+
+ImpulseSpectrum *prepareImpulseSpectrum(float **impulse, int numChannels,
+		int length) {
+
+	ImpulseSpectrum *spectrum = (ImpulseSpectrum *) malloc(
+			sizeof(ImpulseSpectrum));
+
+	int fftSize = 2 * (int) calculateNextPowerOfTwo(length);
+	if (fftSize < MIN_SEGMENT_FFT_SIZE) {
+		fftSize = MIN_SEGMENT_FFT_SIZE;
+	}
+
+	spectrum->numChannels = numChannels;
+	spectrum->length = length;
+	spectrum->fftSize = fftSize;
+	// fftSize >= 2 * length, so a segment's tail (length - 1 samples) never
+	// reaches past the segment after it
+	spectrum->segmentLength = fftSize - length + 1;
+	spectrum->spectra = (complex **) malloc(sizeof(complex *) * numChannels);
+
+	SpectrumArgs args = { spectrum, impulse };
+	parallelFor(numChannels, transformImpulseChannel, &args);
+
+	return spectrum;
+}
+
+void free_ImpulseSpectrum(ImpulseSpectrum *spectrum) {
+	int i;
+	if (spectrum) {
+		for (i = 0; i < spectrum->numChannels; i++) {
+			free(spectrum->spectra[i]);
+		}
+		free(spectrum->spectra);
+		free(spectrum);
+	}
+}
+
+/*
+ * Convolves one segment of one output channel and overlap-adds the result.
+ * Tasks are numbered (segment pair, channel) within the current phase, so
+ * no two concurrent tasks ever write the same output samples.
+ */
+static void convolveSegment(int taskIndex, int threadIndex, void *arg) {
+
+	SegmentArgs *args = (SegmentArgs *) arg;
+	ImpulseSpectrum *spectrum = args->spectrum;
+	int numOutChannels = args->numOutChannels;
+	int fftSize = spectrum->fftSize;
+	int i;
+
+	int channel = taskIndex % numOutChannels;
+	int segment = (taskIndex / numOutChannels) * 2 + args->phase;
+
+	complex *bins = args->scratch[2 * threadIndex];
+	complex *temp = args->scratch[2 * threadIndex + 1];
+	complex *impulseBins = spectrum->spectra[sourceChannel(channel,
+			spectrum->numChannels)];
+	float *input = args->signal[sourceChannel(channel, args->numSignalChannels)];
+
+	int64_t start = (int64_t) segment * spectrum->segmentLength;
+	int count = args->lenX - start > spectrum->segmentLength ?
+			spectrum->segmentLength : (int) (args->lenX - start);
+
+	memset(bins, 0, sizeof(complex) * fftSize);
+	for (i = 0; i < count; i++) {
+		bins[i].Re = input[start + i];
+	}
+
+	fft(bins, fftSize, temp);
+	for (i = 0; i < fftSize; i++) {
+		bins[i] = complex_mult(bins[i], impulseBins[i]);
+	}
+	ifft(bins, fftSize, temp);
+
+	// Overlap-add, scaling by 1/N since ifft() is unnormalized
+	int64_t end = start + count + spectrum->length - 1;
+	if (end > args->lenY) {
+		end = args->lenY;
+	}
+	float scale = 1.0f / fftSize;
+	float *output = args->output[channel] + start;
+	for (i = 0; i < end - start; i++) {
+		output[i] += bins[i].Re * scale;
+	}
+}
+
+float **segmentConvolve(ImpulseSpectrum *spectrum, float **signal,
+		int numSignalChannels, int64_t lenX, int numOutChannels) {
+
+	int i;
+
+	int64_t lenY = lenX + spectrum->length - 1;
+	int numSegments = (int) ((lenX + spectrum->segmentLength - 1)
+			/ spectrum->segmentLength);
+
+	float **output = (float **) malloc(sizeof(float *) * numOutChannels);
+	for (i = 0; i < numOutChannels; i++) {
+		output[i] = allocateChannelBuffer(lenY);
+	}
+
+	int numThreads = getNumWorkerThreads();
+	complex **scratch = (complex **) malloc(sizeof(complex *) * numThreads * 2);
+	for (i = 0; i < numThreads * 2; i++) {
+		scratch[i] = (complex *) malloc(sizeof(complex) * spectrum->fftSize);
+	}
+
+	SegmentArgs args;
+	args.spectrum = spectrum;
+	args.signal = signal;
+	args.numSignalChannels = numSignalChannels;
+	args.lenX = lenX;
+	args.lenY = lenY;
+	args.numOutChannels = numOutChannels;
+	args.output = output;
+	args.scratch = scratch;
+
+	/*
+	 * Segment k's tail only spills into segment k + 1, so all even segments
+	 * (on every channel) can run at once, followed by all odd segments.
+	 */
+	for (args.phase = 0; args.phase < 2; args.phase++) {
+		int segmentsInPhase = (numSegments - args.phase + 1) / 2;
+		parallelFor(segmentsInPhase * numOutChannels, convolveSegment, &args);
+	}
+
+	for (i = 0; i < numThreads * 2; i++) {
+		free(scratch[i]);
+	}
+	free(scratch);
+
+	return output;
+}
+
+/*
+ * y[first..last) += sum over k of h[k] * x[n - k], restricted to the taps
+ * in [firstTap, lastTap). For each tap the update is a contiguous
+ * multiply-add over the block, which is done four lanes at a time.
+ */
+static void directKernel(float *y, int64_t first, int64_t last, const float *x,
+		int64_t lenX, const float *h, int firstTap, int lastTap) {
+
+	int k, n;
+
+	for (k = firstTap; k < lastTap; k++) {
+		// Only outputs whose input sample x[n - k] exists
+		int64_t start = first > k ? first : k;
+		int64_t end = last < lenX + k ? last : lenX + k;
+		if (start >= end) {
+			continue;
+		}
+
+		float *out = y + (start - first);
+		const float *in = x + (start - k);
+		int count = (int) (end - start);
+		v4sf tap = v4sf_set1(h[k]);
+
+		for (n = 0; n + SIMD_WIDTH <= count; n += SIMD_WIDTH) {
+			v4sf_store(out + n, v4sf_load(out + n) + tap * v4sf_load(in + n));
+		}
+		for (; n < count; n++) {
+			out[n] += h[k] * in[n];
+		}
+	}
+}
+
+static void convolveDirectBlock(int taskIndex, int threadIndex, void *arg) {
+
+	DirectArgs *args = (DirectArgs *) arg;
+	int tile;
+
+	int channel = taskIndex % args->numOutChannels;
+	int64_t first = (int64_t) (taskIndex / args->numOutChannels)
+			* DIRECT_BLOCK_SIZE;
+	int64_t last = first + DIRECT_BLOCK_SIZE;
+	if (last > args->lenY) {
+		last = args->lenY;
+	}
+
+	const float *x = args->signal[sourceChannel(channel, args->numSignalChannels)];
+	const float *h = args->impulse[sourceChannel(channel, args->numImpulseChannels)];
+
+	// Each block owns its output samples, so no synchronization is needed
+	for (tile = 0; tile < args->lenH; tile += DIRECT_TAP_TILE) {
+		int lastTap = tile + DIRECT_TAP_TILE;
+		if (lastTap > args->lenH) {
+			lastTap = args->lenH;
+		}
+		directKernel(args->output[channel] + first, first, last, x, args->lenX,
+				h, tile, lastTap);
+	}
+}
+
+float **directConvolve(float **signal, int numSignalChannels, int64_t lenX,
+		float **impulse, int numImpulseChannels, int lenH, int numOutChannels) {
+
+	int i;
+
+	int64_t lenY = lenX + lenH - 1;
+
+	float **output = (float **) malloc(sizeof(float *) * numOutChannels);
+	for (i = 0; i < numOutChannels; i++) {
+		output[i] = allocateChannelBuffer(lenY);
+	}
+
+	DirectArgs args;
+	args.signal = signal;
+	args.numSignalChannels = numSignalChannels;
+	args.lenX = lenX;
+	args.impulse = impulse;
+	args.numImpulseChannels = numImpulseChannels;
+	args.lenH = lenH;
+	args.lenY = lenY;
+	args.numOutChannels = numOutChannels;
+	args.output = output;
+
+	int numBlocks = (int) ((lenY + DIRECT_BLOCK_SIZE - 1) / DIRECT_BLOCK_SIZE);
+	parallelFor(numBlocks * numOutChannels, convolveDirectBlock, &args);
+
+	return output;
+}
+
+/*
+ * Kernel speeds, measured the first time a method has to be chosen:
+ * seconds per multiply-add for the direct kernel, and seconds per
+ * N*log2(N) for one segment (forward FFT, multiply, inverse FFT).
+ */
+static double g_direct_cost_per_mac;
+static double g_fft_cost_per_nlogn;
+static pthread_once_t g_kernel_speeds_once = PTHREAD_ONCE_INIT;
+
+static double secondsSince(struct timespec *start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+static void measureKernelSpeeds() {
+
+	int i;
+	struct timespec start;
+
+	// Direct kernel: one full block against BENCH_DIRECT_TAPS taps
+	int lenX = DIRECT_BLOCK_SIZE;
+	float *x = (float *) malloc(sizeof(float) * lenX);
+	float *h = (float *) malloc(sizeof(float) * BENCH_DIRECT_TAPS);
+	float *y = (float *) calloc(DIRECT_BLOCK_SIZE, sizeof(float));
+	for (i = 0; i < lenX; i++) {
+		x[i] = (float) (i % 7) - 3.0f;
+	}
+	for (i = 0; i < BENCH_DIRECT_TAPS; i++) {
+		h[i] = 1.0f / (i + 1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	directKernel(y, 0, DIRECT_BLOCK_SIZE, x, lenX, h, 0, BENCH_DIRECT_TAPS);
+	g_direct_cost_per_mac = secondsSince(&start)
+			/ ((double) DIRECT_BLOCK_SIZE * BENCH_DIRECT_TAPS);
+
+	// FFT segment: transform, multiply, inverse transform
+	complex *bins = (complex *) calloc(BENCH_FFT_SIZE, sizeof(complex));
+	complex *impulseBins = (complex *) calloc(BENCH_FFT_SIZE, sizeof(complex));
+	complex *temp = (complex *) calloc(BENCH_FFT_SIZE, sizeof(complex));
+	for (i = 0; i < BENCH_FFT_SIZE / 2; i++) {
+		bins[i].Re = x[i % lenX];
+		impulseBins[i].Re = h[i % BENCH_DIRECT_TAPS];
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	fft(bins, BENCH_FFT_SIZE, temp);
+	for (i = 0; i < BENCH_FFT_SIZE; i++) {
+		bins[i] = complex_mult(bins[i], impulseBins[i]);
+	}
+	ifft(bins, BENCH_FFT_SIZE, temp);
+	g_fft_cost_per_nlogn = secondsSince(&start)
+			/ ((double) BENCH_FFT_SIZE * log2(BENCH_FFT_SIZE));
+
+	free(x);
+	free(h);
+	free(y);
+	free(bins);
+	free(impulseBins);
+	free(temp);
+}
+
+ConvolutionMethod chooseConvolutionMethod(int64_t lenX, int lenH,
+		int numImpulseChannels, int numOutChannels) {
+
+	pthread_once(&g_kernel_speeds_once, measureKernelSpeeds);
+
+	// Same segment layout as prepareImpulseSpectrum/segmentConvolve
+	int fftSize = 2 * (int) calculateNextPowerOfTwo(lenH);
+	if (fftSize < MIN_SEGMENT_FFT_SIZE) {
+		fftSize = MIN_SEGMENT_FFT_SIZE;
+	}
+	int segmentLength = fftSize - lenH + 1;
+	double numSegments = (lenX + segmentLength - 1) / segmentLength;
+	double segmentCost = g_fft_cost_per_nlogn * fftSize * log2(fftSize);
+
+	// Transforming the impulse costs about half a segment per channel
+	double fftCost = (numSegments * numOutChannels + 0.5 * numImpulseChannels)
+			* segmentCost;
+	double directCost = g_direct_cost_per_mac * (double) lenX * lenH
+			* numOutChannels;
+
+	return directCost < fftCost ? CONVOLUTION_DIRECT : CONVOLUTION_FFT;
+}
+
+float **autoConvolve(float **signal, int numSignalChannels, int64_t lenX,
+		float **impulse, int numImpulseChannels, int lenH, int numOutChannels) {
+
+	if (chooseConvolutionMethod(lenX, lenH, numImpulseChannels,
+			numOutChannels) == CONVOLUTION_DIRECT) {
+		return directConvolve(signal, numSignalChannels, lenX, impulse,
+				numImpulseChannels, lenH, numOutChannels);
+	}
+
+	ImpulseSpectrum *spectrum = prepareImpulseSpectrum(impulse,
+			numImpulseChannels, lenH);
+	float **output = segmentConvolve(spectrum, signal, numSignalChannels, lenX,
+			numOutChannels);
+	free_ImpulseSpectrum(spectrum);
+	return output;
+}
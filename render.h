@@ -0,0 +1,62 @@
+/*
+ * render.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#ifndef RENDER_H_
+#define RENDER_H_
+
+#include <limits.h>
+
+// Longest impulse (in frames) these functions take: an FFT block of twice
+// the next power of 2 must still fit in an int
+#define MAX_RENDER_IMPULSE_FRAMES	(INT_MAX / 4)
+
+/*
+ * An impulse that has been transformed once for offline segmented
+ * convolution. Each input segment of segmentLength samples is zero-padded to
+ * fftSize, so its convolution with the impulse fits in one FFT block and
+ * only overlaps the segment that follows it.
+ */
+typedef struct ImpulseSpectrum {
+	complex **spectra; // one fftSize-point spectrum per impulse channel
+	int numChannels;
+	int length; // impulse length in frames
+	int fftSize;
+	int segmentLength;
+} ImpulseSpectrum;
+
+// Transform every channel of a planar impulse for use with segmentConvolve
+ImpulseSpectrum *prepareImpulseSpectrum(float **impulse, int numChannels,
+		int length);
+
+void free_ImpulseSpectrum(ImpulseSpectrum *spectrum);
+
+// Convolve a planar signal with a prepared impulse, one worker per segment
+// and output channel. Returns numOutChannels buffers of length
+// (lenX + impulse length - 1), allocated with allocateChannelBuffer.
+float **segmentConvolve(ImpulseSpectrum *spectrum, float **signal,
+		int numSignalChannels, int64_t lenX, int numOutChannels);
+
+typedef enum ConvolutionMethod {
+	CONVOLUTION_DIRECT,
+	CONVOLUTION_FFT
+} ConvolutionMethod;
+
+// Direct (time-domain) convolution, blocked and vectorized, with one worker
+// per output block and channel. Same output layout as segmentConvolve.
+float **directConvolve(float **signal, int numSignalChannels, int64_t lenX,
+		float **impulse, int numImpulseChannels, int lenH, int numOutChannels);
+
+// Pick whichever of directConvolve and segmentConvolve is predicted to be
+// faster, based on kernel speeds measured on this machine
+ConvolutionMethod chooseConvolutionMethod(int64_t lenX, int lenH,
+		int numImpulseChannels, int numOutChannels);
+
+// Convolve using the method chosen by chooseConvolutionMethod
+float **autoConvolve(float **signal, int numSignalChannels, int64_t lenX,
+		float **impulse, int numImpulseChannels, int lenH, int numOutChannels);
+
+#endif /* RENDER_H_ */
@@ -0,0 +1,283 @@
+/*
+ * resample.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include "resample.h"
+#include "simd.h"
+
+// Zero crossings of the sinc on each side of the center, at the cutoff
+#define HALF_ZERO_CROSSINGS		16
+
+// Cutoff as a fraction of the lower of the two Nyquist frequencies
+#define PASSBAND				0.95
+
+// Kaiser window beta (about 90 dB of stopband rejection)
+#define KAISER_BETA				8.6
+
+// Largest number of filter phases kept; rarer ratios use the nearest phase
+#define MAX_PHASES				1024
+
+// Frames converted per block by resampleAudioData
+#define RESAMPLE_BLOCK_FRAMES	8192
+
+static int greatestCommonDivisor(int a, int b) {
+	while (b != 0) {
+		int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+// Zeroth order modified Bessel function of the first kind
+static double besselI0(double x) {
+	double sum = 1.0;
+	double term = 1.0;
+	int k;
+	for (k = 1; k < 50; k++) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+		if (term < sum * 1e-12) {
+			break;
+		}
+	}
+	return sum;
+}
+
+/*
+ * Fills the table of filter phases. Phase p holds the taps for an output
+ * p/numPhases of the way between two input frames, where tap k multiplies
+ * the input frame halfTaps - 1 - k frames before the output. Each phase is
+ * normalized to unity gain at DC.
+ */
+static void designFilter(Resampler *resampler, int halfTaps, double cutoff) {
+
+	int p, k;
+
+	for (p = 0; p <= resampler->numPhases; p++) {
+		float *h = resampler->coefficients + (long) p * resampler->numTaps;
+		double fraction = (double) p / resampler->numPhases;
+		double sum = 0.0;
+		for (k = 0; k < resampler->numTaps; k++) {
+			double x = fraction + halfTaps - 1 - k;
+			double r = x / halfTaps;
+			double value = 0.0;
+			if (fabs(r) < 1.0) {
+				double u = M_PI * cutoff * x;
+				double sinc = fabs(u) < 1e-9 ? 1.0 : sin(u) / u;
+				value = cutoff * sinc
+						* besselI0(KAISER_BETA * sqrt(1.0 - r * r))
+						/ besselI0(KAISER_BETA);
+			}
+			h[k] = (float) value;
+			sum += value;
+		}
+		for (k = 0; k < resampler->numTaps; k++) {
+			h[k] = (float) (h[k] / sum);
+		}
+	}
+}
+
+Resampler *createResampler(int inRate, int outRate, int numChannels) {
+
+	int c;
+
+	Resampler *resampler = (Resampler *) calloc(1, sizeof(Resampler));
+	int divisor = greatestCommonDivisor(inRate, outRate);
+	resampler->inRate = inRate;
+	resampler->outRate = outRate;
+	resampler->upFactor = outRate / divisor;
+	resampler->downFactor = inRate / divisor;
+	resampler->numPhases = resampler->upFactor < MAX_PHASES ?
+			resampler->upFactor : MAX_PHASES;
+
+	// Downsampling narrows the filter, so it spans more input frames
+	double cutoff = PASSBAND;
+	if (outRate < inRate) {
+		cutoff *= (double) outRate / inRate;
+	}
+	int halfTaps = (int) ceil(HALF_ZERO_CROSSINGS / cutoff);
+	halfTaps = (halfTaps + 1) & ~1; // numTaps a multiple of SIMD_WIDTH
+	resampler->numTaps = 2 * halfTaps;
+
+	resampler->coefficients = (float *) malloc(
+			sizeof(float) * (resampler->numPhases + 1) * resampler->numTaps);
+	designFilter(resampler, halfTaps, cutoff);
+
+	// Start with halfTaps - 1 frames of silence, so that the first output
+	// frame is centered on the first input frame
+	resampler->numChannels = numChannels;
+	resampler->bufferCapacity = RESAMPLE_BLOCK_FRAMES + resampler->numTaps;
+	resampler->buffers = (float **) malloc(sizeof(float *) * numChannels);
+	for (c = 0; c < numChannels; c++) {
+		resampler->buffers[c] = allocateChannelBuffer(
+				resampler->bufferCapacity);
+	}
+	resampler->buffered = halfTaps - 1;
+
+	return resampler;
+}
+
+void free_Resampler(Resampler *resampler) {
+	int c;
+	if (resampler) {
+		for (c = 0; c < resampler->numChannels; c++) {
+			free(resampler->buffers[c]);
+		}
+		free(resampler->buffers);
+		free(resampler->coefficients);
+		free(resampler);
+	}
+}
+
+long resamplerMaxOutput(Resampler *resampler, long numInFrames) {
+	return (long) (((int64_t) (resampler->buffered + numInFrames)
+			* resampler->upFactor) / resampler->downFactor) + 2;
+}
+
+static inline float dotProduct(const float *x, const float *h, int numTaps) {
+	v4sf sum = v4sf_set1(0.0f);
+	int k;
+	for (k = 0; k < numTaps; k += SIMD_WIDTH) {
+		sum += v4sf_load(x + k) * v4sf_load(h + k);
+	}
+	return v4sf_sum(sum);
+}
+
+// Produces up to maxFrames output frames from the buffered input, then drops
+// the input that no later output frame needs
+static long produce(Resampler *resampler, float **out, long maxFrames) {
+
+	int c;
+	long count = 0;
+	int numTaps = resampler->numTaps;
+	int upFactor = resampler->upFactor;
+
+	while (count < maxFrames
+			&& resampler->position + numTaps <= resampler->buffered) {
+		long index = resampler->phase;
+		if (resampler->numPhases != upFactor) {
+			index = (long) (((int64_t) resampler->phase * resampler->numPhases
+					+ upFactor / 2) / upFactor);
+		}
+		const float *h = resampler->coefficients + index * numTaps;
+		for (c = 0; c < resampler->numChannels; c++) {
+			out[c][count] = dotProduct(
+					resampler->buffers[c] + resampler->position, h, numTaps);
+		}
+		count++;
+
+		resampler->phase += resampler->downFactor;
+		resampler->position += resampler->phase / upFactor;
+		resampler->phase %= upFactor;
+	}
+
+	if (resampler->position > 0) {
+		long remaining = resampler->buffered - resampler->position;
+		for (c = 0; c < resampler->numChannels; c++) {
+			memmove(resampler->buffers[c],
+					resampler->buffers[c] + resampler->position,
+					sizeof(float) * remaining);
+		}
+		resampler->buffered = remaining;
+		resampler->position = 0;
+	}
+
+	resampler->framesOut += count;
+	return count;
+}
+
+// Appends numFrames frames per channel (silence if in is NULL)
+static void append(Resampler *resampler, float **in, long numFrames) {
+
+	int c;
+
+	if (resampler->buffered + numFrames > resampler->bufferCapacity) {
+		long capacity = resampler->buffered + numFrames;
+		for (c = 0; c < resampler->numChannels; c++) {
+			float *buffer = allocateChannelBuffer(capacity);
+			memcpy(buffer, resampler->buffers[c],
+					sizeof(float) * resampler->buffered);
+			free(resampler->buffers[c]);
+			resampler->buffers[c] = buffer;
+		}
+		resampler->bufferCapacity = capacity;
+	}
+
+	for (c = 0; c < resampler->numChannels; c++) {
+		float *end = resampler->buffers[c] + resampler->buffered;
+		if (in) {
+			memcpy(end, in[c], sizeof(float) * numFrames);
+		} else {
+			memset(end, 0, sizeof(float) * numFrames);
+		}
+	}
+	resampler->buffered += numFrames;
+}
+
+long resamplerProcess(Resampler *resampler, float **in, long numInFrames,
+		float **out) {
+	append(resampler, in, numInFrames);
+	resampler->framesIn += numInFrames;
+	return produce(resampler, out, LONG_MAX);
+}
+
+long resamplerFlush(Resampler *resampler, float **out) {
+
+	int64_t total = (resampler->framesIn * resampler->upFactor
+			+ resampler->downFactor - 1) / resampler->downFactor;
+
+	append(resampler, NULL, resampler->numTaps / 2);
+	return produce(resampler, out, (long) (total - resampler->framesOut));
+}
+
+audioData *resampleAudioData(const audioData *audio, int outRate) {
+
+	int64_t first;
+	int c;
+
+	if (audio->sampleRate == outRate) {
+		return copyAudioData(audio);
+	}
+
+	Resampler *resampler = createResampler(audio->sampleRate, outRate,
+			audio->numChannels);
+	int64_t numOutFrames = (audio->numFrames * resampler->upFactor
+			+ resampler->downFactor - 1) / resampler->downFactor;
+	audioData *resampled = createAudioData(audio->numChannels, numOutFrames,
+			outRate);
+
+	float *in[audio->numChannels];
+	float *out[audio->numChannels];
+	int64_t written = 0;
+
+	for (first = 0; first < audio->numFrames; first += RESAMPLE_BLOCK_FRAMES) {
+		long count = audio->numFrames - first < RESAMPLE_BLOCK_FRAMES ?
+				(long) (audio->numFrames - first) : RESAMPLE_BLOCK_FRAMES;
+		for (c = 0; c < audio->numChannels; c++) {
+			in[c] = audio->channels[c] + first;
+			out[c] = resampled->channels[c] + written;
+		}
+		written += resamplerProcess(resampler, in, count, out);
+	}
+	for (c = 0; c < audio->numChannels; c++) {
+		out[c] = resampled->channels[c] + written;
+	}
+	resamplerFlush(resampler, out);
+
+	if (audio->fileName) {
+		resampled->fileName = malloc(strlen(audio->fileName) + 1);
+		strcpy(resampled->fileName, audio->fileName);
+	}
+
+	free_Resampler(resampler);
+	return resampled;
+}
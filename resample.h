@@ -0,0 +1,61 @@
+/*
+ * resample.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#ifndef RESAMPLE_H_
+#define RESAMPLE_H_
+
+#include <stdint.h>
+#include "dawsonaudio.h"
+
+/*
+ * Polyphase windowed-sinc sample-rate converter working on planar audio.
+ * The rate ratio is reduced to outRate/inRate = L/M, and each output sample is
+ * one dot product of numTaps input samples with the phase of the filter
+ * nearest its position. Output is aligned with the input (no filter delay),
+ * and a whole stream yields ceil(numInFrames * L / M) frames once flushed.
+ */
+typedef struct Resampler {
+	int inRate;
+	int outRate;
+	int upFactor; // L
+	int downFactor; // M
+	int numPhases; // filter phases in the table (L, unless L is very large)
+	int numTaps; // taps per phase (a multiple of SIMD_WIDTH)
+	float *coefficients; // (numPhases + 1) * numTaps
+
+	int numChannels;
+	float **buffers; // input not yet consumed, per channel
+	long bufferCapacity;
+	long buffered; // frames in each buffer
+	long position; // first buffered frame used by the next output frame
+	long phase; // fractional position of the next output, in 1/L frames
+
+	int64_t framesIn;
+	int64_t framesOut;
+} Resampler;
+
+Resampler *createResampler(int inRate, int outRate, int numChannels);
+
+void free_Resampler(Resampler *resampler);
+
+// Most frames resamplerProcess can return for numInFrames more input frames
+long resamplerMaxOutput(Resampler *resampler, long numInFrames);
+
+// Stream numInFrames frames of each channel in, and write the output frames
+// that are now complete to out (one buffer per channel). Returns the number of
+// frames written.
+long resamplerProcess(Resampler *resampler, float **in, long numInFrames,
+		float **out);
+
+// Write the frames still waiting on input that will never come. out needs
+// room for resamplerMaxOutput(resampler, resampler->numTaps) frames.
+long resamplerFlush(Resampler *resampler, float **out);
+
+// Convert a whole buffer to another rate (a copy if the rates are the same)
+audioData *resampleAudioData(const audioData *audio, int outRate);
+
+#endif /* RESAMPLE_H_ */
@@ -0,0 +1,235 @@
+/*
+ * sampleformat.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sampleformat.h"
+#include "simd.h"
+
+#define INT16_SCALE			32768.0f
+#define INT24_SCALE			8388608.0f
+#define INT32_SCALE			2147483648.0f
+
+#define INT24_BITS(p) \
+	((int32_t) (((uint32_t) (p)[0] << 8) | ((uint32_t) (p)[1] << 16) \
+			| ((uint32_t) (p)[2] << 24)))
+
+typedef short v4hi __attribute__ ((vector_size (8)));
+
+// Clip to [-1, 1], scale, and round half away from zero
+static inline v4si quantize(v4sf v, float scale, float maxValue) {
+	v = v4sf_min(v4sf_max(v * scale, v4sf_set1(-scale)), v4sf_set1(maxValue));
+	v4sf half = (v4sf) (((v4si) v & (v4si) v4sf_set1(-0.0f))
+			| (v4si) v4sf_set1(0.5f));
+	return __builtin_convertvector(v + half, v4si);
+}
+
+static inline int quantizeScalar(float x, float scale, float maxValue) {
+	x *= scale;
+	if (x < -scale) {
+		x = -scale;
+	}
+	if (x > maxValue) {
+		x = maxValue;
+	}
+	return (int) (x < 0 ? x - 0.5f : x + 0.5f);
+}
+
+void int16ToFloat(const int16_t *in, float *out, long length) {
+
+	long i = 0;
+
+	v4sf scale = v4sf_set1(1.0f / INT16_SCALE);
+	for (; i + SIMD_WIDTH <= length; i += SIMD_WIDTH) {
+		v4hi v;
+		memcpy(&v, in + i, sizeof(v4hi));
+		v4sf_store(out + i, __builtin_convertvector(v, v4sf) * scale);
+	}
+	for (; i < length; i++) {
+		out[i] = in[i] / INT16_SCALE;
+	}
+}
+
+void floatToInt16(const float *in, int16_t *out, long length) {
+
+	long i = 0;
+
+	for (; i + SIMD_WIDTH <= length; i += SIMD_WIDTH) {
+		v4hi v = __builtin_convertvector(
+				quantize(v4sf_load(in + i), INT16_SCALE, INT16_SCALE - 1), v4hi);
+		memcpy(out + i, &v, sizeof(v4hi));
+	}
+	for (; i < length; i++) {
+		out[i] = (int16_t) quantizeScalar(in[i], INT16_SCALE, INT16_SCALE - 1);
+	}
+}
+
+void int24ToFloat(const unsigned char *in, float *out, long length) {
+
+	long i = 0;
+
+	// Place each sample in the top 3 bytes of an int, then scale as 32-bit
+	v4sf scale = v4sf_set1(1.0f / INT32_SCALE);
+	for (; i + SIMD_WIDTH <= length; i += SIMD_WIDTH) {
+		const unsigned char *p = in + 3 * i;
+		v4si v = { INT24_BITS(p), INT24_BITS(p + 3), INT24_BITS(p + 6),
+				INT24_BITS(p + 9) };
+		v4sf_store(out + i, __builtin_convertvector(v, v4sf) * scale);
+	}
+	for (; i < length; i++) {
+		const unsigned char *p = in + 3 * i;
+		out[i] = INT24_BITS(p) / INT32_SCALE;
+	}
+}
+
+void floatToInt24(const float *in, unsigned char *out, long length) {
+
+	long i = 0;
+	int lane;
+
+	for (; i + SIMD_WIDTH <= length; i += SIMD_WIDTH) {
+		v4si v = quantize(v4sf_load(in + i), INT24_SCALE, INT24_SCALE - 1);
+		for (lane = 0; lane < SIMD_WIDTH; lane++) {
+			unsigned char *p = out + 3 * (i + lane);
+			p[0] = (unsigned char) v[lane];
+			p[1] = (unsigned char) (v[lane] >> 8);
+			p[2] = (unsigned char) (v[lane] >> 16);
+		}
+	}
+	for (; i < length; i++) {
+		int v = quantizeScalar(in[i], INT24_SCALE, INT24_SCALE - 1);
+		unsigned char *p = out + 3 * i;
+		p[0] = (unsigned char) v;
+		p[1] = (unsigned char) (v >> 8);
+		p[2] = (unsigned char) (v >> 16);
+	}
+}
+
+void floatToInt24In32(const float *in, int32_t *out, long length) {
+
+	long i = 0;
+
+	for (; i + SIMD_WIDTH <= length; i += SIMD_WIDTH) {
+		v4si v = quantize(v4sf_load(in + i), INT24_SCALE, INT24_SCALE - 1);
+		v *= 256;
+		memcpy(out + i, &v, sizeof(v4si));
+	}
+	for (; i < length; i++) {
+		out[i] = quantizeScalar(in[i], INT24_SCALE, INT24_SCALE - 1) * 256;
+	}
+}
+
+void int32ToFloat(const int32_t *in, float *out, long length) {
+
+	long i = 0;
+
+	v4sf scale = v4sf_set1(1.0f / INT32_SCALE);
+	for (; i + SIMD_WIDTH <= length; i += SIMD_WIDTH) {
+		v4si v;
+		memcpy(&v, in + i, sizeof(v4si));
+		v4sf_store(out + i, __builtin_convertvector(v, v4sf) * scale);
+	}
+	for (; i < length; i++) {
+		out[i] = in[i] / INT32_SCALE;
+	}
+}
+
+void swapFloat32ToFloat(const unsigned char *in, float *out, long length) {
+
+	long i;
+
+	for (i = 0; i < length; i++) {
+		uint32_t bits;
+		memcpy(&bits, in + 4 * i, sizeof(uint32_t));
+		bits = __builtin_bswap32(bits);
+		memcpy(out + i, &bits, sizeof(float));
+	}
+}
+
+void deinterleave(const float *in, float **out, int numChannels, long numFrames) {
+
+	long i = 0;
+	int c;
+
+	if (numChannels == 1) {
+		memmove(out[0], in, sizeof(float) * numFrames);
+		return;
+	}
+
+	if (numChannels == 2) {
+		for (; i + SIMD_WIDTH <= numFrames; i += SIMD_WIDTH) {
+			v4sf a = v4sf_load(in + 2 * i);
+			v4sf b = v4sf_load(in + 2 * i + SIMD_WIDTH);
+			v4sf_store(out[0] + i, v4sf_shuffle(a, b, 0, 2, 4, 6));
+			v4sf_store(out[1] + i, v4sf_shuffle(a, b, 1, 3, 5, 7));
+		}
+	}
+
+	for (; i < numFrames; i++) {
+		for (c = 0; c < numChannels; c++) {
+			out[c][i] = in[i * numChannels + c];
+		}
+	}
+}
+
+void interleave(float **in, float *out, int numChannels, long numFrames) {
+
+	long i = 0;
+	int c;
+
+	if (numChannels == 1) {
+		memmove(out, in[0], sizeof(float) * numFrames);
+		return;
+	}
+
+	if (numChannels == 2) {
+		for (; i + SIMD_WIDTH <= numFrames; i += SIMD_WIDTH) {
+			v4sf left = v4sf_load(in[0] + i);
+			v4sf right = v4sf_load(in[1] + i);
+			v4sf_store(out + 2 * i, v4sf_shuffle(left, right, 0, 4, 1, 5));
+			v4sf_store(out + 2 * i + SIMD_WIDTH,
+					v4sf_shuffle(left, right, 2, 6, 3, 7));
+		}
+	}
+
+	for (; i < numFrames; i++) {
+		for (c = 0; c < numChannels; c++) {
+			out[i * numChannels + c] = in[c][i];
+		}
+	}
+}
+
+void downmixToMono(const float *in, float *out, int numChannels,
+		long numFrames) {
+
+	long i = 0;
+	int c;
+
+	if (numChannels == 1) {
+		memmove(out, in, sizeof(float) * numFrames);
+		return;
+	}
+
+	if (numChannels == 2) {
+		v4sf half = v4sf_set1(0.5f);
+		for (; i + SIMD_WIDTH <= numFrames; i += SIMD_WIDTH) {
+			v4sf a = v4sf_load(in + 2 * i);
+			v4sf b = v4sf_load(in + 2 * i + SIMD_WIDTH);
+			v4sf_store(out + i, (v4sf_shuffle(a, b, 0, 2, 4, 6)
+					+ v4sf_shuffle(a, b, 1, 3, 5, 7)) * half);
+		}
+	}
+
+	for (; i < numFrames; i++) {
+		float sum = 0.0f;
+		for (c = 0; c < numChannels; c++) {
+			sum += in[i * numChannels + c];
+		}
+		out[i] = sum / numChannels;
+	}
+}
@@ -0,0 +1,48 @@
+/*
+ * sampleformat.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#ifndef SAMPLEFORMAT_H_
+#define SAMPLEFORMAT_H_
+
+#include <stdint.h>
+
+/*
+ * Vectorized sample conversion and channel layout kernels shared by every
+ * file and stream path. 24-bit samples are packed 3-byte little-endian.
+ */
+
+void int16ToFloat(const int16_t *in, float *out, long length);
+
+// Clips to [-1, 1] and rounds to nearest
+void floatToInt16(const float *in, int16_t *out, long length);
+
+void int24ToFloat(const unsigned char *in, float *out, long length);
+
+// Clips to [-1, 1] and rounds to nearest
+void floatToInt24(const float *in, unsigned char *out, long length);
+
+// As floatToInt24, with each sample in the top 3 bytes of an int (the layout
+// sf_writef_int expects for 24-bit files)
+void floatToInt24In32(const float *in, int32_t *out, long length);
+
+void int32ToFloat(const int32_t *in, float *out, long length);
+
+// Reverses the byte order of 32-bit floats (big-endian files)
+void swapFloat32ToFloat(const unsigned char *in, float *out, long length);
+
+// Interleaved frames to one buffer per channel
+void deinterleave(const float *in, float **out, int numChannels, long numFrames);
+
+// One buffer per channel to interleaved frames. The same buffer may be given
+// for several channels (e.g. mono to stereo).
+void interleave(float **in, float *out, int numChannels, long numFrames);
+
+// Interleaved frames to the average of their channels
+void downmixToMono(const float *in, float *out, int numChannels,
+		long numFrames);
+
+#endif /* SAMPLEFORMAT_H_ */
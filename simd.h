@@ -0,0 +1,67 @@
+/*
+ * simd.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#ifndef SIMD_H_
+#define SIMD_H_
+
+#include <string.h>
+
+/*
+ * Four-lane float vectors using the GCC/clang vector extension, which maps
+ * onto SSE on x86 and NEON on ARM. Loads and stores go through memcpy so
+ * they are safe on unaligned pointers.
+ */
+typedef float v4sf __attribute__ ((vector_size (16)));
+typedef int v4si __attribute__ ((vector_size (16)));
+typedef unsigned int v4su __attribute__ ((vector_size (16)));
+
+#define SIMD_WIDTH			4
+
+// Select lanes from the concatenation of two vectors (indices 0-7)
+#if defined(__clang__)
+#define v4sf_shuffle(a, b, i0, i1, i2, i3) \
+	__builtin_shufflevector(a, b, i0, i1, i2, i3)
+#else
+#define v4sf_shuffle(a, b, i0, i1, i2, i3) \
+	__builtin_shuffle(a, b, (v4si) { i0, i1, i2, i3 })
+#endif
+
+static inline v4sf v4sf_load(const float *p) {
+	v4sf v;
+	memcpy(&v, p, sizeof(v4sf));
+	return v;
+}
+
+static inline void v4sf_store(float *p, v4sf v) {
+	memcpy(p, &v, sizeof(v4sf));
+}
+
+static inline v4sf v4sf_set1(float x) {
+	v4sf v = { x, x, x, x };
+	return v;
+}
+
+static inline v4sf v4sf_abs(v4sf v) {
+	return (v4sf) ((v4si) v & 0x7fffffff);
+}
+
+static inline v4sf v4sf_max(v4sf a, v4sf b) {
+	v4si mask = a > b;
+	return (v4sf) (((v4si) a & mask) | ((v4si) b & ~mask));
+}
+
+static inline v4sf v4sf_min(v4sf a, v4sf b) {
+	v4si mask = a < b;
+	return (v4sf) (((v4si) a & mask) | ((v4si) b & ~mask));
+}
+
+// Sum of the four lanes
+static inline float v4sf_sum(v4sf v) {
+	return (v[0] + v[1]) + (v[2] + v[3]);
+}
+
+#endif /* SIMD_H_ */
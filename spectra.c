@@ -0,0 +1,262 @@
+/*
+ * spectra.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "spectra.h"
+
+#define SPECTRA_MAGIC			"CONVSPEC"
+#define SPECTRA_ALIGNMENT		64
+
+#define FNV_OFFSET_BASIS		0xcbf29ce484222325ULL
+#define FNV_PRIME				0x100000001b3ULL
+
+typedef struct SpectraFileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t numChannels;
+	uint64_t key;
+	uint64_t numFrames;
+	int32_t sampleRate;
+	uint32_t numBlocks;
+	uint32_t stateLength;
+	uint32_t reserved;
+	uint64_t blockSizesOffset;
+	uint64_t stateOffset;
+	uint64_t impulseOffset;
+	uint64_t spectraOffset;
+	uint64_t fileSize;
+} SpectraFileHeader;
+
+uint64_t hashBytes(uint64_t hash, const void *data, size_t length) {
+
+	const unsigned char *bytes = (const unsigned char *) data;
+	size_t i;
+
+	if (hash == 0) {
+		hash = FNV_OFFSET_BASIS;
+	}
+	for (i = 0; i < length; i++) {
+		hash = (hash ^ bytes[i]) * FNV_PRIME;
+	}
+	return hash;
+}
+
+uint64_t hashAudioData(uint64_t hash, const audioData *audio) {
+
+	int c;
+
+	hash = hashBytes(hash, &audio->numChannels, sizeof(audio->numChannels));
+	hash = hashBytes(hash, &audio->numFrames, sizeof(audio->numFrames));
+	hash = hashBytes(hash, &audio->sampleRate, sizeof(audio->sampleRate));
+	for (c = 0; c < audio->numChannels; c++) {
+		hash = hashBytes(hash, audio->channels[c],
+				sizeof(float) * audio->numFrames);
+	}
+	return hash;
+}
+
+static uint64_t alignOffset(uint64_t offset) {
+	return (offset + SPECTRA_ALIGNMENT - 1) & ~(uint64_t) (SPECTRA_ALIGNMENT - 1);
+}
+
+// Lays out the sections after the header, and returns the file size
+static uint64_t layOutFile(SpectraFileHeader *header,
+		const uint32_t *blockSizes) {
+
+	uint32_t i;
+	uint64_t spectraLength = 0;
+
+	for (i = 0; i < header->numBlocks; i++) {
+		spectraLength += sizeof(complex) * (uint64_t) blockSizes[i];
+	}
+
+	header->blockSizesOffset = alignOffset(sizeof(SpectraFileHeader));
+	header->stateOffset = alignOffset(header->blockSizesOffset
+			+ sizeof(uint32_t) * (uint64_t) header->numBlocks);
+	header->impulseOffset = alignOffset(header->stateOffset
+			+ sizeof(float) * (uint64_t) header->stateLength);
+	header->spectraOffset = alignOffset(header->impulseOffset
+			+ sizeof(float) * header->numFrames * header->numChannels);
+	return header->spectraOffset + spectraLength * header->numChannels;
+}
+
+PartitionSpectra *openSpectraFile(const char *fileName, uint64_t key) {
+
+	struct stat info;
+	SpectraFileHeader header;
+	uint32_t i;
+	int c;
+
+	int fd = open(fileName, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	if (fstat(fd, &info) != 0 || info.st_size < (off_t) sizeof(header)) {
+		close(fd);
+		return NULL;
+	}
+
+	size_t length = (size_t) info.st_size;
+	void *mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+			0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		return NULL;
+	}
+
+	memcpy(&header, mapping, sizeof(header));
+	if (memcmp(header.magic, SPECTRA_MAGIC, sizeof(header.magic)) != 0
+			|| header.version != SPECTRA_FILE_VERSION || header.key != key
+			|| header.fileSize != length || header.numChannels == 0) {
+		munmap(mapping, length);
+		return NULL;
+	}
+
+	const unsigned char *base = (const unsigned char *) mapping;
+	const uint32_t *blockSizes = (const uint32_t *) (base
+			+ header.blockSizesOffset);
+
+	// The sections must be where the header's sizes put them
+	SpectraFileHeader expected = header;
+	if (header.blockSizesOffset + sizeof(uint32_t) * (uint64_t) header.numBlocks
+			> length || layOutFile(&expected, blockSizes) != length
+			|| expected.stateOffset != header.stateOffset
+			|| expected.impulseOffset != header.impulseOffset
+			|| expected.spectraOffset != header.spectraOffset) {
+		munmap(mapping, length);
+		return NULL;
+	}
+
+	PartitionSpectra *spectra = (PartitionSpectra *) malloc(
+			sizeof(PartitionSpectra));
+
+	spectra->state = (const float *) (base + header.stateOffset);
+	spectra->stateLength = (int) header.stateLength;
+
+	// The impulse is edited and freed like any other, so it gets its own copy
+	spectra->impulse = createAudioData((int) header.numChannels,
+			(int64_t) header.numFrames, header.sampleRate);
+	for (c = 0; c < (int) header.numChannels; c++) {
+		memcpy(spectra->impulse->channels[c],
+				base + header.impulseOffset
+						+ sizeof(float) * header.numFrames * c,
+				sizeof(float) * header.numFrames);
+	}
+
+	FFTData *fftData = (FFTData *) malloc(sizeof(FFTData));
+	fftData->numChannels = (int) header.numChannels;
+	fftData->size = (int) header.numBlocks;
+	fftData->mapping = mapping;
+	fftData->mappingLength = length;
+	fftData->users = 0;
+	fftData->fftBlocks = (complex ***) malloc(
+			sizeof(complex **) * fftData->numChannels);
+
+	complex *block = (complex *) (base + header.spectraOffset);
+	for (c = 0; c < fftData->numChannels; c++) {
+		fftData->fftBlocks[c] = (complex **) malloc(
+				sizeof(complex *) * fftData->size);
+		for (i = 0; i < header.numBlocks; i++) {
+			fftData->fftBlocks[c][i] = block;
+			block += blockSizes[i];
+		}
+	}
+	spectra->fftData = fftData;
+
+	madvise(mapping, length, MADV_WILLNEED);
+
+	return spectra;
+}
+
+// Writes length bytes, then zeros up to offset. Returns false on failure.
+static bool writeSection(FILE *file, const void *data, size_t length,
+		uint64_t end) {
+
+	static const char zeros[SPECTRA_ALIGNMENT];
+
+	if (length > 0 && fwrite(data, 1, length, file) != length) {
+		return false;
+	}
+	long position = ftell(file);
+	if (position < 0 || (uint64_t) position > end) {
+		return false;
+	}
+	return fwrite(zeros, 1, end - position, file) == end - position;
+}
+
+bool writeSpectraFile(const char *fileName, uint64_t key, audioData *impulse,
+		FFTData *fftData, Vector blockLengths, const float *state,
+		int stateLength) {
+
+	SpectraFileHeader header;
+	int c, i;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SPECTRA_MAGIC, sizeof(header.magic));
+	header.version = SPECTRA_FILE_VERSION;
+	header.numChannels = (uint32_t) impulse->numChannels;
+	header.key = key;
+	header.numFrames = (uint64_t) impulse->numFrames;
+	header.sampleRate = impulse->sampleRate;
+	header.numBlocks = (uint32_t) fftData->size;
+	header.stateLength = (uint32_t) stateLength;
+
+	uint32_t *blockSizes = (uint32_t *) malloc(
+			sizeof(uint32_t) * (fftData->size > 0 ? fftData->size : 1));
+	for (i = 0; i < fftData->size; i++) {
+		blockSizes[i] = (uint32_t) vector_get(&blockLengths, i);
+	}
+	header.fileSize = layOutFile(&header, blockSizes);
+
+	// Write beside the final name, then rename over it
+	size_t nameLength = strlen(fileName) + 16;
+	char *tempName = (char *) malloc(nameLength);
+	snprintf(tempName, nameLength, "%s.%ld", fileName, (long) getpid());
+
+	FILE *file = fopen(tempName, "wb");
+	bool ok = file != NULL;
+
+	ok = ok && writeSection(file, &header, sizeof(header),
+			header.blockSizesOffset);
+	ok = ok && writeSection(file, blockSizes,
+			sizeof(uint32_t) * header.numBlocks, header.stateOffset);
+	ok = ok && writeSection(file, state, sizeof(float) * header.stateLength,
+			header.impulseOffset);
+	for (c = 0; ok && c < impulse->numChannels; c++) {
+		uint64_t end = c == impulse->numChannels - 1 ? header.spectraOffset :
+				header.impulseOffset + sizeof(float) * header.numFrames * (c + 1);
+		ok = writeSection(file, impulse->channels[c],
+				sizeof(float) * header.numFrames, end);
+	}
+	for (c = 0; ok && c < fftData->numChannels; c++) {
+		for (i = 0; ok && i < fftData->size; i++) {
+			size_t length = sizeof(complex) * blockSizes[i];
+			ok = fwrite(fftData->fftBlocks[c][i], 1, length, file) == length;
+		}
+	}
+
+	if (file && fclose(file) != 0) {
+		ok = false;
+	}
+	if (ok) {
+		ok = rename(tempName, fileName) == 0;
+	}
+	if (!ok) {
+		printf("Error: unable to write %s\n", fileName);
+		unlink(tempName);
+	}
+
+	free(tempName);
+	free(blockSizes);
+	return ok;
+}
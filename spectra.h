@@ -0,0 +1,64 @@
+/*
+ * spectra.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#ifndef SPECTRA_H_
+#define SPECTRA_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "dawsonaudio.h"
+#include "convolve.h"
+#include "vector.h"
+#include "impulse.h"
+
+// Bump whenever the layout below, or anything that changes the spectra
+// computed for the same key, changes
+#define SPECTRA_FILE_VERSION		6
+
+/*
+ * A file holding a prepared impulse: the synthesized impulse, the spectra of
+ * its partitions in the engine's layout, and a block of caller state (e.g. the
+ * graph the impulse was drawn from). It is keyed by a hash of the source
+ * impulse and of every parameter that went into the synthesis, so a stale file
+ * is never loaded.
+ *
+ * The file is memory-mapped copy-on-write: the partition spectra are used in
+ * place, and processes loading the same file share its pages.
+ *
+ *   header
+ *   uint32_t blockSizes[numBlocks] (complex values per partition)
+ *   float state[stateLength]
+ *   float impulse[numChannels][numFrames]
+ *   complex spectra[numChannels][numBlocks][blockSize]
+ *
+ * Every section starts on a SPECTRA_ALIGNMENT byte boundary.
+ */
+typedef struct PartitionSpectra {
+	audioData *impulse; // copied out of the file (the caller owns it)
+	FFTData *fftData; // blocks point into the mapping (the caller owns it)
+	const float *state; // points into the mapping
+	int stateLength;
+} PartitionSpectra;
+
+// FNV-1a, for building keys: pass 0 to start a new hash
+uint64_t hashBytes(uint64_t hash, const void *data, size_t length);
+
+// Hash of every sample of an impulse, its rate and its channel count
+uint64_t hashAudioData(uint64_t hash, const audioData *audio);
+
+// Map a spectra file. Returns NULL if it is missing, of another version,
+// damaged, or not for key.
+PartitionSpectra *openSpectraFile(const char *fileName, uint64_t key);
+
+// Save a prepared impulse. The file appears atomically, so another process
+// never maps a partly written one. Returns false on failure.
+bool writeSpectraFile(const char *fileName, uint64_t key, audioData *impulse,
+		FFTData *fftData, Vector blockLengths, const float *state,
+		int stateLength);
+
+#endif /* SPECTRA_H_ */
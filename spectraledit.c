@@ -0,0 +1,283 @@
+/*
+ * spectraledit.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Dawson
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "spectraledit.h"
+
+// Largest boost (and, as its reciprocal, cut) a single edit can apply, as a
+// ratio of starting levels. Bins drawn down to nothing keep a trace of sound.
+#define MAX_EDIT_RATIO		1000.0f
+
+// How often to check whether partitions still convolve with a copy
+#define USER_POLL_NANOSECONDS	1000000L
+
+static FFTData *copyFFTData(const FFTData *fftData, const int *blockLengths) {
+	int c, i;
+	FFTData *copy = (FFTData *) malloc(sizeof(FFTData));
+	copy->numChannels = fftData->numChannels;
+	copy->size = fftData->size;
+	copy->mapping = NULL;
+	copy->mappingLength = 0;
+	copy->users = 0;
+	copy->fftBlocks = (complex ***) malloc(
+			sizeof(complex **) * fftData->numChannels);
+	for (c = 0; c < fftData->numChannels; c++) {
+		copy->fftBlocks[c] = (complex **) malloc(
+				sizeof(complex *) * fftData->size);
+		for (i = 0; i < fftData->size; i++) {
+			copy->fftBlocks[c][i] = (complex *) malloc(
+					sizeof(complex) * blockLengths[i]);
+			memcpy(copy->fftBlocks[c][i], fftData->fftBlocks[c][i],
+					sizeof(complex) * blockLengths[i]);
+		}
+	}
+	return copy;
+}
+
+/*
+ * Rewrites one partition of one channel of a copy from the base spectra.
+ * logRatios holds log(y' / y) for every graph bin; gains is scratch for
+ * numBins values.
+ */
+static void applyPartitionGains(SpectralEditor *editor, FFTData *copy,
+		int channel, int block, const float *logRatios, float *gains) {
+
+	int j, k;
+	int n = editor->blockLengths[block];
+	const complex *base = editor->base->fftBlocks[channel][block];
+	complex *edited = copy->fftBlocks[channel][block];
+
+	float remaining = 1.0f - editor->blockTimes[block] / editor->decayBlocks;
+	if (remaining < 0.0f) {
+		remaining = 0.0f;
+	}
+	for (j = 0; j < editor->numBins; j++) {
+		gains[j] = expf(remaining * logRatios[j]);
+	}
+
+	/*
+	 * Graph bin j covers frequencies [j, j + 1) / fftSize of the sample rate,
+	 * so bin k of this partition sits at k * fftSize / n. Gains are
+	 * interpolated between the middles of the graph bins, and mirrored for
+	 * the negative frequencies.
+	 */
+	float scale = (float) editor->fftSize / n;
+	for (k = 0; k < n; k++) {
+		int bin = k <= n / 2 ? k : n - k;
+		float x = bin * scale - 0.5f;
+		float gain;
+		if (x <= 0.0f) {
+			gain = gains[0];
+		} else if (x >= editor->numBins - 1) {
+			gain = gains[editor->numBins - 1];
+		} else {
+			j = (int) x;
+			gain = gains[j] + (x - j) * (gains[j + 1] - gains[j]);
+		}
+		edited[k].Re = base[k].Re * gain;
+		edited[k].Im = base[k].Im * gain;
+	}
+}
+
+/*
+ * Partitions queued with a copy before the engine was given the other one
+ * may still be convolving with it. Returns false if the editor is stopped
+ * while they finish.
+ */
+static bool waitForUsers(SpectralEditor *editor, FFTData *copy) {
+	const struct timespec poll = { 0, USER_POLL_NANOSECONDS };
+	while (isFFTDataInUse(copy)) {
+		if (!__atomic_load_n(&editor->running, __ATOMIC_RELAXED)) {
+			return false;
+		}
+		nanosleep(&poll, NULL);
+	}
+	return true;
+}
+
+static void *spectralEditThread(void *arg) {
+
+	SpectralEditor *editor = (SpectralEditor *) arg;
+	int c, i, j;
+	int numValues = editor->numChannels * editor->numBins;
+
+	float *target = (float *) malloc(sizeof(float) * numValues);
+	float *logRatios = (float *) malloc(sizeof(float) * numValues);
+	float *gains = (float *) malloc(sizeof(float) * editor->numBins);
+	unsigned long seen = 0;
+
+	pthread_mutex_lock(&editor->mutex);
+	while (editor->running) {
+		if (editor->postCount == seen) {
+			pthread_cond_wait(&editor->changed, &editor->mutex);
+			continue;
+		}
+		seen = editor->postCount;
+		memcpy(target, editor->posted, sizeof(float) * numValues);
+		pthread_mutex_unlock(&editor->mutex);
+
+		for (j = 0; j < numValues; j++) {
+			float from = editor->reference[j] + editor->graphHeight;
+			float to = target[j] + editor->graphHeight;
+			float ratio = to / fmaxf(from, editor->graphHeight / MAX_EDIT_RATIO);
+			ratio = fminf(fmaxf(ratio, 1.0f / MAX_EDIT_RATIO), MAX_EDIT_RATIO);
+			logRatios[j] = logf(ratio);
+		}
+
+		// Rewrite the copy the engine doesn't have. A newer graph starts
+		// over; a channel left half-rewritten matches no graph.
+		int spare = 1 - editor->published;
+		FFTData *copy = editor->spectra[spare];
+		float *applied = editor->applied[spare];
+		bool superseded = !waitForUsers(editor, copy);
+		for (c = 0; c < editor->numChannels && !superseded; c++) {
+			const float *row = target + c * editor->numBins;
+			if (memcmp(row, applied + c * editor->numBins,
+					sizeof(float) * editor->numBins) == 0) {
+				continue;
+			}
+			for (i = 0; i < editor->numBlocks; i++) {
+				applyPartitionGains(editor, copy, c, i,
+						logRatios + c * editor->numBins, gains);
+				if (__atomic_load_n(&editor->postCount, __ATOMIC_RELAXED)
+						!= seen) {
+					superseded = true;
+					break;
+				}
+			}
+			if (superseded) {
+				applied[c * editor->numBins] = NAN;
+			} else {
+				memcpy(applied + c * editor->numBins, row,
+						sizeof(float) * editor->numBins);
+			}
+		}
+
+		// Hand it to the engine, unless the engine has moved on to other
+		// spectra (the editor is then retired)
+		FFTData *current = editor->spectra[editor->published];
+		if (!superseded && memcmp(applied, editor->applied[editor->published],
+				sizeof(float) * numValues) != 0
+				&& __atomic_compare_exchange_n(editor->engineSpectra, &current,
+						copy, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+			editor->published = spare;
+		}
+
+		pthread_mutex_lock(&editor->mutex);
+	}
+	pthread_mutex_unlock(&editor->mutex);
+
+	free(target);
+	free(logRatios);
+	free(gains);
+	return NULL;
+}
+
+SpectralEditor *openSpectralEditor(FFTData *base, FFTData **engineSpectra,
+		Vector blockLengths, const float *reference, int numBins, int fftSize,
+		float graphHeight, float decayBlocks) {
+
+	int i;
+	int numValues = base->numChannels * numBins;
+
+	SpectralEditor *editor = (SpectralEditor *) calloc(1,
+			sizeof(SpectralEditor));
+	editor->base = base;
+	editor->engineSpectra = engineSpectra;
+	editor->numBlocks = blockLengths.size;
+	editor->numChannels = base->numChannels;
+	editor->numBins = numBins;
+	editor->fftSize = fftSize;
+	editor->graphHeight = graphHeight;
+	editor->decayBlocks = decayBlocks > 1.0f ? decayBlocks : 1.0f;
+
+	// Partition i holds the frames after those of the partitions before it
+	editor->blockLengths = (int *) malloc(sizeof(int) * editor->numBlocks);
+	editor->blockTimes = (float *) malloc(sizeof(float) * editor->numBlocks);
+	int64_t offset = 0;
+	for (i = 0; i < editor->numBlocks; i++) {
+		editor->blockLengths[i] = vector_get(&blockLengths, i);
+		editor->blockTimes[i] = (offset + editor->blockLengths[i] / 4)
+				/ (float) fftSize;
+		offset += editor->blockLengths[i] / 2;
+	}
+
+	editor->reference = (float *) malloc(sizeof(float) * numValues);
+	editor->posted = (float *) malloc(sizeof(float) * numValues);
+	memcpy(editor->reference, reference, sizeof(float) * numValues);
+	memcpy(editor->posted, reference, sizeof(float) * numValues);
+	for (i = 0; i < 2; i++) {
+		editor->spectra[i] = copyFFTData(base, editor->blockLengths);
+		editor->applied[i] = (float *) malloc(sizeof(float) * numValues);
+		memcpy(editor->applied[i], reference, sizeof(float) * numValues);
+	}
+
+	pthread_mutex_init(&editor->mutex, NULL);
+	pthread_cond_init(&editor->changed, NULL);
+	// The thread reads the base spectra until it stops
+	acquireFFTData(base);
+	editor->running = true;
+	if (pthread_create(&editor->thread, NULL, spectralEditThread, editor)
+			!= 0) {
+		editor->running = false;
+		releaseFFTData(base);
+		free_SpectralEditor(editor);
+		return NULL;
+	}
+	return editor;
+}
+
+bool ownsSpectra(const SpectralEditor *editor, const FFTData *fftData) {
+	return fftData == editor->spectra[0] || fftData == editor->spectra[1];
+}
+
+void postSpectralEdit(SpectralEditor *editor, const float *top) {
+	size_t size = sizeof(float) * editor->numChannels * editor->numBins;
+
+	pthread_mutex_lock(&editor->mutex);
+	if (memcmp(editor->posted, top, size) != 0) {
+		memcpy(editor->posted, top, size);
+		__atomic_add_fetch(&editor->postCount, 1, __ATOMIC_RELAXED);
+		pthread_cond_signal(&editor->changed);
+	}
+	pthread_mutex_unlock(&editor->mutex);
+}
+
+void stopSpectralEditor(SpectralEditor *editor) {
+	pthread_mutex_lock(&editor->mutex);
+	bool running = editor->running;
+	editor->running = false;
+	pthread_cond_signal(&editor->changed);
+	pthread_mutex_unlock(&editor->mutex);
+
+	// A partition being rewritten is finished first
+	if (running) {
+		pthread_join(editor->thread, NULL);
+		releaseFFTData(editor->base);
+	}
+}
+
+void free_SpectralEditor(SpectralEditor *editor) {
+	if (editor) {
+		stopSpectralEditor(editor);
+		for (int i = 0; i < 2; i++) {
+			free_FFTData(editor->spectra[i]);
+			free(editor->applied[i]);
+		}
+		free(editor->blockLengths);
+		free(editor->blockTimes);
+		free(editor->reference);
+		free(editor->posted);
+		pthread_mutex_destroy(&editor->mutex);
+		pthread_cond_destroy(&editor->changed);
+		free(editor);
+	}
+}
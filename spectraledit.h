@@ -0,0 +1,82 @@
+/*
+ * spectraledit.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Dawson
+ */
+
+#ifndef SPECTRALEDIT_H_
+#define SPECTRALEDIT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "dawsonaudio.h"
+#include "convolve.h"
+#include "vector.h"
+#include "impulse.h"
+
+/*
+ * Applies edits of the graph to an impulse's partition spectra as gains,
+ * without resynthesizing it. The engine convolves with one of the editor's
+ * two copies of the spectra. Whenever a new graph is posted, a background
+ * thread rewrites the other copy (once no partition is convolved with it any
+ * more) and hands it to the engine, so edits are heard while they are drawn
+ * and no partition sees a half-rewritten spectrum.
+ *
+ * Raising a bin's starting level from y to y' scales it by (y' / y)^(1 - t/T)
+ * at time t, since the bin still decays to the same floor at the end (T) of
+ * the impulse. Each partition takes the gains at its middle, interpolated
+ * between the graph's bins. It approximates what resynthesizing would give;
+ * Recompute still does that.
+ */
+typedef struct SpectralEditor {
+	FFTData *base; // the spectra as synthesized (not owned; used until stopped)
+	FFTData **engineSpectra; // where the engine takes its spectra from
+	FFTData *spectra[2]; // the edited copies
+	int published; // index of the copy the engine was given last
+	int numBlocks;
+	int *blockLengths;
+	float *blockTimes; // middle of each partition, in graph blocks
+	int numChannels;
+	int numBins; // graph bins per channel
+	int fftSize; // frames per graph bin (times 2) of the synthesis
+	float graphHeight;
+	float decayBlocks; // T, in graph blocks
+
+	float *reference; // [channel][bin] graph the base spectra come from
+	float *posted; // [channel][bin] latest graph to apply
+	float *applied[2]; // [channel][bin] graph each copy reflects
+	unsigned long postCount;
+
+	bool running;
+	pthread_mutex_t mutex;
+	pthread_cond_t changed;
+	pthread_t thread;
+} SpectralEditor;
+
+/*
+ * Start editing spectra (partitioned as blockLengths) that were synthesized
+ * from the graph reference ([channel][bin] top values). The caller gives the
+ * engine spectra[published] in place of base; rewritten copies replace it in
+ * *engineSpectra for as long as it is still there. Returns NULL if the
+ * thread can't be started.
+ */
+SpectralEditor *openSpectralEditor(FFTData *base, FFTData **engineSpectra,
+		Vector blockLengths, const float *reference, int numBins, int fftSize,
+		float graphHeight, float decayBlocks);
+
+// Whether fftData is one of the editor's copies
+bool ownsSpectra(const SpectralEditor *editor, const FFTData *fftData);
+
+// Have the edited spectra follow a new graph ([channel][bin] top values).
+// Only wakes the editor if the graph changed since the last post.
+void postSpectralEdit(SpectralEditor *editor, const float *top);
+
+// Stop the editor's thread (the edited spectra stay as they are)
+void stopSpectralEditor(SpectralEditor *editor);
+
+// Stop the editor and free its copies (which must have no users)
+void free_SpectralEditor(SpectralEditor *editor);
+
+#endif /* SPECTRALEDIT_H_ */
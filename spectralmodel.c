@@ -0,0 +1,162 @@
+/*
+ * spectralmodel.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "spectralmodel.h"
+
+#define SPECTRAL_MODEL_MAGIC		"CONVMODL"
+#define SPECTRAL_MODEL_ALIGNMENT	32
+
+typedef struct SpectralModelHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t numChannels;
+	uint64_t key;
+	int64_t numFrames;
+	uint32_t numBins;
+	uint32_t numBlocks;
+	uint32_t envelopeLength;
+	uint32_t envelopeSpacing;
+} SpectralModelHeader;
+
+SpectralModel *createSpectralModel(int numChannels, int numBins,
+		int envelopeLength) {
+
+	int c;
+
+	SpectralModel *model = (SpectralModel *) calloc(1, sizeof(SpectralModel));
+	model->numChannels = numChannels;
+	model->numBins = numBins;
+	model->A = (float **) malloc(sizeof(float *) * numChannels);
+	model->b = (float **) malloc(sizeof(float *) * numChannels);
+
+	// Every channel's A and b in one block, each row aligned for vector loads
+	int stride = (numBins + SPECTRAL_MODEL_ALIGNMENT / sizeof(float) - 1)
+			/ (SPECTRAL_MODEL_ALIGNMENT / sizeof(float))
+			* (SPECTRAL_MODEL_ALIGNMENT / sizeof(float));
+	void *data = NULL;
+	if (posix_memalign(&data, SPECTRAL_MODEL_ALIGNMENT,
+			sizeof(float) * stride * 2 * numChannels) != 0) {
+		printf("Error: unable to allocate memory. Exiting.\n");
+		exit(1);
+	}
+	memset(data, 0, sizeof(float) * stride * 2 * numChannels);
+	for (c = 0; c < numChannels; c++) {
+		model->A[c] = (float *) data + (size_t) 2 * c * stride;
+		model->b[c] = model->A[c] + stride;
+	}
+	model->envelopeLength = envelopeLength;
+	model->envelope = (float *) calloc(envelopeLength > 0 ? envelopeLength : 1,
+			sizeof(float));
+	return model;
+}
+
+void free_SpectralModel(SpectralModel *model) {
+	if (model) {
+		free(model->A[0]);
+		free(model->A);
+		free(model->b);
+		free(model->envelope);
+		free(model);
+	}
+}
+
+SpectralModel *readSpectralModel(const char *fileName, uint64_t key) {
+
+	SpectralModelHeader header;
+	int c;
+
+	FILE *file = fopen(fileName, "rb");
+	if (file == NULL) {
+		return NULL;
+	}
+
+	if (fread(&header, sizeof(header), 1, file) != 1
+			|| memcmp(header.magic, SPECTRAL_MODEL_MAGIC,
+					sizeof(header.magic)) != 0
+			|| header.version != SPECTRAL_MODEL_VERSION || header.key != key
+			|| header.numChannels == 0 || header.numChannels > 256
+			|| header.numBins == 0 || header.numBins > (1 << 20)
+			|| header.envelopeLength > (1 << 24)) {
+		fclose(file);
+		return NULL;
+	}
+
+	SpectralModel *model = createSpectralModel((int) header.numChannels,
+			(int) header.numBins, (int) header.envelopeLength);
+	model->numBlocks = (int) header.numBlocks;
+	model->numFrames = header.numFrames;
+	model->envelopeSpacing = (int) header.envelopeSpacing;
+
+	bool ok = true;
+	for (c = 0; ok && c < model->numChannels; c++) {
+		ok = fread(model->A[c], sizeof(float), model->numBins, file)
+				== (size_t) model->numBins
+				&& fread(model->b[c], sizeof(float), model->numBins, file)
+						== (size_t) model->numBins;
+	}
+	ok = ok && fread(model->envelope, sizeof(float), model->envelopeLength, file)
+			== (size_t) model->envelopeLength;
+	fclose(file);
+
+	if (!ok) {
+		free_SpectralModel(model);
+		return NULL;
+	}
+	return model;
+}
+
+bool writeSpectralModel(const char *fileName, uint64_t key,
+		SpectralModel *model) {
+
+	SpectralModelHeader header;
+	int c;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SPECTRAL_MODEL_MAGIC, sizeof(header.magic));
+	header.version = SPECTRAL_MODEL_VERSION;
+	header.numChannels = (uint32_t) model->numChannels;
+	header.key = key;
+	header.numFrames = model->numFrames;
+	header.numBins = (uint32_t) model->numBins;
+	header.numBlocks = (uint32_t) model->numBlocks;
+	header.envelopeLength = (uint32_t) model->envelopeLength;
+	header.envelopeSpacing = (uint32_t) model->envelopeSpacing;
+
+	// Write beside the final name, then rename over it
+	size_t nameLength = strlen(fileName) + 16;
+	char *tempName = (char *) malloc(nameLength);
+	snprintf(tempName, nameLength, "%s.%ld", fileName, (long) getpid());
+
+	FILE *file = fopen(tempName, "wb");
+	bool ok = file != NULL
+			&& fwrite(&header, sizeof(header), 1, file) == 1;
+	for (c = 0; ok && c < model->numChannels; c++) {
+		ok = fwrite(model->A[c], sizeof(float), model->numBins, file)
+				== (size_t) model->numBins
+				&& fwrite(model->b[c], sizeof(float), model->numBins, file)
+						== (size_t) model->numBins;
+	}
+	ok = ok && fwrite(model->envelope, sizeof(float), model->envelopeLength,
+			file) == (size_t) model->envelopeLength;
+
+	if (file && fclose(file) != 0) {
+		ok = false;
+	}
+	if (ok) {
+		ok = rename(tempName, fileName) == 0;
+	}
+	if (!ok) {
+		unlink(tempName);
+	}
+
+	free(tempName);
+	return ok;
+}
@@ -0,0 +1,49 @@
+/*
+ * spectralmodel.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#ifndef SPECTRALMODEL_H_
+#define SPECTRALMODEL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SPECTRAL_MODEL_VERSION		2
+
+/*
+ * What the synthesis keeps from analyzing an impulse: for every channel and
+ * frequency bin, an exponential decay A * exp(b * block) fitted to the bin's
+ * magnitude over time, and the average amplitude of the impulse over each
+ * envelopeSpacing frames. It is a few KB however long the impulse is.
+ * (g_max is the largest A of the channels synthesized so far, so it is not
+ * stored separately.)
+ */
+typedef struct SpectralModel {
+	int numChannels;
+	int numBins;
+	int numBlocks; // analysis blocks the fit spans
+	int64_t numFrames; // frames of the (zero-padded) impulse
+	float **A; // [channel][bin], rows of one aligned allocation
+	float **b; // [channel][bin], in the same allocation
+	int envelopeLength;
+	int envelopeSpacing;
+	float *envelope; // average amplitude of channel 0 per envelopeSpacing frames
+} SpectralModel;
+
+SpectralModel *createSpectralModel(int numChannels, int numBins,
+		int envelopeLength);
+
+void free_SpectralModel(SpectralModel *model);
+
+// Read a model saved for key, or return NULL if the file is missing, stale
+// or damaged
+SpectralModel *readSpectralModel(const char *fileName, uint64_t key);
+
+// Save a model (atomically). Returns false on failure.
+bool writeSpectralModel(const char *fileName, uint64_t key,
+		SpectralModel *model);
+
+#endif /* SPECTRALMODEL_H_ */
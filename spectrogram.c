@@ -0,0 +1,71 @@
+/*
+ * spectrogram.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Dawson
+ */
+
+#include <math.h>
+#include "spectrogram.h"
+#include "fastmath.h"
+
+// Blocks between exact restarts of the recurrence in
+// fillExponentialSpectrogram()
+#define RECURRENCE_SPAN		64
+
+Spectrogram *createSpectrogram(int numBlocks, int numBins, Arena *arena) {
+	int alignment = ARENA_ALIGNMENT / sizeof(float);
+
+	Spectrogram *spectrogram = (Spectrogram *) arenaAlloc(arena,
+			sizeof(Spectrogram));
+	spectrogram->numBlocks = numBlocks;
+	spectrogram->numBins = numBins;
+	spectrogram->stride = (numBins + alignment - 1) / alignment * alignment;
+	spectrogram->data = (float *) arenaAlloc(arena,
+			sizeof(float) * spectrogram->stride * numBlocks);
+	return spectrogram;
+}
+
+/*
+ * Each block is the one before it times exp(b), four bins at a time. Every
+ * RECURRENCE_SPAN blocks the values are recomputed with exp() so the error
+ * stays bounded.
+ */
+void fillExponentialSpectrogram(Spectrogram *spectrogram, const float *A,
+		const float *b, Arena *arena) {
+
+	int i, j;
+	int numBins = spectrogram->numBins;
+	int vectorBins = numBins - numBins % SIMD_WIDTH;
+
+	float *step = (float *) arenaAlloc(arena, sizeof(float) * numBins);
+	for (j = 0; j < vectorBins; j += SIMD_WIDTH) {
+		v4sf_store(step + j, v4sf_exp(v4sf_load(b + j)));
+	}
+	for (; j < numBins; j++) {
+		step[j] = expf(b[j]);
+	}
+
+	for (i = 0; i < spectrogram->numBlocks; i++) {
+		float *block = getSpectrogramBlock(spectrogram, i);
+
+		if (i % RECURRENCE_SPAN == 0) {
+			for (j = 0; j < vectorBins; j += SIMD_WIDTH) {
+				v4sf_store(block + j, v4sf_load(A + j)
+						* v4sf_exp(v4sf_load(b + j) * (float) i));
+			}
+			for (; j < numBins; j++) {
+				block[j] = A[j] * expf(b[j] * i);
+			}
+		} else {
+			const float *previous = block - spectrogram->stride;
+			for (j = 0; j < vectorBins; j += SIMD_WIDTH) {
+				v4sf_store(block + j,
+						v4sf_load(previous + j) * v4sf_load(step + j));
+			}
+			for (; j < numBins; j++) {
+				block[j] = previous[j] * step[j];
+			}
+		}
+	}
+}
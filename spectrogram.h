@@ -0,0 +1,38 @@
+/*
+ * spectrogram.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Dawson
+ */
+
+#ifndef SPECTROGRAM_H_
+#define SPECTROGRAM_H_
+
+#include "arena.h"
+
+/*
+ * Magnitudes of an impulse's frequency bins over time, measured or fitted.
+ * Every block's bins are contiguous and aligned, and the blocks follow each
+ * other in one allocation, which is the order both the analysis and the
+ * synthesis walk them in.
+ */
+typedef struct Spectrogram {
+	int numBlocks;
+	int numBins;
+	int stride; // floats from one block to the next
+	float *data; // [block * stride + bin]
+} Spectrogram;
+
+// Allocate a spectrogram (uninitialized) from an arena
+Spectrogram *createSpectrogram(int numBlocks, int numBins, Arena *arena);
+
+static inline float *getSpectrogramBlock(const Spectrogram *spectrogram,
+		int block) {
+	return spectrogram->data + (size_t) block * spectrogram->stride;
+}
+
+// Fill every bin with A[bin] * exp(b[bin] * block)
+void fillExponentialSpectrogram(Spectrogram *spectrogram, const float *A,
+		const float *b, Arena *arena);
+
+#endif /* SPECTROGRAM_H_ */
@@ -0,0 +1,211 @@
+/*
+ * writer.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "writer.h"
+#include "sampleformat.h"
+
+#define DITHER_SEED				0x9e3779b9u
+
+// Uniform in [0, 1)
+static inline float nextUniform(uint32_t *state) {
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+// Adds triangular (TPDF) noise of +/- 1 LSB, which decorrelates the
+// quantization error from the signal
+static void addTPDFDither(float *samples, long length, float lsb,
+		uint32_t *state) {
+
+	long i;
+
+	for (i = 0; i < length; i++) {
+		samples[i] += (nextUniform(state) - nextUniform(state)) * lsb;
+	}
+}
+
+// Dithers and encodes a chunk, then writes it. Returns false on a short write.
+static bool writeChunk(AudioWriter *writer, float *chunk, int numFrames) {
+
+	long length = (long) numFrames * writer->numChannels;
+	sf_count_t written;
+
+	switch (writer->format) {
+	case OUTPUT_PCM_16:
+		addTPDFDither(chunk, length, 1.0f / 32768.0f, &writer->ditherState);
+		floatToInt16(chunk, (int16_t *) writer->encoded, length);
+		written = sf_writef_short(writer->file,
+				(const short *) writer->encoded, numFrames);
+		break;
+	case OUTPUT_PCM_24:
+		addTPDFDither(chunk, length, 1.0f / 8388608.0f, &writer->ditherState);
+		floatToInt24In32(chunk, (int32_t *) writer->encoded, length);
+		written = sf_writef_int(writer->file, (const int *) writer->encoded,
+				numFrames);
+		break;
+	default:
+		written = sf_writef_float(writer->file, chunk, numFrames);
+		break;
+	}
+
+	return written == numFrames;
+}
+
+static void *writerThread(void *arg) {
+
+	AudioWriter *writer = (AudioWriter *) arg;
+	int next = 0;
+
+	while (true) {
+		pthread_mutex_lock(&writer->mutex);
+		while (writer->chunkLength[next] == 0 && !writer->finished) {
+			pthread_cond_wait(&writer->changed, &writer->mutex);
+		}
+		int numFrames = writer->chunkLength[next];
+		pthread_mutex_unlock(&writer->mutex);
+
+		// Finished, and everything queued has been written
+		if (numFrames == 0) {
+			break;
+		}
+
+		bool ok = writeChunk(writer, writer->chunks[next], numFrames);
+
+		pthread_mutex_lock(&writer->mutex);
+		if (!ok) {
+			writer->failed = true;
+		}
+		writer->chunkLength[next] = 0;
+		pthread_cond_signal(&writer->changed);
+		pthread_mutex_unlock(&writer->mutex);
+
+		next ^= 1;
+	}
+
+	return NULL;
+}
+
+AudioWriter *openAudioWriter(const char *fileName, int sampleRate,
+		int numChannels, OutputFormat format, int chunkFrames) {
+
+	SF_INFO sfinfo_out;
+	int i;
+
+	memset(&sfinfo_out, 0, sizeof(SF_INFO));
+	sfinfo_out.samplerate = sampleRate;
+	sfinfo_out.channels = numChannels;
+	sfinfo_out.format = SF_FORMAT_WAV
+			| (format == OUTPUT_PCM_16 ? SF_FORMAT_PCM_16 :
+				format == OUTPUT_PCM_24 ? SF_FORMAT_PCM_24 : SF_FORMAT_FLOAT);
+	if (!sf_format_check(&sfinfo_out)) {
+		printf("error: incorrect audio file format\n");
+		return NULL;
+	}
+
+	SNDFILE *file = sf_open(fileName, SFM_WRITE, &sfinfo_out);
+	if (file == NULL) {
+		printf("error, couldn't open the file\n");
+		return NULL;
+	}
+
+	AudioWriter *writer = (AudioWriter *) calloc(1, sizeof(AudioWriter));
+	writer->file = file;
+	writer->format = format;
+	writer->numChannels = numChannels;
+	writer->chunkFrames = chunkFrames;
+	for (i = 0; i < 2; i++) {
+		writer->chunks[i] = (float *) malloc(
+				sizeof(float) * chunkFrames * numChannels);
+	}
+	// Large enough for any of the formats (at most 4 bytes per sample)
+	writer->encoded = malloc(sizeof(int32_t) * chunkFrames * numChannels);
+	writer->ditherState = DITHER_SEED;
+
+	pthread_mutex_init(&writer->mutex, NULL);
+	pthread_cond_init(&writer->changed, NULL);
+	if (pthread_create(&writer->thread, NULL, writerThread, writer) != 0) {
+		printf("Error: unable to start the writer thread. Exiting.\n");
+		exit(1);
+	}
+
+	return writer;
+}
+
+float *audioWriterGetChunk(AudioWriter *writer) {
+
+	int filling = writer->filling;
+
+	pthread_mutex_lock(&writer->mutex);
+	while (writer->chunkLength[filling] != 0) {
+		pthread_cond_wait(&writer->changed, &writer->mutex);
+	}
+	pthread_mutex_unlock(&writer->mutex);
+
+	return writer->chunks[filling];
+}
+
+void audioWriterSubmit(AudioWriter *writer, int numFrames) {
+
+	if (numFrames <= 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&writer->mutex);
+	writer->chunkLength[writer->filling] = numFrames;
+	pthread_cond_signal(&writer->changed);
+	pthread_mutex_unlock(&writer->mutex);
+
+	writer->filling ^= 1;
+}
+
+void audioWriterWrite(AudioWriter *writer, const float *frames,
+		long numFrames) {
+
+	long first;
+
+	for (first = 0; first < numFrames; first += writer->chunkFrames) {
+		int count = numFrames - first < writer->chunkFrames ?
+				(int) (numFrames - first) : writer->chunkFrames;
+		float *chunk = audioWriterGetChunk(writer);
+		memcpy(chunk, frames + first * writer->numChannels,
+				sizeof(float) * count * writer->numChannels);
+		audioWriterSubmit(writer, count);
+	}
+}
+
+bool closeAudioWriter(AudioWriter *writer) {
+
+	int i;
+
+	pthread_mutex_lock(&writer->mutex);
+	writer->finished = true;
+	pthread_cond_signal(&writer->changed);
+	pthread_mutex_unlock(&writer->mutex);
+	pthread_join(writer->thread, NULL);
+
+	bool ok = !writer->failed;
+	if (sf_close(writer->file) != 0) {
+		ok = false;
+	}
+
+	pthread_cond_destroy(&writer->changed);
+	pthread_mutex_destroy(&writer->mutex);
+	for (i = 0; i < 2; i++) {
+		free(writer->chunks[i]);
+	}
+	free(writer->encoded);
+	free(writer);
+
+	return ok;
+}
@@ -0,0 +1,65 @@
+/*
+ * writer.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Dawson
+ */
+
+#ifndef WRITER_H_
+#define WRITER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sndfile.h>
+
+typedef enum OutputFormat {
+	OUTPUT_PCM_16,	// 16-bit .wav, TPDF dithered
+	OUTPUT_PCM_24,	// 24-bit .wav, TPDF dithered
+	OUTPUT_FLOAT	// 32-bit float .wav
+} OutputFormat;
+
+/*
+ * Streams interleaved audio to a .wav file from a background thread. The
+ * caller renders into one chunk while the thread dithers, encodes and writes
+ * the other, so only two chunks of output are ever held in memory.
+ */
+typedef struct AudioWriter {
+	SNDFILE *file;
+	OutputFormat format;
+	int numChannels;
+	int chunkFrames;
+
+	float *chunks[2]; // interleaved
+	int chunkLength[2]; // frames queued for writing (0 when free)
+	int filling; // chunk handed to the caller
+	void *encoded; // one chunk in the file's sample format
+	uint32_t ditherState;
+
+	bool finished;
+	bool failed;
+	pthread_mutex_t mutex;
+	pthread_cond_t changed;
+	pthread_t thread;
+} AudioWriter;
+
+// Open a .wav file and start the writer thread. Returns NULL if the file
+// can't be opened.
+AudioWriter *openAudioWriter(const char *fileName, int sampleRate,
+		int numChannels, OutputFormat format, int chunkFrames);
+
+// The chunk to render into next (room for chunkFrames interleaved frames).
+// Only waits if the thread is still writing the chunk before last.
+float *audioWriterGetChunk(AudioWriter *writer);
+
+// Queue the first numFrames frames of the chunk from audioWriterGetChunk
+void audioWriterSubmit(AudioWriter *writer, int numFrames);
+
+// Copy numFrames interleaved frames into chunks and queue them
+void audioWriterWrite(AudioWriter *writer, const float *frames, long numFrames);
+
+// Write everything queued and close the file. Returns false if any write
+// failed.
+bool closeAudioWriter(AudioWriter *writer);
+
+#endif /* WRITER_H_ */